@@ -33,6 +33,10 @@
 #include "hphp/runtime/vm/member_operations.h"
 #include "hphp/runtime/base/stats.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // If PEDANTIC is defined, extra checks are performed to ensure correct
 // function even as an array approaches 2^31 elements.  In practice this is
 // just wasted effort though, since such an array would require on the order of
@@ -119,10 +123,13 @@ inline void HphpArray::init(uint capacity) {
   initHash(m_hash, tableSize);
 }
 
+// New arrays start out packed; the hash is built by unpack() the first
+// time a key other than the next append index is inserted.
 HphpArray::HphpArray(uint capacity)
     : ArrayData(ArrayKind::kHphpArray, AllocationMode::smart, 0)
     , m_used(0)
     , m_hLoad(0)
+    , m_packed(true)
     , m_nextKI(0) {
 #ifdef PEDANTIC
   if (size > 0x7fffffffU) {
@@ -130,13 +137,14 @@ HphpArray::HphpArray(uint capacity)
   }
 #endif
   assert(m_size == 0);
-  init(capacity);
+  initWithoutHash(capacity);
 }
 
 HphpArray::HphpArray(uint size, const TypedValue* values)
     : ArrayData(ArrayKind::kHphpArray, AllocationMode::smart, size)
     , m_used(size)
     , m_hLoad(size)
+    , m_packed(true)
     , m_nextKI(size) {
 #ifdef PEDANTIC
   if (size > 0x7fffffffU) {
@@ -147,21 +155,15 @@ HphpArray::HphpArray(uint size, const TypedValue* values)
   assert(size <= m_tableMask + 1);
   // append values by moving -- Caller assumes we update refcount.  Values
   // are in reverse order since they come from the stack, which grows down.
-  // This code is hand-specialized from nextInsert().
+  // This code is hand-specialized from nextInsert(); the array is packed
+  // so the hash is left uninitialized.
   assert(m_size == size && m_hLoad == size && m_nextKI == size);
-  ElmInd* hash = m_hash;
   Elm* data = m_data;
-  uint i = 0;
-  for (; i < size; i++) {
+  for (uint i = 0; i < size; i++) {
     const TypedValue& tv = values[size - i - 1];
     data[i].data.m_data = tv.m_data;
     data[i].data.m_type = tv.m_type;
     data[i].setIntKey(i);
-    hash[i] = i;
-  }
-  // Initialize the leftover hash
-  for (; i <= m_tableMask; i++) {
-    hash[i] = ElmIndEmpty;
   }
   assert(m_size == size);
   assert(m_hLoad == size);
@@ -174,6 +176,7 @@ HphpArray::HphpArray(EmptyMode)
     : ArrayData(ArrayKind::kHphpArray, AllocationMode::smart, 0)
     , m_used(0)
     , m_hLoad(0)
+    , m_packed(true)
     , m_nextKI(0) {
   init(0);
   setStatic();
@@ -409,6 +412,30 @@ Variant HphpArray::each() {
 
 #define STRING_HASH(x)   (int32_t(x) | 0x80000000)
 
+/*
+ * Compare the bytes of two string keys of the same length.  Most array
+ * keys are short, so keys of up to 16 bytes are compared with one SSE2
+ * load from each side instead of a call to memcmp.  The loads may read
+ * past the end of a key, so they are only used when they can't cross
+ * into the next page.
+ */
+static inline bool keyBytesEqual(const char* a, const char* b, int len) {
+#ifdef __SSE2__
+  const uintptr_t kPageMask = 4095;
+  const uintptr_t kLastSafe = 4096 - sizeof(__m128i);
+  if (len <= int(sizeof(__m128i)) &&
+      (uintptr_t(a) & kPageMask) <= kLastSafe &&
+      (uintptr_t(b) & kPageMask) <= kLastSafe) {
+    auto const va = _mm_loadu_si128((const __m128i*)a);
+    auto const vb = _mm_loadu_si128((const __m128i*)b);
+    uint32_t eq = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+    uint32_t mask = (1U << len) - 1;
+    return (eq & mask) == mask;
+  }
+#endif
+  return memcmp(a, b, len) == 0;
+}
+
 static bool hitStringKey(const HphpArray::Elm* e, const StringData* s,
                          int32_t hash) {
   // hitStringKey() should only be called on an Elm that is referenced by a
@@ -428,7 +455,7 @@ static bool hitStringKey(const HphpArray::Elm* e, const StringData* s,
   const char* sdata = s->data();
   int slen = s->size();
   return data == sdata || ((e->key->size() == slen)
-                          && (memcmp(data, sdata, slen) == 0));
+                          && keyBytesEqual(data, sdata, slen));
 }
 
 static bool hitIntKey(const HphpArray::Elm* e, int64_t ki) {
@@ -470,6 +497,9 @@ static bool hitIntKey(const HphpArray::Elm* e, int64_t ki) {
 
 NEVER_INLINE
 ssize_t HphpArray::find(int64_t ki) const {
+  if (m_packed) {
+    return uint64_t(ki) < m_used ? ki : ssize_t(ElmIndEmpty);
+  }
   if (uint64_t(ki) < m_size) {
     // Try to get at it without dirtying a data cache line.
     Elm* e = m_data + uint64_t(ki);
@@ -489,6 +519,7 @@ ssize_t HphpArray::find(int64_t ki) const {
 NEVER_INLINE
 ssize_t HphpArray::find(const StringData* s,
                                    strhash_t prehash) const {
+  if (m_packed) return ElmIndEmpty;
   int32_t h = STRING_HASH(prehash);
   FIND_BODY(prehash, hitStringKey(&elms[pos], s, h));
 }
@@ -535,13 +566,15 @@ HphpArray::ElmInd* warnUnbalanced(size_t n, HphpArray::ElmInd* ei) {
   }
 
 NEVER_INLINE
-HphpArray::ElmInd* HphpArray::findForInsert(int64_t ki) const {
+HphpArray::ElmInd* HphpArray::findForInsert(int64_t ki) {
+  if (m_packed) unpack();
   FIND_FOR_INSERT_BODY(ki, hitIntKey(&elms[pos], ki));
 }
 
 NEVER_INLINE
 HphpArray::ElmInd* HphpArray::findForInsert(const StringData* s,
-                                            strhash_t prehash) const {
+                                            strhash_t prehash) {
+  if (m_packed) unpack();
   int32_t h = STRING_HASH(prehash);
   FIND_FOR_INSERT_BODY(prehash, hitStringKey(&elms[pos], s, h));
 }
@@ -622,6 +655,20 @@ inline ALWAYS_INLINE HphpArray::Elm* HphpArray::allocElm(ElmInd* ei) {
   return e;
 }
 
+inline ALWAYS_INLINE HphpArray::Elm* HphpArray::allocPackedElmFast() {
+  assert(m_packed && !isFull());
+  assert(m_size == m_used && m_hLoad == m_size && m_nextKI == m_used);
+  ++m_size;
+  ++m_hLoad;
+  return &m_data[m_used++];
+}
+
+inline ALWAYS_INLINE HphpArray::Elm* HphpArray::allocPackedElm() {
+  Elm* e = allocPackedElmFast();
+  if (m_pos == ArrayData::invalid_index) m_pos = ssize_t(m_used - 1);
+  return e;
+}
+
 inline ALWAYS_INLINE
 HphpArray::Elm* HphpArray::newElm(ElmInd* ei, size_t h0) {
   if (isFull()) return newElmGrow(h0);
@@ -668,6 +715,8 @@ void HphpArray::newElmStr(ElmInd* ei, strhash_t h, StringData* key,
   initElmStr(newElm(ei, h), h, key, data, byRef);
 }
 
+// Big packed arrays get no room for the hash after their elements;
+// m_hash stays null until unpack() or compact() needs it (see allocHash).
 void HphpArray::allocData(size_t maxElms, size_t tableSize) {
   if (maxElms <= SmallSize) {
     m_data = m_inline_data.slots;
@@ -676,14 +725,15 @@ void HphpArray::allocData(size_t maxElms, size_t tableSize) {
   }
   size_t hashSize = tableSize * sizeof(ElmInd);
   size_t dataSize = maxElms * sizeof(Elm);
-  size_t allocSize = hashSize <= sizeof(m_inline_hash) ? dataSize :
-                     dataSize + hashSize;
+  bool inlineHash = hashSize <= sizeof(m_inline_hash);
+  size_t allocSize = inlineHash || m_packed ? dataSize : dataSize + hashSize;
   if (m_allocMode == AllocationMode::smart) {
     m_data = (Elm*) smart_malloc(allocSize);
   } else {
     m_data = (Elm*) Util::safe_malloc(allocSize);
   }
-  m_hash = hashSize <= sizeof(m_inline_hash) ? m_inline_hash :
+  m_hash = inlineHash ? m_inline_hash :
+           m_packed ? nullptr :
            (ElmInd*)(uintptr_t(m_data) + dataSize);
 }
 
@@ -691,8 +741,8 @@ void HphpArray::reallocData(size_t maxElms, size_t tableSize, uint oldMask) {
   assert(m_data && oldMask > 0 && maxElms > SmallSize);
   size_t hashSize = tableSize * sizeof(ElmInd);
   size_t dataSize = maxElms * sizeof(Elm);
-  size_t allocSize = hashSize <= sizeof(m_inline_hash) ? dataSize :
-                     dataSize + hashSize;
+  bool inlineHash = hashSize <= sizeof(m_inline_hash);
+  size_t allocSize = inlineHash || m_packed ? dataSize : dataSize + hashSize;
   size_t oldDataSize = computeMaxElms(oldMask) * sizeof(Elm); // slots only.
   if (m_allocMode == AllocationMode::smart) {
     if (m_data == m_inline_data.slots) {
@@ -710,10 +760,25 @@ void HphpArray::reallocData(size_t maxElms, size_t tableSize, uint oldMask) {
     }
     m_data = (Elm*) Util::safe_realloc(m_data, allocSize);
   }
-  m_hash = hashSize <= sizeof(m_inline_hash) ? m_inline_hash :
+  m_hash = inlineHash ? m_inline_hash :
+           m_packed ? nullptr :
            (ElmInd*)(uintptr_t(m_data) + dataSize);
 }
 
+void HphpArray::allocHash() {
+  if (m_hash) return;
+  assert(m_packed && m_data != m_inline_data.slots);
+  size_t dataSize = computeMaxElms(m_tableMask) * sizeof(Elm);
+  size_t allocSize = dataSize +
+    computeTableSize(m_tableMask) * sizeof(ElmInd);
+  if (m_allocMode == AllocationMode::smart) {
+    m_data = (Elm*) smart_realloc(m_data, allocSize);
+  } else {
+    m_data = (Elm*) Util::safe_realloc(m_data, allocSize);
+  }
+  m_hash = (ElmInd*)(uintptr_t(m_data) + dataSize);
+}
+
 inline ALWAYS_INLINE void HphpArray::resizeIfNeeded() {
   if (isFull()) resize();
 }
@@ -752,6 +817,7 @@ void HphpArray::grow() {
   size_t tableSize = computeTableSize(m_tableMask);
   size_t maxElms = computeMaxElms(m_tableMask);
   reallocData(maxElms, tableSize, oldMask);
+  if (m_packed) return;
   // All the elements have been copied and their offsets from the base are
   // still the same, so we just need to build the new hash table.
   initHash(m_hash, tableSize);
@@ -778,6 +844,21 @@ void HphpArray::grow() {
   }
 }
 
+void HphpArray::unpack() {
+  assert(m_packed);
+  allocHash();
+  m_packed = false;
+  initHash(m_hash, computeTableSize(m_tableMask));
+  // Key i lives at m_data[i] and m_used <= m_tableMask, so every key
+  // hashes straight to its own slot.
+  Elm* elms = m_data;
+  for (uint32_t pos = 0, limit = m_used; pos < limit; ++pos) {
+    if (elms[pos].data.m_type == KindOfTombstone) continue;
+    assert(elms[pos].hasIntKey() && elms[pos].ikey == pos);
+    m_hash[pos] = pos;
+  }
+}
+
 void HphpArray::compact(bool renumber /* = false */) {
   ElmKey mPos;
   if (m_pos != ArrayData::invalid_index) {
@@ -803,6 +884,11 @@ void HphpArray::compact(bool renumber /* = false */) {
   if (renumber) {
     m_nextKI = 0;
   }
+  // The hash is rebuilt from scratch below; afterwards the array is packed
+  // again if its keys came out as 0..m_size-1 (e.g. after renumbering).
+  if (m_packed) allocHash();
+  m_packed = false;
+  bool packed = true;
   Elm* elms = m_data;
   size_t tableSize = computeTableSize(m_tableMask);
   initHash(m_hash, tableSize);
@@ -825,6 +911,7 @@ void HphpArray::compact(bool renumber /* = false */) {
     if (renumber && !toE.hasStrKey()) {
       toE.ikey = m_nextKI++;
     }
+    packed = packed && toE.hasIntKey() && toE.ikey == toPos;
     ElmInd* ie = findForNewInsert(toE.hasIntKey() ? toE.ikey : toE.hash());
     *ie = toPos;
   }
@@ -832,6 +919,7 @@ void HphpArray::compact(bool renumber /* = false */) {
 #ifdef DEBUG
   m_hLoad = m_size;
 #endif
+  m_packed = packed && m_nextKI == int64_t(m_used);
   if (m_pos != ArrayData::invalid_index) {
     // Update m_pos, now that compaction is complete.
     if (mPos.hash) {
@@ -868,6 +956,14 @@ bool HphpArray::nextInsert(CVarRef data) {
   }
   resizeIfNeeded();
   int64_t ki = m_nextKI;
+  if (m_packed) {
+    if (LIKELY(ki == m_used)) {
+      initElmInt(allocPackedElm(), ki, data);
+      ++m_nextKI;
+      return true;
+    }
+    unpack();
+  }
   // The check above enforces an invariant that allows us to always
   // know that m_nextKI is not present in the array, so it is safe
   // to use findForNewInsert()
@@ -880,6 +976,24 @@ bool HphpArray::nextInsert(CVarRef data) {
   return true;
 }
 
+bool HphpArray::setPacked(int64_t ki, CVarRef data) {
+  if (!m_packed || getCount() > 1) return false;
+  if (uint64_t(ki) < m_used) {
+    tvAsVariant(&m_data[ki].data).assignValHelper(data);
+    return true;
+  }
+  return ki == m_used && appendPacked(data);
+}
+
+bool HphpArray::appendPacked(CVarRef data) {
+  if (!m_packed || getCount() > 1 || isFull()) return false;
+  int64_t ki = m_nextKI;
+  if (ki != m_used) return false;
+  initElmInt(allocPackedElm(), ki, data);
+  ++m_nextKI;
+  return true;
+}
+
 ArrayData* HphpArray::nextInsertRef(CVarRef data) {
   if (UNLIKELY(m_nextKI < 0)) {
     raise_warning("Cannot add element to the array as the next element is "
@@ -888,6 +1002,14 @@ ArrayData* HphpArray::nextInsertRef(CVarRef data) {
   }
   resizeIfNeeded();
   int64_t ki = m_nextKI;
+  if (m_packed) {
+    if (LIKELY(ki == m_used)) {
+      initElmInt(allocPackedElm(), ki, data, true /*byRef*/);
+      ++m_nextKI;
+      return this;
+    }
+    unpack();
+  }
   // The check above enforces an invariant that allows us to always
   // know that m_nextKI is not present in the array, so it is safe
   // to use findForNewInsert()
@@ -901,11 +1023,15 @@ ArrayData* HphpArray::nextInsertRef(CVarRef data) {
 ArrayData* HphpArray::nextInsertWithRef(CVarRef data) {
   resizeIfNeeded();
   int64_t ki = m_nextKI;
-  ElmInd* ei = findForInsert(ki);
-  assert(!validElmInd(*ei));
-
-  // Allocate a new element.
-  Elm* e = allocElm(ei);
+  Elm* e;
+  if (m_packed && ki == m_used) {
+    e = allocPackedElm();
+  } else {
+    ElmInd* ei = findForInsert(ki);
+    assert(!validElmInd(*ei));
+    // Allocate a new element.
+    e = allocElm(ei);
+  }
   tvWriteNull(&e->data);
   tvAsVariant(&e->data).setWithRef(data);
   // Set key.
@@ -917,6 +1043,17 @@ ArrayData* HphpArray::nextInsertWithRef(CVarRef data) {
 
 ArrayData* HphpArray::addLvalImpl(int64_t ki, Variant** pDest) {
   assert(pDest != nullptr);
+  if (m_packed) {
+    if (uint64_t(ki) < m_used) {
+      *pDest = &tvAsVariant(&m_data[ki].data);
+      return this;
+    }
+    if (ki == m_used) {
+      nextInsert(null_variant);
+      *pDest = &tvAsVariant(&m_data[ki].data);
+      return this;
+    }
+  }
   ElmInd* ei = findForInsert(ki);
   if (validElmInd(*ei)) {
     *pDest = &tvAsVariant(&m_data[*ei].data);
@@ -956,8 +1093,13 @@ ArrayData* HphpArray::addLvalImpl(StringData* key, strhash_t h, Variant** pDest)
 inline ArrayData* HphpArray::addVal(int64_t ki, CVarRef data) {
   assert(!exists(ki));
   resizeIfNeeded();
-  ElmInd* ei = findForNewInsert(ki);
-  Elm* e = allocElm(ei);
+  Elm* e;
+  if (m_packed && ki == m_nextKI && ki == m_used) {
+    e = allocPackedElm();
+  } else {
+    if (m_packed) unpack();
+    e = allocElm(findForNewInsert(ki));
+  }
   TypedValue* fr = (TypedValue*)(&data);
   TypedValue* to = (TypedValue*)(&e->data);
   elemConstruct(fr, to);
@@ -971,6 +1113,7 @@ inline ArrayData* HphpArray::addVal(int64_t ki, CVarRef data) {
 inline ArrayData* HphpArray::addVal(StringData* key, CVarRef data) {
   assert(!exists(key));
   resizeIfNeeded();
+  if (m_packed) unpack();
   strhash_t h = key->hash();
   ElmInd* ei = findForNewInsert(h);
   Elm *e = allocElm(ei);
@@ -985,6 +1128,10 @@ inline ArrayData* HphpArray::addVal(StringData* key, CVarRef data) {
 }
 
 inline ArrayData* HphpArray::addValWithRef(int64_t ki, CVarRef data) {
+  if (m_packed) {
+    if (uint64_t(ki) < m_used) return this;
+    if (ki == m_used) return nextInsertWithRef(data);
+  }
   resizeIfNeeded();
   ElmInd* ei = findForInsert(ki);
   if (!validElmInd(*ei)) {
@@ -1015,6 +1162,16 @@ inline ArrayData* HphpArray::addValWithRef(StringData* key, CVarRef data) {
 
 inline INLINE_SINGLE_CALLER
 ArrayData* HphpArray::update(int64_t ki, CVarRef data) {
+  if (m_packed) {
+    if (uint64_t(ki) < m_used) {
+      tvAsVariant(&m_data[ki].data).assignValHelper(data);
+      return this;
+    }
+    if (ki == m_used) {
+      nextInsert(data);
+      return this;
+    }
+  }
   ElmInd* ei = findForInsert(ki);
   if (validElmInd(*ei)) {
     Elm* e = &m_data[*ei];
@@ -1042,6 +1199,13 @@ ArrayData* HphpArray::update(StringData* key, CVarRef data) {
 }
 
 ArrayData* HphpArray::updateRef(int64_t ki, CVarRef data) {
+  if (m_packed) {
+    if (uint64_t(ki) < m_used) {
+      tvAsVariant(&m_data[ki].data).assignRefHelper(data);
+      return this;
+    }
+    if (ki == m_used) return nextInsertRef(data);
+  }
   ElmInd* ei = findForInsert(ki);
   if (validElmInd(*ei)) {
     Elm* e = &m_data[*ei];
@@ -1377,17 +1541,23 @@ ArrayData* genericAddNewElemC(ArrayData* a, TypedValue value) {
 ArrayData* HphpArray::AddNewElemC(ArrayData* a, TypedValue value) {
   assert(value.m_type != KindOfRef);
   HphpArray* h;
-  ElmInd* ei;
   int64_t k;
   if (LIKELY(a->isHphpArray()) &&
       ((h = (HphpArray*)a), LIKELY(h->m_pos >= 0)) &&
       LIKELY(h->getCount() <= 1) &&
       LIKELY(!h->isFull()) &&
-      ((k = h->m_nextKI), LIKELY(k >= 0)) &&
-      ((ei = &h->m_hash[k & h->m_tableMask]), LIKELY(!validElmInd(*ei)))) {
+      ((k = h->m_nextKI), LIKELY(k >= 0))) {
+    Elm* e;
+    if (LIKELY(h->m_packed)) {
+      if (UNLIKELY(k != h->m_used)) return genericAddNewElemC(a, value);
+      e = h->allocPackedElmFast();
+    } else {
+      ElmInd* ei = &h->m_hash[k & h->m_tableMask];
+      if (UNLIKELY(validElmInd(*ei))) return genericAddNewElemC(a, value);
+      e = h->allocElmFast(ei);
+    }
     // Fast path is a streamlined copy of Variant.constructValHelper()
     // with no incref+decref because we're moving (data,type) to this array.
-    Elm* e = h->allocElmFast(ei);
     e->data.m_type = typeInitNull(value.m_type);
     e->data.m_data.num = value.m_data.num;
     e->setIntKey(k);
@@ -1592,6 +1762,7 @@ ALWAYS_INLINE HphpArray* HphpArray::clone(AllocationMode am) const {
   target->m_size = 0;
   target->m_hLoad = 0;
   target->m_used = 0;
+  target->m_packed = true;
   target->m_data = target->m_inline_data.slots;
   auto const ht = target->m_inline_data.hash;
   target->m_hash = ht;
@@ -1619,11 +1790,14 @@ NEVER_INLINE void HphpArray::cloneNonEmpty(HphpArray* target) const {
   target->m_size = m_size;
   target->m_hLoad = m_hLoad;
   target->m_used = m_used;
+  target->m_packed = m_packed;
   const auto tableSize = computeTableSize(m_tableMask);
   const auto maxElms = computeMaxElms(m_tableMask);
   target->allocData(maxElms, tableSize);
-  // Copy the hash.
-  memcpy(target->m_hash, m_hash, tableSize * sizeof(ElmInd));
+  // Copy the hash, unless it isn't built.
+  if (!m_packed) {
+    memcpy(target->m_hash, m_hash, tableSize * sizeof(ElmInd));
+  }
 
   // Copy the elements and bump up refcounts as needed.
   Elm* elms = m_data;
@@ -190,6 +190,20 @@ public:
   TypedValue* nvGetCell(int64_t ki) const;
   TypedValue* nvGetCell(const StringData* k) const;
 
+  // nvGetPacked is the fast path for integer reads of packed arrays.
+  // It returns nullptr if the array is not packed or ki is out of
+  // range; callers then fall back to nvGet/nvGetCell.
+  TypedValue* nvGetPacked(int64_t ki) const {
+    return m_packed && uint64_t(ki) < m_used ? &m_data[ki].data : nullptr;
+  }
+
+  // setPacked and appendPacked are the matching fast paths for writes to
+  // unshared packed arrays: overwriting an existing element, or adding
+  // one at the end.  They return false, having done nothing, when the
+  // write isn't that simple; callers then fall back to set/append.
+  bool setPacked(int64_t ki, CVarRef v);
+  bool appendPacked(CVarRef v);
+
   void nvBind(int64_t ki, const TypedValue* v) {
     updateRef(ki, tvAsCVarRef(v));
   }
@@ -352,13 +366,17 @@ private:
   //            +--------------------+
   // m_hash --> |                    | 2^K hash table entries.
   //            +--------------------+
+  //
+  // A Big array that is packed leaves the hash table out of the
+  // allocation, and m_hash is null, until allocHash() adds it.
 
   uint32_t m_used;       // number of used elements (values or tombstones)
   uint32_t m_tableMask;  // Bitmask used when indexing into the hash table.
   uint32_t m_hLoad;      // Hash table load (# of non-empty slots).
+  bool     m_packed;     // Keys are 0..m_used-1 and m_hash is not built.
   int64_t  m_nextKI;     // Next integer key to use for append.
   Elm*     m_data;       // Contains elements and hash table.
-  ElmInd*  m_hash;       // Hash table.
+  ElmInd*  m_hash;       // Hash table; null for big packed arrays.
   union {
     InlineSlots m_inline_data;
     ElmInd m_inline_hash[sizeof(m_inline_data) / sizeof(ElmInd)];
@@ -377,8 +395,8 @@ private:
 
   ssize_t find(int64_t ki) const;
   ssize_t find(const StringData* s, strhash_t prehash) const;
-  ElmInd* findForInsert(int64_t ki) const;
-  ElmInd* findForInsert(const StringData* k, strhash_t prehash) const;
+  ElmInd* findForInsert(int64_t ki);
+  ElmInd* findForInsert(const StringData* k, strhash_t prehash);
 
   ssize_t iter_advance_helper(ssize_t prev) const ATTRIBUTE_COLD;
 
@@ -391,6 +409,7 @@ private:
 
   inline ALWAYS_INLINE
   ElmInd* findForNewInsert(size_t h0) const {
+    assert(!m_packed);
     size_t tableMask = m_tableMask;
     size_t probeIndex = h0 & tableMask;
     ElmInd* ei = &m_hash[probeIndex];
@@ -422,6 +441,8 @@ private:
   Elm* newElmGrow(size_t h0);
   Elm* allocElm(ElmInd* ei);
   Elm* allocElmFast(ElmInd* ei);
+  Elm* allocPackedElm();
+  Elm* allocPackedElmFast();
   void initElmInt(Elm* e, int64_t ki, CVarRef data, bool byRef=false);
   void initElmStr(Elm* e, strhash_t h, StringData* key, CVarRef data,
                   bool byRef=false);
@@ -429,6 +450,21 @@ private:
                       bool byRef=false);
   void newElmStr(ElmInd* ei, strhash_t h, StringData* key, CVarRef data,
                       bool byRef=false);
+  /**
+   * A packed array holds the integer keys 0..m_used-1 in order, with no
+   * tombstones, and does not maintain m_hash: lookups index m_data
+   * directly and appends skip hashing.  m_hLoad is kept equal to m_size
+   * so isFull() and resize() behave as if the hash were built.  unpack()
+   * builds the hash and must run before any operation that would break
+   * the packed invariant or that needs an ElmInd* into m_hash.
+   *
+   * Packed arrays too big for the inline hash don't allocate space for
+   * it at all (m_hash is null); allocHash() extends m_data to make room
+   * the first time the array stops being packed.  It may move m_data.
+   */
+  void unpack() ATTRIBUTE_COLD;
+  void allocHash();
+
   void allocData(size_t maxElms, size_t tableSize);
   void reallocData(size_t maxElms, size_t tableSize, uint oldMask);
 
@@ -115,18 +115,21 @@ done:
  */
 void HphpArray::postSort(bool resetKeys) {
   assert(m_size > 0);
-  size_t tableSize = computeTableSize(m_tableMask);
-  initHash(m_hash, tableSize);
-  m_hLoad = 0;
   if (resetKeys) {
+    // Renumbered keys leave the array packed, so skip the hash entirely.
     for (uint32_t pos = 0; pos < m_used; ++pos) {
       Elm* e = &m_data[pos];
       if (e->hasStrKey()) decRefStr(e->key);
       e->setIntKey(pos);
-      m_hash[pos] = pos;
     }
     m_nextKI = m_size;
+    m_packed = true;
   } else {
+    if (m_packed) allocHash();
+    size_t tableSize = computeTableSize(m_tableMask);
+    initHash(m_hash, tableSize);
+    m_hLoad = 0;
+    m_packed = false;
     for (uint32_t pos = 0; pos < m_used; ++pos) {
       Elm* e = &m_data[pos];
       ElmInd* ei = findForNewInsert(e->hasIntKey() ? e->ikey : e->hash());
@@ -197,7 +197,7 @@ void BaseExecutionContext::setRequestMemoryMaxBytes(int64_t max) {
     max = INT64_MAX;
   }
   m_maxMemory = max;
-  MemoryManager::TheMemoryManager()->getStats().maxBytes = m_maxMemory;
+  MemoryManager::TheMemoryManager()->setMaxBytes(m_maxMemory);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -441,9 +441,11 @@ public:
   static void packContVarEnvLinkage(ActRec* fp);
   void pushLocalsAndIterators(const HPHP::Func* f, int nparams = 0);
   void enqueueSharedVar(SharedVariant* var);
+  void enqueueFree(void* p);
 
 private:
   SVarVector m_freedSvars;
+  std::vector<void*> m_freedMemory;
   void treadmillSharedVars();
 
   enum class VectorLeaveCode {
@@ -484,6 +486,9 @@ private:
   void setHelperPost(unsigned ndiscard, Variant& tvRef,
                      Variant& tvRef2);
   template<class Op> void implCellBinOpBool(PC&, Op op);
+  bool tryFuse(PC& pc);
+  bool fuseSetLPopC(PC& pc);
+  template<class Cmp> bool fuseCmpJmp(PC& pc, Cmp cmp);
   bool cellInstanceOf(TypedValue* c, const HPHP::NamedEntity* s);
   bool initIterator(PC& pc, PC& origPc, Iter* it,
                     Offset offset, Cell* c1);
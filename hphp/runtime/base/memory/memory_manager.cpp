@@ -30,9 +30,12 @@
 #include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/base/server/http_server.h"
 #include "hphp/util/alloc.h"
+#include "hphp/util/maphuge.h"
 #include "hphp/util/process.h"
 #include "hphp/util/trace.h"
 
+#include <sys/mman.h>
+
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -134,6 +137,8 @@ static void* MemoryManagerInit() {
 
 void* MemoryManager::TlsInitSetup = MemoryManagerInit();
 
+std::atomic<size_t> MemoryManager::s_heapSampleBytes(0);
+
 void MemoryManager::Create(void* storage) {
   new (storage) MemoryManager();
 }
@@ -161,7 +166,10 @@ void MemoryManager::AllocIterator::next() {
 }
 
 MemoryManager::MemoryManager() : m_front(0), m_limit(0),
-  m_enabled(RuntimeOption::EnableMemoryManager) {
+  m_mediumFront(0), m_mediumLimit(0),
+  m_enabled(RuntimeOption::EnableMemoryManager),
+  m_slabCacheLimit(RuntimeOption::EvalRequestHeapCacheSlabs),
+  m_heapSampleCountdown(0), m_heapSampled(0), m_gcTrigger(INT64_MAX) {
 #ifdef USE_JEMALLOC
   threadStats(m_allocated, m_deallocated, m_cactive, m_cactiveLimit);
 #endif
@@ -171,12 +179,19 @@ MemoryManager::MemoryManager() : m_front(0), m_limit(0),
   m_sweep.next = m_sweep.prev = &m_sweep;
 }
 
+MemoryManager::~MemoryManager() {
+  for (auto slab : m_slabCache) {
+    munmap(slab, SLAB_SIZE);
+  }
+}
+
 void MemoryManager::resetStats() {
   m_stats.usage = 0;
   m_stats.alloc = 0;
   m_stats.peakUsage = 0;
   m_stats.peakAlloc = 0;
   m_stats.totalAlloc = 0;
+  m_heapSampled = 0;
 #ifdef USE_JEMALLOC
   if (s_statsEnabled) {
     m_stats.jemallocDebt = 0;
@@ -196,6 +211,55 @@ void MemoryManager::refreshStatsHelperExceeded() {
   info->m_reqInjectionData.setMemExceededFlag();
 }
 
+void MemoryManager::setMaxBytes(int64_t maxBytes) {
+  m_stats.maxBytes = maxBytes;
+  uint32_t pct = RuntimeOption::EvalGCTriggerPct;
+  m_gcTrigger = pct && maxBytes != INT64_MAX ? maxBytes / 100 * pct
+                                             : INT64_MAX;
+}
+
+void MemoryManager::scheduleCollection() {
+  uint32_t pct = RuntimeOption::EvalGCTriggerPct;
+  int64_t maxBytes = m_stats.maxBytes;
+  if (!pct || maxBytes == INT64_MAX) {
+    m_gcTrigger = INT64_MAX;
+    return;
+  }
+  m_gcTrigger = std::max(maxBytes / 100 * pct,
+                         m_stats.usage + maxBytes / 16);
+}
+
+inline void MemoryManager::checkCollectionTrigger() {
+  if (UNLIKELY(m_stats.usage > m_gcTrigger)) collectionTriggered();
+}
+
+NEVER_INLINE
+void MemoryManager::collectionTriggered() {
+  // Don't ask again until the collection has run.
+  m_gcTrigger = INT64_MAX;
+  RequestInjectionData& data =
+    ThreadInfo::s_threadInfo.getNoCheck()->m_reqInjectionData;
+  if (data.cflagsPtr) data.setCollectCyclesFlag();
+}
+
+inline void MemoryManager::heapSampleTick(size_t nbytes) {
+  size_t interval = s_heapSampleBytes.load(std::memory_order_relaxed);
+  if (LIKELY(!interval)) return;
+  m_heapSampleCountdown -= nbytes;
+  if (UNLIKELY(m_heapSampleCountdown <= 0)) heapSample(interval);
+}
+
+NEVER_INLINE
+void MemoryManager::heapSample(size_t interval) {
+  size_t samples = 1 + size_t(-m_heapSampleCountdown) / interval;
+  m_heapSampleCountdown += samples * interval;
+  m_heapSampled += samples * interval;
+  RequestInjectionData& data =
+    ThreadInfo::s_threadInfo.getNoCheck()->m_reqInjectionData;
+  // Outside of a request there's no stack to charge.
+  if (data.cflagsPtr) data.setHeapProfileFlag();
+}
+
 #ifdef USE_JEMALLOC
 void MemoryManager::refreshStatsHelperStop() {
   HttpServer::Server->stop();
@@ -226,9 +290,15 @@ void MemoryManager::rollback() {
   }
   // free smart-malloc slabs
   for (SlabIter i = m_slabs.begin(), end = m_slabs.end(); i != end; ++i) {
-    free(*i);
+    freeSlab(*i);
   }
   m_slabs.clear();
+  // free medium-block chunks
+  for (SlabIter i = m_mediumChunks.begin(), end = m_mediumChunks.end();
+       i != end; ++i) {
+    freeSlab(*i);
+  }
+  m_mediumChunks.clear();
   // free large allocation blocks
   for (SweepNode *n = m_sweep.next, *next; n != &m_sweep; n = next) {
     next = n->next;
@@ -239,7 +309,32 @@ void MemoryManager::rollback() {
   for (unsigned i = 0; i < kNumSizes; i++) {
     m_smartfree[i].clear();
   }
+  for (unsigned i = 0; i < kNumMediumSizes; i++) {
+    m_mediumFree[i].clear();
+  }
   m_front = m_limit = 0;
+  m_mediumFront = m_mediumLimit = 0;
+  updateSlabCacheLimit();
+}
+
+/*
+ * The MemoryManager is created with its thread, possibly before the
+ * config is loaded, so pick up Eval.RequestHeapCacheSlabs again whenever
+ * no slab is in use: a slab must go back the way it was allocated.
+ */
+void MemoryManager::updateSlabCacheLimit() {
+  assert(m_slabs.empty() && m_mediumChunks.empty());
+  m_slabCacheLimit = RuntimeOption::EvalRequestHeapCacheSlabs;
+  while (m_slabCache.size() > m_slabCacheLimit) {
+    munmap(m_slabCache.back(), SLAB_SIZE);
+    m_slabCache.pop_back();
+  }
+}
+
+void MemoryManager::trimSlabCache() {
+  for (auto slab : m_slabCache) {
+    madvise(slab, SLAB_SIZE, MADV_DONTNEED);
+  }
 }
 
 void MemoryManager::logStats() {
@@ -256,6 +351,7 @@ void MemoryManager::checkMemory() {
   printf("Peak Alloc: %" PRId64 " bytes\n", m_stats.peakAlloc);
 
   printf("Slabs: %lu KiB\n", m_slabs.size() * SLAB_SIZE / 1024);
+  printf("Medium chunks: %lu KiB\n", m_mediumChunks.size() * SLAB_SIZE / 1024);
 }
 
 //
@@ -267,12 +363,43 @@ void MemoryManager::checkMemory() {
 // (m_smartfree[i]).  Small blocks have an 8-byte SmallNode and
 // are swept en-masse when slabs are freed.
 //
-// Medium blocks use a 16-byte SweepNode header to maintain a doubly-linked
+// Medium blocks, up to kMaxMediumSize, are bump-allocated from
+// SLAB_SIZE chunks that are only used for them, and are rounded up to one
+// of 4 size classes per power of two, each with its own freelist
+// (m_mediumFree[i]).  Their 16-byte SweepNode header holds just padbytes,
+// and they are swept en-masse when the chunks are freed.
+//
+// Big blocks use a 16-byte SweepNode header to maintain a doubly-linked
 // list of blocks to free at request end.  smart_free can distinguish
-// SmallNode and SweepNode because valid next/prev pointers must be
-// larger than kMaxSmartSize.
+// the three kinds by padbytes, because valid next/prev pointers must be
+// larger than kMaxMediumSize.
 //
 
+// Round padbytes up to its medium size class; return the class index and
+// store the class size in classbytes.
+inline unsigned MemoryManager::mediumSizeIndex(size_t padbytes,
+                                               size_t& classbytes) {
+  static_assert(size_t(1) << kLgMaxSmartSize == kMaxSmartSize,
+                "kLgMaxSmartSize is wrong");
+  static_assert(size_t(1) << kLgMaxMediumSize == kMaxMediumSize,
+                "kLgMaxMediumSize is wrong");
+  assert(padbytes > kMaxSmartSize && padbytes <= kMaxMediumSize);
+  // 2^lg < padbytes <= 2^(lg+1)
+  unsigned lg = 63 - __builtin_clzl(padbytes - 1);
+  unsigned lgStep = lg - kLgMediumSteps;
+  classbytes = (padbytes + (size_t(1) << lgStep) - 1) >> lgStep << lgStep;
+  unsigned i = ((lg - kLgMaxSmartSize) << kLgMediumSteps) +
+               (classbytes >> lgStep) - (1 << kLgMediumSteps) - 1;
+  assert(i < kNumMediumSizes && mediumClassSize(i) == classbytes);
+  return i;
+}
+
+inline size_t MemoryManager::mediumClassSize(unsigned i) {
+  unsigned lg = (i >> kLgMediumSteps) + kLgMaxSmartSize;
+  unsigned step = (i & ((1 << kLgMediumSteps) - 1)) + 1;
+  return (size_t(1) << lg) + (size_t(step) << (lg - kLgMediumSteps));
+}
+
 inline void* MemoryManager::smartMalloc(size_t nbytes) {
   assert(nbytes > 0);
   // add room for header before rounding up
@@ -292,6 +419,9 @@ inline void* MemoryManager::smartMalloc(size_t nbytes) {
     }
     return smartMallocSlab(padbytes);
   }
+  if (nbytes + sizeof(SweepNode) <= kMaxMediumSize) {
+    return smartMallocMedium(nbytes);
+  }
   return smartMallocBig(nbytes);
 }
 
@@ -307,6 +437,10 @@ inline void MemoryManager::smartFree(void* ptr) {
     m_stats.usage -= padbytes;
     return;
   }
+  if (padbytes <= kMaxMediumSize) {
+    smartFreeMedium(n);
+    return;
+  }
   smartFreeBig(n);
 }
 
@@ -322,6 +456,9 @@ inline void* MemoryManager::smartRealloc(void* ptr, size_t nbytes) {
     smartFree(ptr);
     return newmem;
   }
+  if (old_padbytes <= kMaxMediumSize) {
+    return smartReallocMedium(n, nbytes);
+  }
   SweepNode* next = n->next;
   SweepNode* prev = n->prev;
   SweepNode* n2 = (SweepNode*) realloc(n, nbytes + sizeof(SweepNode));
@@ -335,6 +472,55 @@ inline void* MemoryManager::smartRealloc(void* ptr, size_t nbytes) {
   return n2 + 1;
 }
 
+/**
+ * Map a SLAB_SIZE-aligned slab so the kernel can back it with a huge page,
+ * and fault it in now rather than in the middle of a request.
+ */
+static char* mapHugeSlab() {
+  size_t len = 2 * SLAB_SIZE;
+  char* mem = (char*) mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) throw OutOfMemoryException(len);
+  char* slab =
+    (char*)((uintptr_t(mem) + SLAB_SIZE - 1) & ~uintptr_t(SLAB_SIZE - 1));
+  char* end = slab + SLAB_SIZE;
+  if (slab != mem) munmap(mem, slab - mem);
+  if (end != mem + len) munmap(end, mem + len - end);
+  hintHuge(slab, SLAB_SIZE);
+  long pageSize = sysconf(_SC_PAGESIZE);
+  for (char* p = slab; p < end; p += pageSize) {
+    *(volatile char*)p = 0;
+  }
+  return slab;
+}
+
+/**
+ * Get SLAB_SIZE bytes for a slab or medium chunk.  When the thread keeps a
+ * slab cache, slabs are huge-page mappings reused from earlier requests;
+ * otherwise they come from malloc.
+ */
+char* MemoryManager::allocSlab() {
+  if (!m_slabCacheLimit) {
+    char* slab = (char*) Util::safe_malloc(SLAB_SIZE);
+    JEMALLOC_STATS_ADJUST(&m_stats, SLAB_SIZE);
+    return slab;
+  }
+  if (m_slabCache.empty()) return mapHugeSlab();
+  char* slab = m_slabCache.back();
+  m_slabCache.pop_back();
+  return slab;
+}
+
+void MemoryManager::freeSlab(char* slab) {
+  if (!m_slabCacheLimit) {
+    free(slab);
+  } else if (m_slabCache.size() < m_slabCacheLimit) {
+    m_slabCache.push_back(slab);
+  } else {
+    munmap(slab, SLAB_SIZE);
+  }
+}
+
 /**
  * Get a new slab, then allocate nbytes from it and install it in our
  * slab list.  Return the newly allocated nbytes-sized block.
@@ -343,12 +529,14 @@ NEVER_INLINE char* MemoryManager::newSlab(size_t nbytes) {
   if (UNLIKELY(m_stats.usage > m_stats.maxBytes)) {
     refreshStatsHelper();
   }
-  char* slab = (char*) Util::safe_malloc(SLAB_SIZE);
-  JEMALLOC_STATS_ADJUST(&m_stats, SLAB_SIZE);
+  char* slab = allocSlab();
   m_stats.alloc += SLAB_SIZE;
   if (m_stats.alloc > m_stats.peakAlloc) {
     m_stats.peakAlloc = m_stats.alloc;
   }
+  // Small blocks are only sampled a slab at a time.
+  heapSampleTick(SLAB_SIZE);
+  checkCollectionTrigger();
   m_slabs.push_back(slab);
   m_front = slab + nbytes;
   m_limit = slab + SLAB_SIZE;
@@ -362,10 +550,48 @@ void* MemoryManager::smartMallocSlab(size_t padbytes) {
   return n + 1;
 }
 
+NEVER_INLINE char* MemoryManager::newMediumChunk() {
+  static_assert(kMaxMediumSize <= SLAB_SIZE,
+                "medium blocks must fit in a chunk");
+  if (UNLIKELY(m_stats.usage > m_stats.maxBytes)) {
+    refreshStatsHelper();
+  }
+  // Put whatever is left of the current chunk on the freelists, largest
+  // blocks first.
+  while (size_t(m_mediumLimit - m_mediumFront) > kMaxSmartSize) {
+    size_t remaining = m_mediumLimit - m_mediumFront;
+    if (remaining > kMaxMediumSize) remaining = kMaxMediumSize;
+    size_t classbytes;
+    unsigned i = mediumSizeIndex(remaining, classbytes);
+    if (classbytes > remaining) {
+      if (i == 0) break;
+      classbytes = mediumClassSize(--i);
+    }
+    SweepNode* n = (SweepNode*) m_mediumFront;
+    n->next = nullptr;
+    n->padbytes = classbytes;
+    m_mediumFree[i].push(n + 1);
+    m_mediumFront += classbytes;
+  }
+  char* chunk = allocSlab();
+  m_stats.alloc += SLAB_SIZE;
+  if (m_stats.alloc > m_stats.peakAlloc) {
+    m_stats.peakAlloc = m_stats.alloc;
+  }
+  // Like small blocks, medium blocks are only sampled a chunk at a time,
+  // so reusing freed ones doesn't count as growth.
+  heapSampleTick(SLAB_SIZE);
+  m_mediumChunks.push_back(chunk);
+  m_mediumFront = chunk;
+  m_mediumLimit = chunk + SLAB_SIZE;
+  return chunk;
+}
+
 inline void* MemoryManager::smartEnlist(SweepNode* n) {
   if (UNLIKELY(m_stats.usage > m_stats.maxBytes)) {
     refreshStatsHelper();
   }
+  checkCollectionTrigger();
   // link after m_sweep
   SweepNode* next = m_sweep.next;
   n->next = next;
@@ -378,6 +604,7 @@ inline void* MemoryManager::smartEnlist(SweepNode* n) {
 NEVER_INLINE
 void* MemoryManager::smartMallocBig(size_t nbytes) {
   assert(nbytes > 0);
+  heapSampleTick(nbytes);
   SweepNode* n = (SweepNode*) Util::safe_malloc(nbytes + sizeof(SweepNode));
   return smartEnlist(n);
 }
@@ -385,6 +612,7 @@ void* MemoryManager::smartMallocBig(size_t nbytes) {
 NEVER_INLINE
 void* MemoryManager::smartCallocBig(size_t totalbytes) {
   assert(totalbytes > 0);
+  heapSampleTick(totalbytes);
   SweepNode* n = (SweepNode*)Util::safe_calloc(totalbytes + sizeof(SweepNode),
                                                1);
   return smartEnlist(n);
@@ -399,6 +627,60 @@ void MemoryManager::smartFreeBig(SweepNode* n) {
   free(n);
 }
 
+NEVER_INLINE
+void* MemoryManager::smartMallocMedium(size_t nbytes) {
+  size_t padbytes;
+  unsigned i = mediumSizeIndex(nbytes + sizeof(SweepNode), padbytes);
+  m_stats.usage += padbytes;
+  checkCollectionTrigger();
+  void* p = m_mediumFree[i].maybePop();
+  if (p) return p;
+  char* mem = m_mediumFront;
+  if (UNLIKELY(mem + padbytes > m_mediumLimit)) {
+    mem = newMediumChunk();
+  }
+  m_mediumFront = mem + padbytes;
+  SweepNode* n = (SweepNode*) mem;
+  n->next = nullptr;
+  n->padbytes = padbytes;
+  return n + 1;
+}
+
+NEVER_INLINE
+void MemoryManager::smartFreeMedium(SweepNode* n) {
+  size_t padbytes = n->padbytes;
+  size_t classbytes;
+  unsigned i = mediumSizeIndex(padbytes, classbytes);
+  assert(classbytes == padbytes);
+  assert(memset(n + 1, kSmartFreeFill, padbytes - sizeof(SweepNode)));
+  m_mediumFree[i].push(n + 1);
+  m_stats.usage -= padbytes;
+}
+
+NEVER_INLINE
+void* MemoryManager::smartReallocMedium(SweepNode* n, size_t nbytes) {
+  size_t old_padbytes = n->padbytes;
+  size_t padbytes = nbytes + sizeof(SweepNode);
+  if (padbytes > kMaxSmartSize && padbytes <= kMaxMediumSize) {
+    size_t classbytes;
+    mediumSizeIndex(padbytes, classbytes);
+    if (classbytes == old_padbytes) return n + 1;
+    // A block at the end of the current chunk (typically a string being
+    // appended to) can be resized in place.
+    char* end = (char*)n + old_padbytes;
+    if (end == m_mediumFront && (char*)n + classbytes <= m_mediumLimit) {
+      m_mediumFront = (char*)n + classbytes;
+      n->padbytes = classbytes;
+      m_stats.usage += int64_t(classbytes) - int64_t(old_padbytes);
+      return n + 1;
+    }
+  }
+  void* newmem = smartMalloc(nbytes);
+  memcpy(newmem, n + 1, std::min(old_padbytes - sizeof(SweepNode), nbytes));
+  smartFreeMedium(n);
+  return newmem;
+}
+
 // allocate nbytes from the current slab, aligned to 16-bytes
 inline void* MemoryManager::slabAlloc(size_t nbytes) {
   const size_t kAlignMask = 15;
@@ -425,7 +707,7 @@ void* smart_malloc(size_t nbytes) {
 HOT_FUNC
 void* smart_calloc(size_t count, size_t nbytes) {
   size_t totalbytes = std::max(nbytes * count, size_t(1));
-  if (totalbytes <= MemoryManager::kMaxSmartSize) {
+  if (totalbytes <= MemoryManager::kMaxMediumSize) {
     return memset(MM().smartMalloc(totalbytes), 0, totalbytes);
   }
   return MM().smartCallocBig(totalbytes);
@@ -24,6 +24,7 @@
 #include "hphp/util/thread_local.h"
 #include "hphp/runtime/base/memory/memory_usage_stats.h"
 
+#include <atomic>
 #include <vector>
 #include <deque>
 #include <queue>
@@ -163,6 +164,7 @@ public:
   }
 
   MemoryManager();
+  ~MemoryManager();
 
   // State for iteration over all the smart allocators registered in a
   // memory manager.
@@ -198,6 +200,12 @@ public:
   void sweepAll();
   void rollback();
 
+  /**
+   * Give the physical memory behind slabs cached for the next request back
+   * to the kernel, keeping the mappings.  Called when the thread is idle.
+   */
+  void trimSlabCache();
+
   /**
    * Write stats to ServerStats.
    */
@@ -232,6 +240,20 @@ public:
    */
   void resetStats();
 
+  /**
+   * Set the request's memory limit.  Once usage passes
+   * Eval.GCTriggerPct percent of it, the CollectCycles surprise flag asks
+   * for a cycle collection at the next safe point.
+   */
+  void setMaxBytes(int64_t maxBytes);
+
+  /**
+   * Called after an automatic cycle collection: the next one waits until
+   * usage has grown by another 1/16th of the memory limit, so a heap with
+   * little cyclic garbage isn't rescanned on every allocation.
+   */
+  void scheduleCollection();
+
   /**
    * Out-of-line version of refresh stats
    */
@@ -328,17 +350,44 @@ public:
   void* smartCallocBig(size_t totalbytes);
   void  smartFree(void* ptr);
   static const size_t kMaxSmartSize = 2048;
+  static const size_t kMaxMediumSize = 1 << 20;
 
   // allocate nbytes from the current slab, aligned to 16-bytes
   void* slabAlloc(size_t nbytes);
 
+  /**
+   * Heap profile sampling (see HeapProfiler).  While s_heapSampleBytes is
+   * non-zero, every s_heapSampleBytes bytes of fresh slabs, medium blocks
+   * and big blocks set the HeapProfile surprise flag; the sampled bytes
+   * wait here until the surprise check charges them to a PHP stack.
+   */
+  static std::atomic<size_t> s_heapSampleBytes;
+  size_t takeHeapSampledBytes() {
+    size_t bytes = m_heapSampled;
+    m_heapSampled = 0;
+    return bytes;
+  }
+
 private:
+  char* allocSlab();
+  void freeSlab(char* slab);
+  void updateSlabCacheLimit();
   char* newSlab(size_t nbytes);
   void* smartEnlist(SweepNode*);
   void* smartMallocSlab(size_t padbytes);
+  void* smartMallocMedium(size_t nbytes);
+  void* smartReallocMedium(SweepNode*, size_t nbytes);
+  void  smartFreeMedium(SweepNode*);
+  char* newMediumChunk();
+  static unsigned mediumSizeIndex(size_t padbytes, size_t& classbytes);
+  static size_t mediumClassSize(unsigned i);
   void* smartMallocBig(size_t nbytes);
   void  smartFreeBig(SweepNode*);
   void refreshStatsHelperExceeded();
+  void heapSampleTick(size_t nbytes);
+  void heapSample(size_t interval);
+  void checkCollectionTrigger();
+  void collectionTriggered();
 #ifdef USE_JEMALLOC
   void refreshStatsHelperStop();
 #endif
@@ -347,16 +396,31 @@ private:
   static const unsigned kLgSizeQuantum = 4; // 16 bytes
   static const unsigned kNumSizes = kMaxSmartSize >> kLgSizeQuantum;
   static const size_t kMask = (1 << kLgSizeQuantum) - 1;
+  // Medium blocks have 4 size classes per power of two, from just above
+  // kMaxSmartSize up to kMaxMediumSize.
+  static const unsigned kLgMaxSmartSize = 11;
+  static const unsigned kLgMaxMediumSize = 20;
+  static const unsigned kLgMediumSteps = 2;
+  static const unsigned kNumMediumSizes =
+    (kLgMaxMediumSize - kLgMaxSmartSize) << kLgMediumSteps;
 
 private:
   char *m_front, *m_limit;
   GarbageList m_smartfree[kNumSizes];
+  char *m_mediumFront, *m_mediumLimit;
+  GarbageList m_mediumFree[kNumMediumSizes];
   SweepNode m_sweep;   // oversize smart_malloc'd blocks
   MemoryUsageStats m_stats;
   bool m_enabled;
 
   std::vector<SmartAllocatorImpl*> m_smartAllocators;
   std::vector<char*> m_slabs;
+  std::vector<char*> m_mediumChunks;
+  std::vector<char*> m_slabCache; // huge-page slabs kept across requests
+  uint32_t m_slabCacheLimit;     // re-read from the config by rollback()
+  int64_t m_heapSampleCountdown; // bytes until the next heap profile sample
+  size_t m_heapSampled;          // sampled bytes not yet charged to a stack
+  int64_t m_gcTrigger;           // usage that requests a cycle collection
 
 #ifdef USE_JEMALLOC
   uint64_t* m_allocated;
@@ -383,8 +447,10 @@ public:
 // survive beyond a request, they'll be dangling pointers.
 //
 // Block sizes <= MemoryManager::kMaxSmartSize are region-allocated
-// and are only guaranteed to be 8-byte aligned.  Larger blocks are
-// directly malloc'd (with a header) and are 16-byte aligned.
+// and are only guaranteed to be 8-byte aligned.  Blocks up to
+// MemoryManager::kMaxMediumSize are carved from request-local chunks, and
+// larger blocks are directly malloc'd (with a header); both are 16-byte
+// aligned.
 //
 // Clients must not mix/match calls between smart_malloc and malloc:
 //  - these blocks have a header that malloc wouldn't grok
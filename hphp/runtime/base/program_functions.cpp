@@ -31,6 +31,7 @@
 #include "hphp/runtime/base/server/admin_request_handler.h"
 #include "hphp/runtime/base/server/server_stats.h"
 #include "hphp/runtime/base/server/server_note.h"
+#include "hphp/runtime/base/server/unit_preloader.h"
 #include "hphp/runtime/base/memory/memory_manager.h"
 #include "hphp/util/process.h"
 #include "hphp/util/capability.h"
@@ -64,6 +65,8 @@
 
 #include "hphp/runtime/vm/runtime.h"
 #include "hphp/runtime/vm/repo.h"
+#include "hphp/runtime/vm/repo_image.h"
+#include "hphp/runtime/vm/heap_profiler.h"
 #include "hphp/runtime/vm/jit/translator.h"
 #include "hphp/compiler/builtin_symbols.h"
 
@@ -658,6 +661,9 @@ static int start_server(const std::string &username) {
   // initialize the process
   HttpServer::Server = HttpServerPtr(new HttpServer(sslCTX));
 
+  // Load the units we expect to need before anything can ask for them
+  UnitPreloader::Run();
+
   // If we have any warmup requests, replay them before listening for
   // real connections
   for (auto& file : RuntimeOption::ServerWarmupRequests) {
@@ -1241,6 +1247,10 @@ void hphp_process_init() {
 
   g_vmProcessInit();
 
+  // Map the repo image now, rather than on whichever request thread
+  // first loads a unit, so building it never stalls a request.
+  RepoImage::Init();
+
   PageletServer::Restart();
   XboxServer::Restart();
   Stream::RegisterCoreWrappers();
@@ -1441,6 +1451,7 @@ void hphp_session_exit() {
   if (RuntimeOption::EnableStats && RuntimeOption::EnableMemoryStats) {
     mm->logStats();
   }
+  HeapProfiler::RequestExit(mm->getStats().peakUsage);
   mm->resetStats();
 
   if (mm->isEnabled()) {
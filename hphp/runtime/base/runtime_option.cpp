@@ -113,6 +113,10 @@ bool RuntimeOption::ServerThreadDropStack = false;
 bool RuntimeOption::ServerHttpSafeMode = false;
 bool RuntimeOption::ServerStatCache = true;
 std::vector<std::string> RuntimeOption::ServerWarmupRequests;
+int RuntimeOption::ServerPreloadThreads = 0;
+std::string RuntimeOption::ServerPreloadHotList;
+bool RuntimeOption::ServerPreloadAll = true;
+bool RuntimeOption::ServerPreloadClasses = true;
 int RuntimeOption::PageletServerThreadCount = 0;
 bool RuntimeOption::PageletServerThreadRoundRobin = false;
 int RuntimeOption::PageletServerThreadDropCacheTimeoutSeconds = 0;
@@ -338,6 +342,7 @@ bool RuntimeOption::ApcExpireOnSets = false;
 int RuntimeOption::ApcPurgeFrequency = 4096;
 int RuntimeOption::ApcPurgeRate = -1;
 bool RuntimeOption::ApcAllowObj = false;
+bool RuntimeOption::ApcUseUncountedArrays = true;
 int RuntimeOption::ApcTTLLimit = -1;
 bool RuntimeOption::ApcUseFileStorage = false;
 int64_t RuntimeOption::ApcFileStorageChunkSize = int64_t(1LL << 29);
@@ -406,6 +411,7 @@ const uint64_t kEvalVMStackElmsDefault =
  ;
 const uint32_t kEvalVMInitialGlobalTableSizeDefault = 512;
 static const int kDefaultWarmupRequests = debug ? 1 : 11;
+static const uint32_t kDefaultJitPGOThreshold = debug ? 2 : 1000;
 #define F(type, name, def) \
   type RuntimeOption::Eval ## name = type(def);
 EVALFLAGS();
@@ -423,6 +429,8 @@ std::string RuntimeOption::RepoLocalPath;
 std::string RuntimeOption::RepoCentralPath;
 std::string RuntimeOption::RepoEvalMode;
 std::string RuntimeOption::RepoJournal;
+std::string RuntimeOption::RepoImagePath;
+bool RuntimeOption::RepoImageVerify = false;
 bool RuntimeOption::RepoCommit = true;
 bool RuntimeOption::RepoDebugInfo = true;
 // Missing: RuntimeOption::RepoAuthoritative's physical location is
@@ -694,6 +702,13 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
     ServerHttpSafeMode = server["HttpSafeMode"].getBool();
     ServerStatCache = server["StatCache"].getBool(true);
     server["WarmupRequests"].get(ServerWarmupRequests);
+    {
+      Hdf preload = server["Preload"];
+      ServerPreloadThreads = preload["Threads"].getInt32(0);
+      ServerPreloadHotList = preload["HotList"].getString();
+      ServerPreloadAll = preload["All"].getBool(true);
+      ServerPreloadClasses = preload["Classes"].getBool(true);
+    }
     RequestTimeoutSeconds = server["RequestTimeoutSeconds"].getInt32(0);
     ServerMemoryHeadRoom = server["MemoryHeadRoom"].getInt64(0);
     RequestMemoryMaxBytes = server["RequestMemoryMaxBytes"].getInt64(INT64_MAX);
@@ -839,6 +854,8 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
     string apcTableType = apc["TableType"].getString("concurrent");
     if (strcasecmp(apcTableType.c_str(), "concurrent") == 0) {
       ApcTableType = ApcTableTypes::ApcConcurrentTable;
+    } else if (strcasecmp(apcTableType.c_str(), "lockfree") == 0) {
+      ApcTableType = ApcTableTypes::ApcLockFreeTable;
     } else {
       throw InvalidArgumentException("apc table type",
                                      "Invalid table type");
@@ -849,6 +866,7 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
     ApcPurgeRate = apc["PurgeRate"].getInt32(-1);
 
     ApcAllowObj = apc["AllowObject"].getBool();
+    ApcUseUncountedArrays = apc["UncountedArrays"].getBool(true);
     ApcTTLLimit = apc["TTLLimit"].getInt32(-1);
     Hdf fileStorage = apc["FileStorage"];
     ApcUseFileStorage = fileStorage["Enable"].getBool();
@@ -1244,6 +1262,9 @@ void RuntimeOption::Load(Hdf &config, StringVec *overwrites /* = NULL */,
         }
       }
       RepoJournal = repo["Journal"].getString("delete");
+      // Repo.Image.Path, Repo.Image.Verify.
+      RepoImagePath = repo["Image"]["Path"].getString();
+      RepoImageVerify = repo["Image"]["Verify"].getBool(false);
       RepoCommit = repo["Commit"].getBool(true);
       RepoDebugInfo = repo["DebugInfo"].getBool(true);
       RepoAuthoritative = repo["Authoritative"].getBool(false);
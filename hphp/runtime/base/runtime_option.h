@@ -105,6 +105,10 @@ public:
   static bool ServerHttpSafeMode;
   static bool ServerStatCache;
   static std::vector<std::string> ServerWarmupRequests;
+  static int ServerPreloadThreads;
+  static std::string ServerPreloadHotList;
+  static bool ServerPreloadAll;
+  static bool ServerPreloadClasses;
   static int PageletServerThreadCount;
   static bool PageletServerThreadRoundRobin;
   static int PageletServerThreadDropCacheTimeoutSeconds;
@@ -322,7 +326,8 @@ public:
   static int ApcLoadThread;
   static std::set<std::string> ApcCompletionKeys;
   enum class ApcTableTypes {
-    ApcConcurrentTable
+    ApcConcurrentTable,
+    ApcLockFreeTable
   };
   static ApcTableTypes ApcTableType;
   static bool EnableApcSerialize;
@@ -333,6 +338,7 @@ public:
   static int ApcPurgeFrequency;
   static int ApcPurgeRate;
   static bool ApcAllowObj;
+  static bool ApcUseUncountedArrays;
   static int ApcTTLLimit;
   static bool ApcUseFileStorage;
   static int64_t ApcFileStorageChunkSize;
@@ -401,10 +407,17 @@ public:
   F(uint32_t, JitTargetCacheSize,      64 << 20)                        \
   F(uint32_t, HHBCArenaChunkSize,      64 << 20)                        \
   F(bool, ProfileBC,                   false)                           \
+  F(bool, InterpFuseOps,               true)                            \
   F(bool, ProfileHWEnable,             true)                            \
   F(string, ProfileHWEvents,           string(""))                      \
   F(uint32_t, JitMaxTranslations,      12)                              \
+  /* Once a SrcKey has JitMaxTranslations translations, interpret only  \
+   * its first instruction, not the whole tracelet, and re-enter the    \
+   * TC after it.  Off by default. */                                   \
+  F(bool, JitLimitBailout,             false)                           \
   F(uint64_t, JitGlobalTranslationLimit, -1)                            \
+  F(bool, JitReuseTC,                  false)                           \
+  F(uint32_t, JitReuseTCMinBlock,      4096)                            \
   F(bool, JitTrampolines,              true)                            \
   F(string, JitProfilePath,            string(""))                      \
   F(bool, JitTypePrediction,           true)                            \
@@ -430,6 +443,8 @@ public:
   F(bool, HHIRExtraOptPass,            true)                            \
   F(uint32_t, HHIRNumFreeRegs,         -1)                              \
   F(bool, HHIREnableGenTimeInlining,   true)                            \
+  F(uint32_t, HHIRInliningMaxInstrs,   12)                              \
+  F(double, HHIRInliningMinCallShare,  0.95)                            \
   F(bool, HHIREnableCalleeSavedOpt,    true)                            \
   F(bool, HHIREnablePreColoring,       true)                            \
   F(bool, HHIREnableCoalescing,        true)                            \
@@ -442,6 +457,11 @@ public:
   F(bool, HHIRPredictionOpts,          true)                            \
   F(bool, HHIRStressCodegenBlocks,     false)                           \
   F(string, JitRegionSelector,         "")                              \
+  F(bool, JitPGO,                      false)                           \
+  F(uint32_t, JitPGOThreshold,         kDefaultJitPGOThreshold)         \
+  F(uint32_t, JitPGOMinBlockCountPercent, 50)                           \
+  F(uint32_t, JitCompilerThreads,      2)                               \
+  F(bool, JitPGOOptimizedInAHot,       false)                           \
   /* DumpBytecode =1 dumps user php, =2 dumps systemlib & user php */   \
   F(int32_t, DumpBytecode,             0)                               \
   F(bool, DumpTC,                      false)                           \
@@ -454,6 +474,12 @@ public:
   F(uint32_t, InitialNamedEntityTableSize,  30000)                      \
   F(uint32_t, InitialStaticStringTableSize, 100000)                     \
   F(uint32_t, PCRETableSize, kPCREInitialTableSize)                     \
+  /* Number of smart_malloc slabs each thread keeps, huge-page backed,  \
+   * for its next request; 0 returns them to malloc at request end. */  \
+  F(uint32_t, RequestHeapCacheSlabs,   0)                               \
+  /* Collect garbage cycles when a request's heap passes this percent  \
+   * of its memory limit; 0 disables automatic collection. */           \
+  F(uint32_t, GCTriggerPct,            0)                               \
   /* */                                                                 \
 
 #define F(type, name, unused) \
@@ -477,6 +503,8 @@ public:
   static std::string RepoCentralPath;
   static std::string RepoEvalMode;
   static std::string RepoJournal;
+  static std::string RepoImagePath;
+  static bool RepoImageVerify;
   static bool RepoCommit;
   static bool RepoDebugInfo;
   static bool RepoAuthoritative;
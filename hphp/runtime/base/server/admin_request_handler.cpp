@@ -35,6 +35,7 @@
 #include "hphp/runtime/base/shared/shared_store_stats.h"
 #include "hphp/runtime/vm/repo.h"
 #include "hphp/runtime/vm/jit/translator.h"
+#include "hphp/runtime/vm/heap_profiler.h"
 #include "hphp/util/alloc.h"
 #include "hphp/util/timer.h"
 #include "hphp/util/repo_schema.h"
@@ -183,6 +184,8 @@ void AdminRequestHandler::handleRequest(Transport *transport) {
         "                  group as <keysample>\n"
         "/const-ss:        get const_map_size\n"
         "/static-strings:  get number of static strings\n"
+        "/static-strings-stats: get static string table size, resizes,\n"
+        "                  longest probe and retired table bytes\n"
         "/dump-apc:        dump all current value in APC to /tmp/apc_dump\n"
         "/dump-const:      dump all constant value in constant map to\n"
         "                  /tmp/const_map_dump\n"
@@ -207,6 +210,14 @@ void AdminRequestHandler::handleRequest(Transport *transport) {
 #ifdef EXECUTION_PROFILER
         "/prof-exe:        returns sampled execution profile\n"
 #endif
+        "/prof-alloc-on:   sample which PHP stacks grow the request heap\n"
+        "    bytes         optional, sampling interval, default 1048576\n"
+        "/prof-alloc-off:  stop sampling request heap growth\n"
+        "/prof-alloc-dump: sampled bytes per PHP stack, all requests, in\n"
+        "                  folded-stack format\n"
+        "/prof-alloc-peak: same, for the request with the highest peak\n"
+        "                  memory usage\n"
+        "/prof-alloc-clear: discard the sampled profiles\n"
         "/vm-tcspace:      show space used by translator caches\n"
         "/vm-dump-tc:      dump translation cache to /tmp/tc_dump_a and\n"
         "                  /tmp/tc_dump_astub\n"
@@ -323,7 +334,7 @@ void AdminRequestHandler::handleRequest(Transport *transport) {
         handleConstSizeRequest(cmd, transport)) {
       break;
     }
-    if (strcmp(cmd.c_str(), "static-strings") == 0 &&
+    if ((cmd == "static-strings" || cmd == "static-strings-stats") &&
         handleStaticStringsRequest(cmd, transport)) {
       break;
     }
@@ -746,6 +757,30 @@ bool AdminRequestHandler::handleProfileRequest(const std::string &cmd,
 
     return true;
   }
+  if (cmd == "prof-alloc-on") {
+    int64_t bytes = transport->getInt64Param("bytes");
+    HeapProfiler::Enable(bytes > 0 ? bytes : 1 << 20);
+    transport->sendString("OK\n");
+    return true;
+  }
+  if (cmd == "prof-alloc-off") {
+    HeapProfiler::Disable();
+    transport->sendString("OK\n");
+    return true;
+  }
+  if (cmd == "prof-alloc-dump") {
+    transport->sendString(HeapProfiler::DumpAggregate());
+    return true;
+  }
+  if (cmd == "prof-alloc-peak") {
+    transport->sendString(HeapProfiler::DumpPeakRequest());
+    return true;
+  }
+  if (cmd == "prof-alloc-clear") {
+    HeapProfiler::Clear();
+    transport->sendString("OK\n");
+    return true;
+  }
 #ifdef GOOGLE_CPU_PROFILER
   if (handleCPUProfilerRequest(cmd, transport)) {
     return true;
@@ -942,7 +977,18 @@ bool AdminRequestHandler::handleConstSizeRequest (const std::string &cmd,
 bool AdminRequestHandler::handleStaticStringsRequest(const std::string& cmd,
                                                      Transport* transport) {
   std::ostringstream result;
-  result << StringData::GetStaticStringCount();
+  if (cmd == "static-strings-stats") {
+    auto stats = StringData::GetStaticStringStats();
+    result << "{\n"
+           << "  \"count\": " << stats.count << ",\n"
+           << "  \"capacity\": " << stats.capacity << ",\n"
+           << "  \"resizes\": " << stats.resizes << ",\n"
+           << "  \"max_probe\": " << stats.maxProbe << ",\n"
+           << "  \"retired_bytes\": " << stats.retiredBytes << "\n"
+           << "}\n";
+  } else {
+    result << StringData::GetStaticStringCount();
+  }
   transport->sendString(result.str());
   return true;
 }
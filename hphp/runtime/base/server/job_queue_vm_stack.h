@@ -17,6 +17,7 @@
 #define incl_HPHP_RUNTIME_BASE_SERVER_JOB_QUEUE_VM_STACK_H_
 
 #include "hphp/util/base.h"
+#include "hphp/runtime/base/memory/memory_manager.h"
 
 namespace HPHP {
 //////////////////////////////////////////////////////////////////////
@@ -24,7 +25,10 @@ namespace HPHP {
 void flush_evaluation_stack();
 
 struct JobQueueDropVMStack {
-  static void dropCache() { flush_evaluation_stack(); }
+  static void dropCache() {
+    flush_evaluation_stack();
+    MemoryManager::TheMemoryManager()->trimSlabCache();
+  }
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -0,0 +1,158 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include "hphp/runtime/base/server/unit_preloader.h"
+
+#include <atomic>
+#include <fstream>
+
+#include "hphp/runtime/base/file_repository.h"
+#include "hphp/runtime/base/program_functions.h"
+#include "hphp/runtime/base/runtime_option.h"
+#include "hphp/runtime/base/server/source_root_info.h"
+#include "hphp/runtime/vm/repo.h"
+#include "hphp/runtime/vm/unit.h"
+#include "hphp/util/job_queue.h"
+#include "hphp/util/lock.h"
+#include "hphp/util/logger.h"
+#include "hphp/util/timer.h"
+#include "hphp/util/trace.h"
+
+namespace HPHP {
+
+TRACE_SET_MOD(fr);
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+std::atomic<int> s_loaded;
+Mutex s_unitsLock;
+std::vector<Unit*> s_units;
+
+struct PreloadWorker : JobQueueWorker<std::string> {
+  virtual void doJob(std::string path) {
+    // Compiling or loading a unit allocates from the request heap, so
+    // give each one a session of its own, like a request would.
+    hphp_session_init();
+    auto context = hphp_context_init();
+    try {
+      String name(path);
+      if (path[0] != '/') {
+        name = String(SourceRootInfo::GetCurrentSourceRoot()) + name;
+      }
+      struct stat s;
+      if (Eval::FileRepository::findFile(name.get(), &s)) {
+        Eval::PhpFile* efile = Eval::FileRepository::checkoutFile(name.get(),
+                                                                  s);
+        if (efile) {
+          {
+            Lock lock(s_unitsLock);
+            s_units.push_back(efile->unit());
+          }
+          // The FileRepository keeps its own reference.
+          efile->decRef();
+          ++s_loaded;
+          TRACE(2, "preloaded %s\n", name.data());
+        }
+      } else {
+        TRACE(1, "preload: %s not found\n", name.data());
+      }
+    } catch (const std::exception& e) {
+      Logger::Warning("Preloading %s failed: %s", path.c_str(), e.what());
+    }
+    hphp_context_exit(context, false, false);
+    hphp_session_exit();
+  }
+};
+
+void readHotList(const std::string& file, std::vector<std::string>& paths) {
+  std::ifstream in(file.c_str());
+  if (!in) {
+    Logger::Warning("Unable to read preload hot list %s", file.c_str());
+    return;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    paths.push_back(line);
+  }
+}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void UnitPreloader::Run() {
+  int threads = RuntimeOption::ServerPreloadThreads;
+  if (threads <= 0) return;
+
+  std::vector<std::string> paths;
+  if (!RuntimeOption::ServerPreloadHotList.empty()) {
+    readHotList(RuntimeOption::ServerPreloadHotList, paths);
+  }
+  size_t hot = paths.size();
+  if (RuntimeOption::RepoAuthoritative && RuntimeOption::ServerPreloadAll) {
+    Repo::get().enumerateFiles(paths);
+  }
+  if (paths.empty()) return;
+
+  timespec start, end;
+  gettime(CLOCK_MONOTONIC, &start);
+  Logger::Info("Preloading %zu units (%zu hot) on %d threads",
+               paths.size(), hot, threads);
+
+  JobQueueDispatcher<std::string, PreloadWorker> dispatcher(
+    threads,
+    false, // round robin
+    0,     // drop cache timeout
+    false, // drop stack
+    nullptr
+  );
+  // Jobs are handed out in the order they were queued, so the hot list
+  // goes first; anything it shares with the rest of the repo is a
+  // cheap FileRepository hit the second time around.
+  for (auto& path : paths) {
+    dispatcher.enqueue(path);
+  }
+  dispatcher.start();
+  dispatcher.stop();
+
+  gettime(CLOCK_MONOTONIC, &end);
+  Logger::Info("Preloaded %d units in %" PRId64 "ms", s_loaded.load(),
+               gettime_diff_us(start, end) / 1000);
+
+  if (RuntimeOption::RepoAuthoritative && RuntimeOption::ServerPreloadClasses) {
+    PrebuildClasses();
+  }
+  s_units.clear();
+}
+
+void UnitPreloader::PrebuildClasses() {
+  timespec start, end;
+  gettime(CLOCK_MONOTONIC, &start);
+  hphp_session_init();
+  auto context = hphp_context_init();
+  size_t classes = Unit::prebuildClasses(s_units);
+  hphp_context_exit(context, false, false);
+  hphp_session_exit();
+  gettime(CLOCK_MONOTONIC, &end);
+  Logger::Info("Prebuilt %zu classes in %" PRId64 "ms", classes,
+               gettime_diff_us(start, end) / 1000);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,50 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef incl_HPHP_UNIT_PRELOADER_H_
+#define incl_HPHP_UNIT_PRELOADER_H_
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Loads units into the FileRepository before the server starts taking
+ * traffic, so the first requests don't all stall on the same cold
+ * files.
+ *
+ * Paths come from Server.Preload.HotList, one per line, hottest first,
+ * and then (in RepoAuthoritative mode with Server.Preload.All set) from
+ * every other file in the repo.  They are handed out in that order to
+ * Server.Preload.Threads worker threads; Run() returns once all of them
+ * have been loaded.  It does nothing if Server.Preload.Threads is 0.
+ *
+ * In RepoAuthoritative mode, unless Server.Preload.Classes is false, it
+ * then builds the Class for every class in the loaded units, so the
+ * first request to define each one reuses it instead of paying for
+ * Class::newClass.
+ */
+class UnitPreloader {
+public:
+  static void Run();
+
+private:
+  static void PrebuildClasses();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // incl_HPHP_UNIT_PRELOADER_H_
@@ -17,6 +17,7 @@
 #include "hphp/runtime/base/shared/concurrent_shared_store.h"
 #include "hphp/runtime/base/variable_serializer.h"
 #include "hphp/runtime/ext/ext_apc.h"
+#include "hphp/runtime/vm/treadmill.h"
 #include "hphp/util/logger.h"
 #include "hphp/util/timer.h"
 #include <mutex>
@@ -150,8 +151,8 @@ bool ConcurrentTableSharedStore::eraseImpl(CStrRef key, bool expired) {
   return false;
 }
 
-// Should be called outside m_lock
-void ConcurrentTableSharedStore::purgeExpired() {
+// Should be called outside any table lock
+void TableSharedStore::purgeExpired() {
   if (m_purgeCounter.fetch_add(1, std::memory_order_relaxed) %
       RuntimeOption::ApcPurgeFrequency != 0) {
     return;
@@ -189,7 +190,7 @@ void ConcurrentTableSharedStore::purgeExpired() {
   SharedStoreStats::setExpireQueueSize(m_expQueue.size());
 }
 
-void ConcurrentTableSharedStore::addToExpirationQueue(const char* key, int64_t etime) {
+void TableSharedStore::addToExpirationQueue(const char* key, int64_t etime) {
   ExpMap::accessor acc;
   if (m_expMap.find(acc, key)) {
     acc->second++;
@@ -241,8 +242,8 @@ static string std_apc_cas = "apc.cas";
 static string std_apc_update = "apc.update";
 static string std_apc_new = "apc.new";
 
-SharedVariant* ConcurrentTableSharedStore::unserialize(CStrRef key,
-                                                       const StoreValue* sval) {
+SharedVariant* TableSharedStore::unserialize(CStrRef key,
+                                             const StoreValue* sval) {
   try {
     VariableUnserializer::Type sType =
       RuntimeOption::EnableApcSerialize ?
@@ -500,8 +501,8 @@ void ConcurrentTableSharedStore::prime
   }
 }
 
-bool ConcurrentTableSharedStore::constructPrime(CStrRef v, KeyValuePair& item,
-                                                bool serialized) {
+bool TableSharedStore::constructPrime(CStrRef v, KeyValuePair& item,
+                                      bool serialized) {
   if (s_apc_file_storage.getState() !=
       SharedStoreFileStorage::StorageState::Invalid &&
       (!v->isStatic() || serialized)) {
@@ -523,8 +524,7 @@ bool ConcurrentTableSharedStore::constructPrime(CStrRef v, KeyValuePair& item,
   return true;
 }
 
-bool ConcurrentTableSharedStore::constructPrime(CVarRef v,
-                                                KeyValuePair& item) {
+bool TableSharedStore::constructPrime(CVarRef v, KeyValuePair& item) {
   if (s_apc_file_storage.getState() !=
       SharedStoreFileStorage::StorageState::Invalid &&
       (IS_REFCOUNTED_TYPE(v.getType()))) {
@@ -541,7 +541,7 @@ bool ConcurrentTableSharedStore::constructPrime(CVarRef v,
   return true;
 }
 
-void ConcurrentTableSharedStore::primeDone() {
+void TableSharedStore::primeDone() {
   if (s_apc_file_storage.getState() !=
       SharedStoreFileStorage::StorageState::Invalid) {
     s_apc_file_storage.seal();
@@ -554,6 +554,10 @@ void ConcurrentTableSharedStore::primeDone() {
                          time(nullptr) +
                          RuntimeOption::ApcFileStorageAdviseOutPeriod);
   }
+}
+
+void ConcurrentTableSharedStore::primeDone() {
+  TableSharedStore::primeDone();
 
   for (set<string>::const_iterator iter =
          RuntimeOption::ApcCompletionKeys.begin();
@@ -569,6 +573,27 @@ void ConcurrentTableSharedStore::primeDone() {
 ///////////////////////////////////////////////////////////////////////////////
 // debugging support
 
+static void dump_value(std::ostream & out, const StoreValue *sval) {
+  if (sval->expired()) return;
+  VariableSerializer vs(VariableSerializer::Type::Serialize);
+  Variant value;
+  if (sval->inMem()) {
+    value = sval->var->toLocal();
+  } else {
+    assert(sval->inFile());
+    // we need unserialize and serialize again because the format was
+    // APCSerialize
+    String s(sval->sAddr, sval->getSerializedSize(), AttachLiteral);
+    value = apc_unserialize(s);
+  }
+  try {
+    String valS(vs.serialize(value, true));
+    out << valS->toCPPString();
+  } catch (const Exception &e) {
+    out << "Exception: " << e.what();
+  }
+}
+
 void ConcurrentTableSharedStore::dump(std::ostream & out, bool keyOnly,
                                       int waitSeconds) {
   // Use write lock here to prevent concurrent ops running in parallel from
@@ -590,26 +615,7 @@ void ConcurrentTableSharedStore::dump(std::ostream & out, bool keyOnly,
     out << key;
     if (!keyOnly) {
       out << " #### ";
-      const StoreValue *sval = &iter->second;
-      if (!sval->expired()) {
-        VariableSerializer vs(VariableSerializer::Type::Serialize);
-        Variant value;
-        if (sval->inMem()) {
-          value = sval->var->toLocal();
-        } else {
-          assert(sval->inFile());
-          // we need unserialize and serialize again because the format was
-          // APCSerialize
-          String s(sval->sAddr, sval->getSerializedSize(), AttachLiteral);
-          value = apc_unserialize(s);
-        }
-        try {
-          String valS(vs.serialize(value, true));
-          out << valS->toCPPString();
-        } catch (const Exception &e) {
-          out << "Exception: " << e.what();
-        }
-      }
+      dump_value(out, &iter->second);
     }
     out << std::endl;
   }
@@ -619,5 +625,494 @@ void ConcurrentTableSharedStore::dump(std::ostream & out, bool keyOnly,
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// LockFreeTableSharedStore
+
+namespace {
+
+/*
+ * Frees a batch of nodes (or tables) retired together, once no request
+ * that started before they were unlinked is still running.
+ */
+class FreedNodes : public Treadmill::WorkItem {
+  std::vector<void*> m_ptrs;
+public:
+  explicit FreedNodes(std::vector<void*>&& ptrs) : m_ptrs(std::move(ptrs)) {}
+  virtual void operator()() {
+    for (auto it = m_ptrs.begin(); it != m_ptrs.end(); ++it) {
+      free(*it);
+    }
+  }
+};
+
+}
+
+LockFreeTableSharedStore::Node*
+LockFreeTableSharedStore::Node::Make(const char* key, int32_t len,
+                                     strhash_t h, const StoreValue& sval) {
+  void* mem = malloc(sizeof(Node) + len + 1);
+  Node* n = new (mem) Node(h, len, sval);
+  char* k = reinterpret_cast<char*>(n + 1);
+  memcpy(k, key, len);
+  k[len] = '\0';
+  return n;
+}
+
+LockFreeTableSharedStore::Table*
+LockFreeTableSharedStore::NewTable(size_t nbuckets) {
+  assert((nbuckets & (nbuckets - 1)) == 0);
+  // calloc leaves every bucket a null std::atomic<Node*>.
+  Table* t = static_cast<Table*>(
+    calloc(1, sizeof(Table) + nbuckets * sizeof(std::atomic<Node*>)));
+  t->mask = nbuckets - 1;
+  t->buckets = reinterpret_cast<std::atomic<Node*>*>(t + 1);
+  return t;
+}
+
+LockFreeTableSharedStore::LockFreeTableSharedStore(int id)
+  : TableSharedStore(id), m_table(NewTable(kInitialBuckets)), m_size(0) {
+}
+
+LockFreeTableSharedStore::~LockFreeTableSharedStore() {
+  // Like the other stores, this leaves the values alone; they may still
+  // be referenced from the treadmill.
+  Table* t = m_table.load(std::memory_order_relaxed);
+  for (size_t i = 0; i <= t->mask; ++i) {
+    Node* n = t->buckets[i].load(std::memory_order_relaxed);
+    while (n) {
+      Node* next = n->next.load(std::memory_order_relaxed);
+      free(n);
+      n = next;
+    }
+  }
+  free(t);
+}
+
+void LockFreeTableSharedStore::lockAll() {
+  for (int i = 0; i < kNumLocks; ++i) m_locks[i].lock.lock();
+}
+
+void LockFreeTableSharedStore::unlockAll() {
+  for (int i = kNumLocks; i--; ) m_locks[i].lock.unlock();
+}
+
+/*
+ * Readers: no locks.  Whatever we reach through an acquire load stays
+ * allocated until this request finishes, even if a writer unlinks it.
+ */
+const LockFreeTableSharedStore::Node*
+LockFreeTableSharedStore::find(const char* key, int32_t len,
+                               strhash_t h) const {
+  Table* t = m_table.load(std::memory_order_acquire);
+  const Node* n = t->buckets[h & t->mask].load(std::memory_order_acquire);
+  while (n && !n->matches(key, len, h)) {
+    n = n->next.load(std::memory_order_acquire);
+  }
+  return n;
+}
+
+/*
+ * Writers, holding lockFor(h): returns the link that points at key's
+ * node, or the null link at the end of its chain.
+ */
+std::atomic<LockFreeTableSharedStore::Node*>*
+LockFreeTableSharedStore::findLink(const char* key, int32_t len,
+                                   strhash_t h) const {
+  Table* t = m_table.load(std::memory_order_relaxed);
+  std::atomic<Node*>* link = &t->buckets[h & t->mask];
+  Node* n;
+  while ((n = link->load(std::memory_order_relaxed)) &&
+         !n->matches(key, len, h)) {
+    link = &n->next;
+  }
+  return link;
+}
+
+/*
+ * Unlinked nodes are freed with the rest of the request's garbage when it
+ * ends, so a busy writer doesn't take the treadmill's lock for every
+ * update.
+ */
+void LockFreeTableSharedStore::retire(Node* n) {
+  g_vmContext->enqueueFree(n);
+}
+
+void LockFreeTableSharedStore::replace(std::atomic<Node*>* link, Node* old,
+                                       Node* fresh) {
+  fresh->next.store(old->next.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+  link->store(fresh, std::memory_order_release);
+  retire(old);
+}
+
+/*
+ * Used for priming: nothing is being fetched yet and there are no stats
+ * to update, so a replaced node's value is simply dropped.  Priming runs
+ * outside any request, so the node goes straight to the treadmill.
+ */
+LockFreeTableSharedStore::Node*
+LockFreeTableSharedStore::insert(const char* key, int32_t len,
+                                 const StoreValue& sval, bool overwrite) {
+  strhash_t h = hash_string_inline(key, len);
+  std::lock_guard<SmallLock> g(lockFor(h));
+  std::atomic<Node*>* link = findLink(key, len, h);
+  Node* old = link->load(std::memory_order_relaxed);
+  if (old && !overwrite) return nullptr;
+  Node* fresh = Node::Make(key, len, h, sval);
+  if (old) {
+    fresh->next.store(old->next.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+    link->store(fresh, std::memory_order_release);
+    Treadmill::deferredFree(old);
+  } else {
+    link->store(fresh, std::memory_order_release);
+    ++m_size;
+  }
+  return fresh;
+}
+
+/*
+ * Grow the table to at least count buckets.  Nodes in the old table are
+ * still being walked by readers, so they're copied rather than relinked.
+ */
+void LockFreeTableSharedStore::reserve(size_t count) {
+  if (count <= m_table.load(std::memory_order_acquire)->mask + 1) return;
+  lockAll();
+  Table* old = m_table.load(std::memory_order_relaxed);
+  size_t nbuckets = old->mask + 1;
+  if (count <= nbuckets) {
+    unlockAll();
+    return;
+  }
+  while (nbuckets < count) nbuckets *= 2;
+  Table* t = NewTable(nbuckets);
+  std::vector<void*> retired;
+  retired.reserve(m_size.load(std::memory_order_relaxed) + 1);
+  for (size_t i = 0; i <= old->mask; ++i) {
+    for (Node* n = old->buckets[i].load(std::memory_order_relaxed); n;
+         n = n->next.load(std::memory_order_relaxed)) {
+      Node* copy = Node::Copy(n);
+      std::atomic<Node*>& head = t->buckets[copy->hash & t->mask];
+      copy->next.store(head.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+      head.store(copy, std::memory_order_relaxed);
+      retired.push_back(n);
+    }
+  }
+  retired.push_back(old);
+  m_table.store(t, std::memory_order_release);
+  unlockAll();
+  Treadmill::WorkItem::enqueue(new FreedNodes(std::move(retired)));
+}
+
+bool LockFreeTableSharedStore::clear() {
+  lockAll();
+  Table* old = m_table.load(std::memory_order_relaxed);
+  std::vector<void*> retired;
+  retired.reserve(m_size.load(std::memory_order_relaxed) + 1);
+  for (size_t i = 0; i <= old->mask; ++i) {
+    for (Node* n = old->buckets[i].load(std::memory_order_relaxed); n;
+         n = n->next.load(std::memory_order_relaxed)) {
+      if (n->sval.inMem()) {
+        g_vmContext->enqueueSharedVar(n->sval.var);
+      }
+      retired.push_back(n);
+    }
+  }
+  retired.push_back(old);
+  m_table.store(NewTable(kInitialBuckets), std::memory_order_release);
+  m_size = 0;
+  unlockAll();
+  Treadmill::WorkItem::enqueue(new FreedNodes(std::move(retired)));
+  return true;
+}
+
+bool LockFreeTableSharedStore::eraseImpl(CStrRef key, bool expired) {
+  if (key.isNull()) return false;
+  strhash_t h = key->hash();
+  std::lock_guard<SmallLock> g(lockFor(h));
+  std::atomic<Node*>* link = findLink(key.data(), key.size(), h);
+  Node* n = link->load(std::memory_order_relaxed);
+  if (!n) return false;
+  const StoreValue *sval = &n->sval;
+  if (expired && !sval->expired()) {
+    return false;
+  }
+  if (sval->inMem()) {
+    stats_on_delete(key.get(), sval, expired);
+    g_vmContext->enqueueSharedVar(sval->var);
+  } else {
+    assert(sval->inFile());
+    assert(sval->expiry == 0);
+  }
+  if (expired && sval->inFile()) {
+    // a primed key expired, do not erase the table entry
+    StoreValue primed;
+    primed.sAddr = sval->sAddr;
+    primed.sSize = sval->sSize;
+    replace(link, n, Node::Make(key.data(), key.size(), h, primed));
+  } else {
+    link->store(n->next.load(std::memory_order_relaxed),
+                std::memory_order_release);
+    retire(n);
+    --m_size;
+  }
+  return true;
+}
+
+/*
+ * A primed value still in file storage: unserialize it into a copy of its
+ * node, under the writer lock so only one thread does so.
+ */
+SharedVariant* LockFreeTableSharedStore::loadPrimed(CStrRef key) {
+  strhash_t h = key->hash();
+  std::lock_guard<SmallLock> g(lockFor(h));
+  std::atomic<Node*>* link = findLink(key.data(), key.size(), h);
+  Node* n = link->load(std::memory_order_relaxed);
+  if (!n) return nullptr;
+  if (n->sval.inMem()) return n->sval.var;
+  Node* fresh = Node::Copy(n);
+  SharedVariant* svar = unserialize(key, &fresh->sval);
+  if (!svar) {
+    free(fresh);
+    return nullptr;
+  }
+  replace(link, n, fresh);
+  return svar;
+}
+
+bool LockFreeTableSharedStore::handlePromoteObj(CStrRef key,
+                                                SharedVariant* svar,
+                                                CVarRef value) {
+  SharedVariant *converted = svar->convertObj(value);
+  if (!converted) return false;
+  strhash_t h = key->hash();
+  std::lock_guard<SmallLock> g(lockFor(h));
+  std::atomic<Node*>* link = findLink(key.data(), key.size(), h);
+  Node* n = link->load(std::memory_order_relaxed);
+  // Another thread may have deleted or updated the key while we were
+  // converting the object; if so, just bail.
+  if (!n || n->sval.var != svar || svar->isUnserializedObj()) {
+    delete converted;
+    return false;
+  }
+  int64_t ttl = n->sval.expiry ? n->sval.expiry - time(nullptr) : 0;
+  stats_on_update(key.get(), &n->sval, converted, ttl);
+  Node* fresh = Node::Copy(n);
+  fresh->sval.var = converted;
+  replace(link, n, fresh);
+  g_vmContext->enqueueSharedVar(svar);
+  return true;
+}
+
+bool LockFreeTableSharedStore::get(CStrRef key, Variant &value) {
+  const Node* n = find(key.data(), key.size(), key->hash());
+  if (!n) {
+    log_apc(std_apc_miss);
+    return false;
+  }
+  if (n->sval.expired()) {
+    log_apc(std_apc_miss);
+    eraseImpl(key, true);
+    return false;
+  }
+  SharedVariant *svar = n->sval.var;
+  if (!svar) {
+    svar = loadPrimed(key);
+    if (!svar) return false;
+  }
+  value = svar->toLocal();
+  stats_on_get(key.get(), svar);
+  log_apc(std_apc_hit);
+
+  if (RuntimeOption::ApcAllowObj && svar->is(KindOfObject)) {
+    handlePromoteObj(key, svar, value);
+  }
+  return true;
+}
+
+int64_t LockFreeTableSharedStore::inc(CStrRef key, int64_t step,
+                                      bool &found) {
+  found = false;
+  strhash_t h = key->hash();
+  std::lock_guard<SmallLock> g(lockFor(h));
+  std::atomic<Node*>* link = findLink(key.data(), key.size(), h);
+  Node* n = link->load(std::memory_order_relaxed);
+  if (!n || n->sval.expired()) return 0;
+  int64_t ret = get_int64_value(&n->sval) + step;
+  Node* fresh = Node::Copy(n);
+  fresh->sval.var = construct(Variant(ret));
+  if (n->sval.inMem()) {
+    g_vmContext->enqueueSharedVar(n->sval.var);
+  }
+  replace(link, n, fresh);
+  found = true;
+  log_apc(std_apc_hit);
+  return ret;
+}
+
+bool LockFreeTableSharedStore::cas(CStrRef key, int64_t old, int64_t val) {
+  strhash_t h = key->hash();
+  std::lock_guard<SmallLock> g(lockFor(h));
+  std::atomic<Node*>* link = findLink(key.data(), key.size(), h);
+  Node* n = link->load(std::memory_order_relaxed);
+  if (!n || n->sval.expired() || get_int64_value(&n->sval) != old) {
+    return false;
+  }
+  Node* fresh = Node::Copy(n);
+  fresh->sval.var = construct(Variant(val));
+  if (n->sval.inMem()) {
+    g_vmContext->enqueueSharedVar(n->sval.var);
+  }
+  replace(link, n, fresh);
+  log_apc(std_apc_cas);
+  return true;
+}
+
+bool LockFreeTableSharedStore::exists(CStrRef key) {
+  const Node* n = find(key.data(), key.size(), key->hash());
+  if (!n) {
+    log_apc(std_apc_miss);
+    return false;
+  }
+  if (n->sval.expired()) {
+    log_apc(std_apc_miss);
+    eraseImpl(key, true);
+    return false;
+  }
+  // No need toLocal() here, avoiding the copy
+  if (n->sval.inMem()) {
+    stats_on_get(key.get(), n->sval.var);
+  }
+  log_apc(std_apc_hit);
+  return true;
+}
+
+bool LockFreeTableSharedStore::store(CStrRef key, CVarRef value, int64_t ttl,
+                                     bool overwrite /* = true */) {
+  SharedVariant* svar = construct(value);
+  strhash_t h = key->hash();
+  bool present;
+  time_t expiry;
+  {
+    std::lock_guard<SmallLock> g(lockFor(h));
+    std::atomic<Node*>* link = findLink(key.data(), key.size(), h);
+    Node* n = link->load(std::memory_order_relaxed);
+    present = n != nullptr;
+    bool update = false;
+    bool overwritePrime = false;
+    StoreValue sval;
+    if (present) {
+      if (!overwrite && !n->sval.expired()) {
+        delete svar;
+        return false;
+      }
+      // if ApcTTLLimit is set, then only primed keys can have expiry == 0
+      overwritePrime = (n->sval.expiry == 0);
+      if (n->sval.inMem()) {
+        stats_on_update(key.get(), &n->sval, svar,
+                        adjust_ttl(ttl, overwritePrime));
+        sval.size = n->sval.size;
+        g_vmContext->enqueueSharedVar(n->sval.var);
+        update = true;
+      }
+      // an inFile copy is dropped since we are updating the key
+    }
+    int64_t adjustedTtl = adjust_ttl(ttl, overwritePrime);
+    if (check_noTTL(key.data())) {
+      adjustedTtl = 0;
+    }
+    sval.set(svar, adjustedTtl);
+    expiry = sval.expiry;
+    if (!update) {
+      stats_on_add(key.get(), &sval, adjustedTtl, false, false);
+    }
+    Node* fresh = Node::Make(key.data(), key.size(), h, sval);
+    if (present) {
+      replace(link, n, fresh);
+    } else {
+      link->store(fresh, std::memory_order_release);
+      ++m_size;
+    }
+  }
+  if (!present) {
+    reserve(m_size.load(std::memory_order_relaxed));
+  }
+  if (expiry) {
+    addToExpirationQueue(key.data(), expiry);
+  }
+  if (RuntimeOption::ApcExpireOnSets) {
+    purgeExpired();
+  }
+  if (present) {
+    log_apc(std_apc_update);
+  } else {
+    log_apc(std_apc_new);
+    if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCKeyStats) {
+      string prefix = "apc.new." + GetSkeleton(key);
+      ServerStats::Log(prefix, 1);
+    }
+  }
+  return true;
+}
+
+void LockFreeTableSharedStore::prime
+(const std::vector<SharedStore::KeyValuePair> &vars) {
+  reserve(m_size.load(std::memory_order_relaxed) + vars.size());
+  // we are priming, so we are not checking existence or expiration
+  for (unsigned int i = 0; i < vars.size(); i++) {
+    const SharedStore::KeyValuePair &item = vars[i];
+    StoreValue sval;
+    if (item.inMem()) {
+      sval.set(item.value, 0);
+    } else {
+      sval.sAddr = item.sAddr;
+      sval.sSize = item.sSize;
+    }
+    Node* n = insert(item.key, item.len, sval, true);
+    if (item.inMem() && RuntimeOption::APCSizeCountPrime) {
+      StackStringData sd(n->key());
+      stats_on_add(&sd, &n->sval, 0, true, false);
+    }
+  }
+}
+
+void LockFreeTableSharedStore::primeDone() {
+  TableSharedStore::primeDone();
+
+  for (set<string>::const_iterator iter =
+         RuntimeOption::ApcCompletionKeys.begin();
+       iter != RuntimeOption::ApcCompletionKeys.end(); ++iter) {
+    StoreValue sval;
+    sval.set(this->construct(1), 0);
+    if (!insert(iter->c_str(), iter->size(), sval, false)) {
+      delete sval.var;
+    }
+  }
+}
+
+void LockFreeTableSharedStore::dump(std::ostream & out, bool keyOnly,
+                                    int waitSeconds) {
+  // Readers never block, so there's nothing to wait for; holding every
+  // writer lock keeps the table still while we walk it.
+  lockAll();
+  Logger::Info("dumping apc");
+  out << "Total " << size() << std::endl;
+  Table* t = m_table.load(std::memory_order_relaxed);
+  for (size_t i = 0; i <= t->mask; ++i) {
+    for (const Node* n = t->buckets[i].load(std::memory_order_relaxed); n;
+         n = n->next.load(std::memory_order_relaxed)) {
+      out << n->key();
+      if (!keyOnly) {
+        out << " #### ";
+        dump_value(out, &n->sval);
+      }
+      out << std::endl;
+    }
+  }
+  unlockAll();
+  Logger::Info("dumping apc done");
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
@@ -19,6 +19,8 @@
 
 #define TBB_PREVIEW_CONCURRENT_PRIORITY_QUEUE 1
 
+#include <atomic>
+
 #include "hphp/runtime/base/shared/shared_store_base.h"
 #include "hphp/runtime/base/complex_types.h"
 #include "hphp/runtime/base/shared/shared_variant.h"
@@ -34,32 +36,21 @@ namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
 ///////////////////////////////////////////////////////////////////////////////
-// ConcurrentThreadSharedStore
+// TableSharedStore
 
-class ConcurrentTableSharedStore : public SharedStore {
+/*
+ * What the table-based stores have in common: priming into file storage,
+ * unserializing primed values on first access, and the expiration queue.
+ */
+class TableSharedStore : public SharedStore {
 public:
-  explicit ConcurrentTableSharedStore(int id)
-    : SharedStore(id), m_lockingFlag(false), m_purgeCounter(0) {}
+  explicit TableSharedStore(int id) : SharedStore(id), m_purgeCounter(0) {}
 
-  virtual int size() {
-    return m_vars.size();
-  }
-  virtual bool get(CStrRef key, Variant &value);
-  virtual bool store(CStrRef key, CVarRef val, int64_t ttl,
-                     bool overwrite = true);
-  virtual int64_t inc(CStrRef key, int64_t step, bool &found);
-  virtual bool cas(CStrRef key, int64_t old, int64_t val);
-  virtual bool exists(CStrRef key);
-
-  virtual void prime(const std::vector<SharedStore::KeyValuePair> &vars);
   virtual bool constructPrime(CStrRef v, KeyValuePair& item,
                               bool serialized);
   virtual bool constructPrime(CVarRef v, KeyValuePair& item);
   virtual void primeDone();
 
-  // debug support
-  virtual void dump(std::ostream & out, bool keyOnly, int waitSeconds);
-
 protected:
   virtual SharedVariant* construct(CVarRef v) {
     return new SharedVariant(v, false);
@@ -76,6 +67,55 @@ protected:
     }
   };
 
+  typedef std::pair<const char*, time_t> ExpirationPair;
+  class ExpirationCompare {
+  public:
+    bool operator()(const ExpirationPair &p1, const ExpirationPair &p2) {
+      return p1.second > p2.second;
+    }
+  };
+
+  tbb::concurrent_priority_queue<ExpirationPair,
+                                 ExpirationCompare> m_expQueue;
+  typedef tbb::concurrent_hash_map<const char*, int, charHashCompare>
+    ExpMap;
+  ExpMap m_expMap;
+
+  std::atomic<uint64_t> m_purgeCounter;
+
+  // Should be called outside any table lock
+  void purgeExpired();
+
+  void addToExpirationQueue(const char* key, int64_t etime);
+
+  SharedVariant* unserialize(CStrRef key, const StoreValue* sval);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// ConcurrentThreadSharedStore
+
+class ConcurrentTableSharedStore : public TableSharedStore {
+public:
+  explicit ConcurrentTableSharedStore(int id)
+    : TableSharedStore(id), m_lockingFlag(false) {}
+
+  virtual int size() {
+    return m_vars.size();
+  }
+  virtual bool get(CStrRef key, Variant &value);
+  virtual bool store(CStrRef key, CVarRef val, int64_t ttl,
+                     bool overwrite = true);
+  virtual int64_t inc(CStrRef key, int64_t step, bool &found);
+  virtual bool cas(CStrRef key, int64_t old, int64_t val);
+  virtual bool exists(CStrRef key);
+
+  virtual void prime(const std::vector<SharedStore::KeyValuePair> &vars);
+  virtual void primeDone();
+
+  // debug support
+  virtual void dump(std::ostream & out, bool keyOnly, int waitSeconds);
+
+protected:
   typedef tbb::concurrent_hash_map<const char*, StoreValue, charHashCompare>
     Map;
 
@@ -95,31 +135,112 @@ protected:
   ReadWriteMutex m_lock;
   bool m_lockingFlag; // flag to enable temporary locking
 
-  typedef std::pair<const char*, time_t> ExpirationPair;
-  class ExpirationCompare {
-  public:
-    bool operator()(const ExpirationPair &p1, const ExpirationPair &p2) {
-      return p1.second > p2.second;
+  bool handleUpdate(CStrRef key, SharedVariant* svar);
+  bool handlePromoteObj(CStrRef key, SharedVariant* svar, CVarRef valye);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// LockFreeTableSharedStore
+
+/*
+ * A chained hash table whose readers take no locks at all.  Buckets and
+ * chain links are atomic pointers, and a published Node is never
+ * modified: writers link in an updated copy and hand the old node to the
+ * Treadmill, which frees it once every request that might still be
+ * walking it has finished.  Each request batches the nodes it unlinks
+ * into a single treadmill item at request exit.  Writers serialize on one
+ * of kNumLocks locks picked by the key's hash; growing the table takes
+ * all of them.
+ */
+class LockFreeTableSharedStore : public TableSharedStore {
+public:
+  explicit LockFreeTableSharedStore(int id);
+  ~LockFreeTableSharedStore();
+
+  virtual int size() {
+    return m_size.load(std::memory_order_relaxed);
+  }
+  virtual bool get(CStrRef key, Variant &value);
+  virtual bool store(CStrRef key, CVarRef val, int64_t ttl,
+                     bool overwrite = true);
+  virtual int64_t inc(CStrRef key, int64_t step, bool &found);
+  virtual bool cas(CStrRef key, int64_t old, int64_t val);
+  virtual bool exists(CStrRef key);
+
+  virtual void prime(const std::vector<SharedStore::KeyValuePair> &vars);
+  virtual void primeDone();
+
+  // debug support
+  virtual void dump(std::ostream & out, bool keyOnly, int waitSeconds);
+
+protected:
+  virtual bool clear();
+
+  virtual bool eraseImpl(CStrRef key, bool expired);
+
+private:
+  struct Node {
+    Node(strhash_t h, int32_t l, const StoreValue& v)
+      : next(nullptr), hash(h), len(l), sval(v) {}
+
+    static Node* Make(const char* key, int32_t len, strhash_t h,
+                      const StoreValue& sval);
+    static Node* Copy(const Node* n) {
+      return Make(n->key(), n->len, n->hash, n->sval);
+    }
+
+    // The key is allocated inline, just past the node.
+    const char* key() const {
+      return reinterpret_cast<const char*>(this + 1);
     }
+    bool matches(const char* k, int32_t l, strhash_t h) const {
+      return hash == h && len == l && memcmp(key(), k, l) == 0;
+    }
+
+    std::atomic<Node*> next;
+    const strhash_t hash;
+    const int32_t len;
+    StoreValue sval;
   };
 
-  tbb::concurrent_priority_queue<ExpirationPair,
-                                 ExpirationCompare> m_expQueue;
-  typedef tbb::concurrent_hash_map<const char*, int, charHashCompare>
-    ExpMap;
-  ExpMap m_expMap;
+  struct Table {
+    size_t mask;
+    std::atomic<Node*>* buckets; // allocated just past the table
+  };
 
-  std::atomic<uint64_t> m_purgeCounter;
+  // Pad each lock out to a cache line, so writers on neighbouring
+  // stripes don't bounce the same line.
+  struct StripeLock {
+    SmallLock lock;
+    char padding[64 - sizeof(SmallLock)];
+  };
 
-  // Should be called outside m_lock
-  void purgeExpired();
+  static const int kNumLocks = 256;
+  static const size_t kInitialBuckets = 4096;
 
-  void addToExpirationQueue(const char* key, int64_t etime);
+  static Table* NewTable(size_t nbuckets);
 
-  bool handleUpdate(CStrRef key, SharedVariant* svar);
-  bool handlePromoteObj(CStrRef key, SharedVariant* svar, CVarRef valye);
-private:
-  SharedVariant* unserialize(CStrRef key, const StoreValue* sval);
+  SmallLock& lockFor(strhash_t h) {
+    return m_locks[h & (kNumLocks - 1)].lock;
+  }
+  void lockAll();
+  void unlockAll();
+
+  const Node* find(const char* key, int32_t len, strhash_t h) const;
+  std::atomic<Node*>* findLink(const char* key, int32_t len,
+                               strhash_t h) const;
+  static void retire(Node* n);
+  void replace(std::atomic<Node*>* link, Node* old, Node* fresh);
+  Node* insert(const char* key, int32_t len, const StoreValue& sval,
+               bool overwrite);
+  void reserve(size_t count);
+
+  SharedVariant* loadPrimed(CStrRef key);
+  bool handlePromoteObj(CStrRef key, SharedVariant* svar, CVarRef value);
+
+  std::atomic<Table*> m_table;
+  std::atomic<int> m_size;
+  StripeLock m_locks[kNumLocks];
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -88,6 +88,9 @@ void SharedStores::create() {
       case RuntimeOption::ApcTableTypes::ApcConcurrentTable:
         m_stores[i] = new ConcurrentTableSharedStore(i);
         break;
+      case RuntimeOption::ApcTableTypes::ApcLockFreeTable:
+        m_stores[i] = new LockFreeTableSharedStore(i);
+        break;
       default:
         assert(false);
     }
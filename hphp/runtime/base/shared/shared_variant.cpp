@@ -19,8 +19,95 @@
 #include "hphp/runtime/ext/ext_apc.h"
 #include "hphp/runtime/base/shared/shared_map.h"
 #include "hphp/runtime/base/runtime_option.h"
+#include "hphp/runtime/base/array/hphp_array.h"
 
 namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+// Uncounted arrays.
+
+/*
+ * An array can be stored uncounted if it holds nothing but scalars,
+ * interned strings and other such arrays.  Strings must already be in the
+ * static string table: a static StringData is assumed to be interned (and
+ * immortal) all over the runtime, so private static copies aren't safe.
+ */
+static bool isUncountable(const ArrayData* arr) {
+  if (!arr->isHphpArray() && !arr->isSharedMap()) return false;
+  for (ArrayIter it(arr); !it.end(); it.next()) {
+    Variant k = it.first();
+    if (k.isString() && !StringData::LookupStaticString(k.getStringData())) {
+      return false;
+    }
+    CVarRef v = it.secondRef();
+    if (v.isReferenced() || v.isObject()) return false;
+    if (v.isString() && !StringData::LookupStaticString(v.getStringData())) {
+      return false;
+    }
+    if (v.isArray() && !isUncountable(v.getArrayData())) return false;
+  }
+  return true;
+}
+
+static HphpArray* makeUncountedArray(ArrayData* arr) {
+  // Start from a malloc'd copy of the array.  Its keys and values were
+  // incref'd by the copy; each refcounted one is swapped for its interned
+  // or uncounted equivalent and the reference dropped.  Sub-arrays are
+  // always copied, even if they are static, since they may belong to
+  // another entry.
+  ArrayData* src = arr->escalate();
+  Array holder(src);
+  assert(src->isHphpArray());
+  HphpArray* ret = static_cast<HphpArray*>(src->nonSmartCopy());
+  for (uint32_t pos = 0, limit = ret->iterLimit(); pos < limit; ++pos) {
+    HphpArray::Elm* e = ret->getElm(pos);
+    if (e->data.m_type == HphpArray::KindOfTombstone) continue;
+    if (e->hasStrKey()) {
+      StringData* key = StringData::LookupStaticString(e->key);
+      assert(key);
+      decRefStr(e->key);
+      e->key = key;
+    }
+    TypedValue* tv = &e->data;
+    if (IS_STRING_TYPE(tv->m_type)) {
+      StringData* str = StringData::LookupStaticString(tv->m_data.pstr);
+      assert(str);
+      decRefStr(tv->m_data.pstr);
+      tv->m_data.pstr = str;
+      tv->m_type = KindOfStaticString;
+    } else if (tv->m_type == KindOfArray) {
+      HphpArray* sub = makeUncountedArray(tv->m_data.parr);
+      decRefArr(tv->m_data.parr);
+      tv->m_data.parr = sub;
+    }
+  }
+  ret->setStatic();
+  return ret;
+}
+
+static void releaseUncountedArray(HphpArray* arr) {
+  for (uint32_t pos = 0, limit = arr->iterLimit(); pos < limit; ++pos) {
+    TypedValue* tv = &arr->getElm(pos)->data;
+    if (tv->m_type == KindOfArray) {
+      releaseUncountedArray(static_cast<HphpArray*>(tv->m_data.parr));
+      tvWriteNull(tv);
+    }
+  }
+  arr->~HphpArray();
+  operator delete(arr);
+}
+
+static int32_t uncountedArraySize(HphpArray* arr) {
+  int32_t size = sizeof(HphpArray);
+  size += arr->iterLimit() * sizeof(HphpArray::Elm);
+  for (uint32_t pos = 0, limit = arr->iterLimit(); pos < limit; ++pos) {
+    TypedValue* tv = &arr->getElm(pos)->data;
+    if (tv->m_type == KindOfArray) {
+      size += uncountedArraySize(static_cast<HphpArray*>(tv->m_data.parr));
+    }
+  }
+  return size;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 SharedVariant::SharedVariant(CVarRef source, bool serialized,
@@ -84,6 +171,11 @@ StringCase:
           m_data.str = new StringData(s.data(), s.size(), CopyMalloc);
           break;
         }
+        if (RuntimeOption::ApcUseUncountedArrays && isUncountable(arr)) {
+          setIsUncounted();
+          m_data.arr = makeUncountedArray(arr);
+          break;
+        }
       }
 
       if (arr->isVectorData()) {
@@ -148,6 +240,9 @@ Variant SharedVariant::toLocal() {
         return apc_unserialize(String(m_data.str->data(), m_data.str->size(),
                                       AttachLiteral));
       }
+      if (getIsUncounted()) {
+        return m_data.arr;
+      }
       return NEW(SharedMap)(this);
     }
   case KindOfUninit:
@@ -195,6 +290,8 @@ void SharedVariant::dump(std::string &out) {
     if (getSerializedArray()) {
       out += "array: ";
       out += m_data.str->data();
+    } else if (getIsUncounted()) {
+      m_data.arr->dump(out);
     } else {
       SharedMap(this).dump(out);
     }
@@ -229,6 +326,11 @@ SharedVariant::~SharedVariant() {
         break;
       }
 
+      if (getIsUncounted()) {
+        releaseUncountedArray(static_cast<HphpArray*>(m_data.arr));
+        break;
+      }
+
       if (getIsVector()) {
         delete m_data.vec;
       } else {
@@ -278,6 +380,8 @@ int32_t SharedVariant::getSpaceUsage() const {
     assert(is(KindOfArray));
     if (getSerializedArray()) {
       size += sizeof(StringData) + m_data.str->size();
+    } else if (getIsUncounted()) {
+      size += uncountedArraySize(static_cast<HphpArray*>(m_data.arr));
     } else if (getIsVector()) {
       size += sizeof(VectorData) +
               sizeof(SharedVariant*) * m_data.vec->m_size;
@@ -332,6 +436,12 @@ void SharedVariant::getStats(SharedVariantStats *stats) const {
                              stats->dataSize;
       break;
     }
+    if (getIsUncounted()) {
+      stats->dataSize =
+        uncountedArraySize(static_cast<HphpArray*>(m_data.arr));
+      stats->dataTotalSize = sizeof(SharedVariant) + stats->dataSize;
+      break;
+    }
     if (getIsVector()) {
       stats->dataTotalSize = sizeof(SharedVariant) + sizeof(VectorData);
       stats->dataTotalSize += sizeof(SharedVariant*) * m_data.vec->m_size;
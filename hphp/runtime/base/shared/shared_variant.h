@@ -112,6 +112,7 @@ private:
     ImmutableMap* map;
     VectorData* vec;
     ImmutableObj* obj;
+    ArrayData* arr;
   };
 
   union {
@@ -143,6 +144,7 @@ private:
   const static uint8_t IsVector = (1<<1);
   const static uint8_t IsObj = (1<<2);
   const static uint8_t ObjAttempted = (1<<3);
+  const static uint8_t IsUncounted = (1<<4);
 
   static void compileTimeAssertions() {
     static_assert(offsetof(SharedVariant, m_data) == offsetof(TypedValue, m_data),
@@ -170,6 +172,16 @@ private:
   void setObjAttempted() { m_flags |= ObjAttempted;}
   void clearObjAttempted() { m_flags &= ~ObjAttempted;}
 
+  /*
+   * An uncounted array is a static, malloc'd HphpArray whose strings are
+   * interned and whose sub-arrays are uncounted too.  toLocal() hands it
+   * to the request as-is, so a fetch neither allocates nor touches a
+   * refcount.  It is freed with the SharedVariant, which the store
+   * already defers past every request that could still see it.
+   */
+  bool getIsUncounted() const { return (bool)(m_flags & IsUncounted);}
+  void setIsUncounted() { m_flags |= IsUncounted;}
+
 public:
   bool getIsVector() const { return (bool)(m_flags & IsVector);}
   ImmutableMap* getMap() const { return m_data.map; }
@@ -176,6 +176,7 @@ namespace Stats {
   /* astubs stats */ \
   STAT(Astubs_New) \
   STAT(Astubs_Reused) \
+  STAT(TC_Reused) \
   /* HphpArray */ \
   STAT(HA_FindIntFast) \
   STAT(HA_FindIntSlow) \
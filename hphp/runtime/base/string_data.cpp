@@ -29,26 +29,135 @@
 #include "hphp/runtime/base/type_conversions.h"
 #include "hphp/runtime/base/builtin_functions.h"
 #include "hphp/runtime/vm/jit/targetcache.h"
-#include "tbb/concurrent_hash_map.h"
+#include "hphp/util/smalllocks.h"
+#include "hphp/util/util.h"
+
+#include <atomic>
+#include <mutex>
+#include <algorithm>
 
 namespace HPHP {
 
 IMPLEMENT_SMART_ALLOCATION_HOT(StringData);
 ///////////////////////////////////////////////////////////////////////////////
 
-// equality checker for AtomicHashMap
-struct ahm_string_data_same {
-  bool operator()(const StringData *s1, const StringData *s2) const {
-    // ahm uses -1, -2, -3 as magic values
-    return int64_t(s1) > 0 && s1->same(s2);
+/*
+ * The static string table.
+ *
+ * Lookups are lock-free.  The table uses open addressing with linear
+ * probing, and each slot keeps the string's hash next to its pointer, so a
+ * probe rejects most other strings without touching their StringData.
+ * Inserts are rare once the server is warm; they are serialized by
+ * s_staticStringLock, publish a slot with a release store of its pointer,
+ * and grow the table by rehashing into a copy twice the size when it is
+ * half full.  A stale table still holds every string interned before it
+ * was replaced, so a lookup that misses in one simply orders before the
+ * later inserts, and GetStaticString rechecks the live table under the
+ * lock before it inserts.
+ *
+ * Superseded tables are kept, not freed.  Lookups come from static
+ * initializers, process init and threads outside any request, so the
+ * Treadmill can't tell when the last reader of an old table is gone.
+ * Capacities double, so the retired tables together hold fewer slots
+ * than the live one; GetStaticStringStats reports their size.  Sizing
+ * Eval.InitialStaticStringTableSize for the repo avoids them entirely.
+ *
+ * Each static string is allocated with room for its constant handle right
+ * after the StringData, so the handle's address survives table growth.
+ */
+namespace {
+
+struct StaticStringSlot {
+  std::atomic<StringData*> str;
+  uint32_t tag; // hash | 0x80000000, written before str is published
+};
+
+struct StaticStringTable {
+  explicit StaticStringTable(size_t capacity)
+    : mask(capacity - 1)
+    , slots(new StaticStringSlot[capacity]()) {
+    assert((capacity & mask) == 0);
   }
+  size_t capacity() const { return mask + 1; }
+
+  const size_t mask;
+  StaticStringSlot* const slots;
 };
 
-// The uint32_t is used to hold TargetCache offsets for constants
-typedef folly::AtomicHashMap<const StringData *, uint32_t,
-                             string_data_hash,
-                             ahm_string_data_same> StringDataMap;
-static StringDataMap *s_stringDataMap;
+std::atomic<StaticStringTable*> s_staticStrings;
+std::atomic<size_t> s_staticStringCount;
+// All zeroes is the unlocked state, so this is usable during static init.
+SmallLock s_staticStringLock;
+size_t s_staticStringResizes;
+size_t s_staticStringMaxProbe;
+size_t s_staticStringRetiredSlots;
+
+inline uint32_t staticStringTag(const StringData* s) {
+  return uint32_t(s->hash()) | 0x80000000U;
+}
+
+static_assert(sizeof(StringData) % alignof(uint32_t) == 0,
+              "the constant handle after a static StringData is misaligned");
+
+inline uint32_t* cnsHandleFor(const StringData* s) {
+  // Only GetStaticString allocates the room for the handle.
+  assert(s->isStatic());
+  return (uint32_t*)(s + 1);
+}
+
+StringData* findStaticString(const StaticStringTable* table,
+                             const StringData* s) {
+  uint32_t tag = staticStringTag(s);
+  for (size_t i = tag & table->mask; ; i = (i + 1) & table->mask) {
+    StaticStringSlot& slot = table->slots[i];
+    StringData* sd = slot.str.load(std::memory_order_acquire);
+    if (!sd) return nullptr;
+    if (slot.tag == tag && sd->same(s)) return sd;
+  }
+}
+
+// Returns the probe length.  Caller holds s_staticStringLock.
+size_t insertStaticString(StaticStringTable* table, StringData* sd,
+                          uint32_t tag) {
+  size_t probe = 0;
+  for (size_t i = tag & table->mask; ; i = (i + 1) & table->mask, ++probe) {
+    StaticStringSlot& slot = table->slots[i];
+    if (!slot.str.load(std::memory_order_relaxed)) {
+      slot.tag = tag;
+      slot.str.store(sd, std::memory_order_release);
+      return probe;
+    }
+  }
+}
+
+// Caller holds s_staticStringLock.
+StaticStringTable* growStaticStrings(StaticStringTable* old) {
+  auto table = new StaticStringTable(old->capacity() * 2);
+  for (size_t i = 0; i <= old->mask; ++i) {
+    StaticStringSlot& slot = old->slots[i];
+    StringData* sd = slot.str.load(std::memory_order_relaxed);
+    if (sd) insertStaticString(table, sd, slot.tag);
+  }
+  s_staticStrings.store(table, std::memory_order_release);
+  ++s_staticStringResizes;
+  s_staticStringRetiredSlots += old->capacity();
+  assert(s_staticStringRetiredSlots < table->capacity());
+  return table;
+}
+
+StaticStringTable* createStaticStrings() {
+  std::lock_guard<SmallLock> lock(s_staticStringLock);
+  StaticStringTable* table = s_staticStrings.load(std::memory_order_acquire);
+  if (!table) {
+    table = new StaticStringTable(
+      Util::roundUpToPowerOfTwo(
+        std::max(RuntimeOption::EvalInitialStaticStringTableSize, 1U) * 2));
+    s_staticStrings.store(table, std::memory_order_release);
+  }
+  return table;
+}
+
+}
 
 const StringData* StringData::convert_double_helper(double n) {
  char *buf;
@@ -76,59 +185,66 @@ const StringData* StringData::convert_integer_helper(int64_t n) {
 #ifndef NDEBUG
 static bool checkStaticStr(const StringData* s) {
   assert(s->isStatic());
-  StringDataMap::const_iterator it = s_stringDataMap->find(s);
-  assert(it != s_stringDataMap->end());
-  assert(it->first == s);
+  auto table = s_staticStrings.load(std::memory_order_acquire);
+  assert(table);
+  assert(findStaticString(table, s) == s);
   return true;
 }
 #endif
 
 size_t StringData::GetStaticStringCount() {
-  if (!s_stringDataMap) return 0;
-  return s_stringDataMap->size();
+  return s_staticStringCount.load(std::memory_order_relaxed);
+}
+
+StringData::StaticStringStats StringData::GetStaticStringStats() {
+  StaticStringStats stats;
+  std::lock_guard<SmallLock> lock(s_staticStringLock);
+  auto table = s_staticStrings.load(std::memory_order_acquire);
+  stats.count = s_staticStringCount.load(std::memory_order_relaxed);
+  stats.capacity = table ? table->capacity() : 0;
+  stats.resizes = s_staticStringResizes;
+  stats.maxProbe = s_staticStringMaxProbe;
+  stats.retiredBytes = s_staticStringRetiredSlots * sizeof(StaticStringSlot);
+  return stats;
 }
 
 StringData *StringData::GetStaticString(const StringData *str) {
-  if (UNLIKELY(!s_stringDataMap)) {
-    StringDataMap::Config config;
-    config.growthFactor = 1;
-    s_stringDataMap =
-      new StringDataMap(RuntimeOption::EvalInitialStaticStringTableSize,
-                        config);
-  }
   if (str->isStatic()) {
     assert(checkStaticStr(str));
     return const_cast<StringData*>(str);
   }
-  StringDataMap::const_iterator it = s_stringDataMap->find(str);
-  if (it != s_stringDataMap->end()) {
-    return const_cast<StringData*>(it->first);
-  }
-  // Lookup failed, so do the hard work of creating a StringData with its own
-  // copy of the key string, so that the atomic insert() has a permanent key.
-  StringData *sd = (StringData*)Util::low_malloc(sizeof(StringData));
+  StaticStringTable* table = s_staticStrings.load(std::memory_order_acquire);
+  if (UNLIKELY(!table)) table = createStaticStrings();
+  if (StringData* sd = findStaticString(table, str)) return sd;
+
+  std::lock_guard<SmallLock> lock(s_staticStringLock);
+  // Recheck the live table: it may have grown, or another thread may have
+  // interned str, since the lock-free probe.
+  table = s_staticStrings.load(std::memory_order_relaxed);
+  if (StringData* sd = findStaticString(table, str)) return sd;
+  size_t count = s_staticStringCount.load(std::memory_order_relaxed) + 1;
+  if (count * 2 > table->capacity()) table = growStaticStrings(table);
+  // Create a StringData with its own copy of the key string, followed by
+  // the constant handle for this name.
+  StringData* sd = (StringData*)Util::low_malloc(sizeof(StringData) +
+                                                 sizeof(uint32_t));
   new (sd) StringData(str->data(), str->size(), CopyMalloc);
   sd->setStatic();
-  auto pair = s_stringDataMap->insert(sd, 0);
-  if (!pair.second) {
-    sd->~StringData();
-    Util::low_free(sd);
-  }
-  assert(pair.first->first != nullptr);
-  return const_cast<StringData*>(pair.first->first);
+  *cnsHandleFor(sd) = 0;
+  size_t probe = insertStaticString(table, sd, staticStringTag(sd));
+  s_staticStringMaxProbe = std::max(s_staticStringMaxProbe, probe);
+  s_staticStringCount.store(count, std::memory_order_relaxed);
+  return sd;
 }
 
 StringData *StringData::LookupStaticString(const StringData *str) {
-  if (UNLIKELY(!s_stringDataMap)) return nullptr;
+  StaticStringTable* table = s_staticStrings.load(std::memory_order_acquire);
+  if (UNLIKELY(!table)) return nullptr;
   if (str->isStatic()) {
     assert(checkStaticStr(str));
     return const_cast<StringData*>(str);
   }
-  StringDataMap::const_iterator it = s_stringDataMap->find(str);
-  if (it != s_stringDataMap->end()) {
-    return const_cast<StringData*>(it->first);
-  }
-  return nullptr;
+  return findStaticString(table, str);
 }
 
 StringData* StringData::GetStaticString(const String& str) {
@@ -150,10 +266,9 @@ StringData *StringData::GetStaticString(const char *str) {
 }
 
 uint32_t StringData::GetCnsHandle(const StringData* cnsName) {
-  assert(s_stringDataMap);
-  StringDataMap::const_iterator it = s_stringDataMap->find(cnsName);
-  if (it != s_stringDataMap->end()) {
-    return it->second;
+  assert(s_staticStrings.load(std::memory_order_relaxed));
+  if (StringData* sd = LookupStaticString(cnsName)) {
+    return *cnsHandleFor(sd);
   }
   return 0;
 }
@@ -167,29 +282,29 @@ uint32_t StringData::DefCnsHandle(const StringData* cnsName, bool persistent) {
     // the request local TargetCache::s_constants instead.
     return 0;
   }
-  StringDataMap::iterator it = s_stringDataMap->find(cnsName);
-  assert(it != s_stringDataMap->end());
-  if (!it->second) {
-    Transl::TargetCache::allocConstant(&it->second, persistent);
-  }
-  return it->second;
+  assert(checkStaticStr(cnsName));
+  return Transl::TargetCache::allocConstant(cnsHandleFor(cnsName),
+                                            persistent);
 }
 
 Array StringData::GetConstants() {
   // Return an array of all defined constants.
-  assert(s_stringDataMap);
+  auto table = s_staticStrings.load(std::memory_order_acquire);
+  assert(table);
   Array a(Transl::TargetCache::s_constants);
 
-  for (StringDataMap::const_iterator it = s_stringDataMap->begin();
-       it != s_stringDataMap->end(); ++it) {
-    if (it->second) {
+  for (size_t i = 0; i <= table->mask; ++i) {
+    StringData* sd = table->slots[i].str.load(std::memory_order_acquire);
+    if (!sd) continue;
+    uint32_t handle = *cnsHandleFor(sd);
+    if (handle) {
       TypedValue& tv =
-        Transl::TargetCache::handleToRef<TypedValue>(it->second);
+        Transl::TargetCache::handleToRef<TypedValue>(handle);
       if (tv.m_type != KindOfUninit) {
-        StrNR key(const_cast<StringData*>(it->first));
+        StrNR key(sd);
         a.set(key, tvAsVariant(&tv), true);
       } else if (tv.m_data.pref) {
-        StrNR key(const_cast<StringData*>(it->first));
+        StrNR key(sd);
         ClassInfo::ConstantInfo* ci =
           (ClassInfo::ConstantInfo*)(void*)tv.m_data.pref;
         a.set(key, ci->getDeferredValue(), true);
@@ -341,6 +456,27 @@ char* smart_concat(const char* s1, uint32_t len1, const char* s2, uint32_t len2)
   return s;
 }
 
+// Capacity for a buffer that an append has outgrown.  Leaving slack means
+// a loop of appends (e.g. .= building a page) copies O(N) bytes in total
+// instead of O(N^2).
+static inline uint32_t appendCapacity(uint32_t newlen) {
+  uint32_t cap = newlen + (newlen >> 2);
+  return cap < StringData::MaxSize ? cap : StringData::MaxSize;
+}
+
+// smart_concat into a buffer of appendCapacity(len1 + len2) bytes.
+static char* smart_concat_grow(const char* s1, uint32_t len1,
+                               const char* s2, uint32_t len2,
+                               uint32_t& cap) {
+  uint32_t len = len1 + len2;
+  cap = appendCapacity(len);
+  char* s = (char*)smart_malloc(cap + 1);
+  memcpy(s, s1, len1);
+  memcpy(s + len1, s2, len2);
+  s[len] = 0;
+  return s;
+}
+
 void StringData::initConcat(StringSlice r1, StringSlice r2) {
   m_hash = 0;
   _count = 0;
@@ -394,25 +530,25 @@ void StringData::append(const char *s, int len) {
                               size_t(len) + size_t(m_len));
   }
   uint32_t newlen = m_len + len;
-  // TODO: t1122987: in any of the cases below where we need a bigger buffer,
-  // we can probably assume we're in a concat-loop and pick a good buffer
-  // size to avoid O(N^2) copying cost.
+  // Whenever we need a bigger buffer, assume we're in a concat loop and
+  // take appendCapacity(newlen) bytes, so repeated appends amortize.
+  uint32_t cap;
   if (isShared() || isLiteral()) {
     // buffer is immutable, don't modify it.
     StringSlice r = slice();
-    char* newdata = smart_concat(r.ptr, r.len, s, len);
+    char* newdata = smart_concat_grow(r.ptr, r.len, s, len, cap);
     m_len = newlen;
     m_data = newdata;
-    m_big.cap = newlen | IsSmart;
+    m_big.cap = cap | IsSmart;
     m_hash = 0;
   } else if (rawdata() == s) {
     // appending ourself to ourself, be conservative.
     StringSlice r = slice();
-    char *newdata = smart_concat(r.ptr, r.len, s, len);
+    char *newdata = smart_concat_grow(r.ptr, r.len, s, len, cap);
     releaseData();
     m_len = newlen;
     m_data = newdata;
-    m_big.cap = newlen | IsSmart;
+    m_big.cap = cap | IsSmart;
     m_hash = 0;
   } else if (isSmall()) {
     // we're currently small but might not be after append.
@@ -428,10 +564,10 @@ void StringData::append(const char *s, int len) {
       m_hash = 0;
     } else {
       // small->big string transition.
-      char *newdata = smart_concat(m_small, oldlen, s, len);
+      char *newdata = smart_concat_grow(m_small, oldlen, s, len, cap);
       m_len = newlen;
       m_data = newdata;
-      m_big.cap = newlen | IsSmart;
+      m_big.cap = cap | IsSmart;
       m_hash = 0;
     }
   } else if (format() == IsSmart) {
@@ -445,9 +581,9 @@ void StringData::append(const char *s, int len) {
     if ((int)newlen <= capacity()) {
       newdata = oldp;
     } else {
-      uint32_t nlen = newlen + (newlen >> 2);
-      newdata = (char*) smart_realloc(oldp, nlen + 1);
-      m_big.cap = nlen | IsSmart;
+      cap = appendCapacity(newlen);
+      newdata = (char*) smart_realloc(oldp, cap + 1);
+      m_big.cap = cap | IsSmart;
     }
     memcpy(newdata + oldlen, s, len);
     newdata[newlen] = 0;
@@ -461,12 +597,18 @@ void StringData::append(const char *s, int len) {
     assert((oldp > s && oldp - s > len) ||
            (oldp < s && s - oldp > oldlen)); // no overlapping
     newlen = oldlen + len;
-    char* newdata = (char*) realloc(oldp, newlen + 1);
+    char* newdata;
+    if ((int)newlen <= capacity()) {
+      newdata = oldp;
+    } else {
+      cap = appendCapacity(newlen);
+      newdata = (char*) realloc(oldp, cap + 1);
+      m_big.cap = cap | IsMalloc;
+    }
     memcpy(newdata + oldlen, s, len);
     newdata[newlen] = 0;
     m_len = newlen;
     m_data = newdata;
-    m_big.cap = newlen | IsMalloc;
     m_hash = 0;
   }
   assert(newlen <= MaxSize);
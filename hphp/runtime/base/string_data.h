@@ -338,6 +338,14 @@ public:
    * and if so, return it. Else, return nullptr. */
   static StringData *LookupStaticString(const StringData* str);
   static size_t GetStaticStringCount();
+  struct StaticStringStats {
+    size_t count;
+    size_t capacity;
+    size_t resizes;
+    size_t maxProbe;
+    size_t retiredBytes; // superseded tables, which are never freed
+  };
+  static StaticStringStats GetStaticStringStats();
   static uint32_t GetCnsHandle(const StringData* cnsName);
   static uint32_t DefCnsHandle(const StringData* cnsName, bool persistent);
   static Array GetConstants();
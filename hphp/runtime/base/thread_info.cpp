@@ -188,6 +188,16 @@ void RequestInjectionData::clearInterceptFlag() {
                        ~RequestInjectionData::InterceptFlag);
 }
 
+void RequestInjectionData::setHeapProfileFlag() {
+  __sync_fetch_and_or(getConditionFlags(),
+                      RequestInjectionData::HeapProfileFlag);
+}
+
+void RequestInjectionData::setCollectCyclesFlag() {
+  __sync_fetch_and_or(getConditionFlags(),
+                      RequestInjectionData::CollectCyclesFlag);
+}
+
 ssize_t RequestInjectionData::fetchAndClearFlags() {
   return __sync_fetch_and_and(getConditionFlags(),
                               (RequestInjectionData::EventHookFlag |
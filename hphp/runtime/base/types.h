@@ -204,7 +204,9 @@ public:
   static const ssize_t EventHookFlag        = 1 << 3;
   static const ssize_t PendingExceptionFlag = 1 << 4;
   static const ssize_t InterceptFlag        = 1 << 5;
-  static const ssize_t LastFlag             = InterceptFlag;
+  static const ssize_t HeapProfileFlag      = 1 << 6;
+  static const ssize_t CollectCyclesFlag    = 1 << 7;
+  static const ssize_t LastFlag             = CollectCyclesFlag;
 
   RequestInjectionData()
     : cflagsPtr(nullptr), surprisePage(nullptr), started(0), timeoutSeconds(-1),
@@ -269,6 +271,8 @@ public:
   void clearPendingExceptionFlag();
   void setInterceptFlag();
   void clearInterceptFlag();
+  void setHeapProfileFlag();
+  void setCollectCyclesFlag();
   ssize_t fetchAndClearFlags();
 
   void onSessionInit();
@@ -515,6 +515,17 @@ std::string gc_collect_cycles() {
   return ret;
 }
 
+void gc_collect_cycles_near_limit() {
+  TRACE(1, "GC: heap near memory limit\n");
+
+  GCState state;
+  collect_algorithm<GarbageCollector>(state);
+  MemoryManager::TheMemoryManager()->scheduleCollection();
+
+  TRACE(1, "GC: released %" PRIu64 "/%" PRIu64 " objects\n",
+        state.m_collectedCount, state.m_totalCount);
+}
+
 void gc_detect_cycles(const std::string& filename) {
   TRACE(1, "GC: starting gc_detect_cycles\n");
 
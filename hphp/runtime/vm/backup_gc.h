@@ -32,6 +32,19 @@ namespace HPHP {
  */
 std::string gc_collect_cycles();
 
+/*
+ * Collect cyclic garbage because the request heap has grown past
+ * Eval.GCTriggerPct of its memory limit, then schedule the next
+ * automatic collection.
+ *
+ * Trial deletion doesn't need to find the roots: whatever part of a
+ * count it can't account for from inside the smart heap keeps the
+ * object alive.  It does need every pointer to a heap value to be
+ * counted, so this only runs from surprise checks, between bytecodes,
+ * where no helper is holding a borrowed pointer into the heap.
+ */
+void gc_collect_cycles_near_limit();
+
 /*
  * Detect cyclic garbage and dump it as GML to filename.  Intended to
  * allow introspection of the user heap so application-level code can
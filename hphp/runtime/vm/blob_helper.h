@@ -166,6 +166,21 @@ struct BlobEncoder {
     encodeContainer(set, "set");
   }
 
+  /*
+   * Raw bytes, which BlobDecoder::decodeBytes hands back in place.
+   */
+  void encodeBytes(const void* vp, size_t sz) {
+    if (sz >= 0xffffffffu) {
+      throw std::runtime_error("maximum byte string size exceeded in "
+                               "BlobEncoder");
+    }
+    encode(uint32_t(sz));
+    const size_t start = m_blob.size();
+    m_blob.resize(start + sz);
+    const unsigned char* pc = static_cast<const unsigned char*>(vp);
+    std::copy(pc, pc + sz, m_blob.begin() + start);
+  }
+
   template<class T>
   BlobEncoder& operator()(const T& t) {
     encode(t);
@@ -234,8 +249,16 @@ struct BlobDecoder {
   }
 
   void decode(const StringData*& sd) {
-    String s(decodeString());
-    sd = s.get() ? StringData::GetStaticString(s) : 0;
+    // Static strings get copied anyway, so skip the temporary String.
+    uint32_t sz;
+    decode(sz);
+    if (sz == uint32_t(-1)) {
+      sd = 0;
+      return;
+    }
+    assert(m_last - m_p >= sz);
+    sd = StringData::GetStaticString(reinterpret_cast<const char*>(m_p), sz);
+    m_p += sz;
   }
 
   void decode(TypedValue& tv) {
@@ -287,6 +310,20 @@ struct BlobDecoder {
     }
   }
 
+  /*
+   * Bytes written by BlobEncoder::encodeBytes.  Points into the blob,
+   * so it is only valid as long as the blob is.
+   */
+  const void* decodeBytes(size_t& sz) {
+    uint32_t sz32;
+    decode(sz32);
+    assert(m_last - m_p >= sz32);
+    const void* ret = m_p;
+    m_p += sz32;
+    sz = sz32;
+    return ret;
+  }
+
   template<class T>
   BlobDecoder& operator()(T& t) {
     decode(t);
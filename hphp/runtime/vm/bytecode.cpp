@@ -2535,19 +2535,35 @@ void VMExecutionContext::enqueueSharedVar(SharedVariant* svar) {
   m_freedSvars.push_back(svar);
 }
 
+/*
+ * Like Treadmill::deferredFree, but the memory is handed to the treadmill
+ * with everything else this request freed, in one work item at request
+ * exit, rather than taking the treadmill's lock once per pointer.
+ */
+void VMExecutionContext::enqueueFree(void* p) {
+  m_freedMemory.push_back(p);
+}
+
 class FreedSVars : public Treadmill::WorkItem {
   SVarVector m_svars;
+  std::vector<void*> m_memory;
 public:
-  explicit FreedSVars(SVarVector&& svars) : m_svars(std::move(svars)) {}
+  FreedSVars(SVarVector&& svars, std::vector<void*>&& memory)
+    : m_svars(std::move(svars)), m_memory(std::move(memory)) {}
   virtual void operator()() {
     for (auto it = m_svars.begin(); it != m_svars.end(); it++) {
       delete *it;
     }
+    for (auto it = m_memory.begin(); it != m_memory.end(); it++) {
+      free(*it);
+    }
   }
 };
 
 void VMExecutionContext::treadmillSharedVars() {
-  Treadmill::WorkItem::enqueue(new FreedSVars(std::move(m_freedSvars)));
+  if (m_freedSvars.empty() && m_freedMemory.empty()) return;
+  Treadmill::WorkItem::enqueue(new FreedSVars(std::move(m_freedSvars),
+                                              std::move(m_freedMemory)));
 }
 
 void VMExecutionContext::destructObjects() {
@@ -3691,12 +3707,16 @@ inline void OPTBLD_INLINE VMExecutionContext::iopConcat(PC& pc) {
   Cell* c1 = m_stack.topC();
   Cell* c2 = m_stack.indC(1);
   if (IS_STRING_TYPE(c1->m_type) && IS_STRING_TYPE(c2->m_type)) {
-    tvCellAsVariant(c2) = concat(
-      tvCellAsVariant(c2).toString(), tvCellAsCVarRef(c1).toString());
-  } else {
-    tvCellAsVariant(c2) = concat(tvCellAsVariant(c2).toString(),
-                                 tvCellAsCVarRef(c1).toString());
+    // concat_ss consumes both references and appends in place when c2
+    // holds the only one, so a chain of concats doesn't recopy its prefix.
+    c2->m_data.pstr = concat_ss(c2->m_data.pstr, c1->m_data.pstr);
+    c2->m_type = KindOfString;
+    assert(c2->m_data.pstr->getCount() > 0);
+    m_stack.discard();
+    return;
   }
+  tvCellAsVariant(c2) = concat(tvCellAsVariant(c2).toString(),
+                               tvCellAsCVarRef(c1).toString());
   assert(c2->m_data.pstr->getCount() > 0);
   m_stack.popC();
 }
@@ -4094,6 +4114,105 @@ inline void OPTBLD_INLINE VMExecutionContext::iopJmpNZ(PC& pc) {
   JMPOP(!=, toBoolean);
 }
 
+/*
+ * Superinstructions.
+ *
+ * dispatch() runs a few common pairs of instructions as one, skipping
+ * a trip through the dispatch loop and the push and pop of the value
+ * passed from one to the other:
+ *
+ *   SetL; PopC            moves the value into the local
+ *   <compare>; JmpZ/JmpNZ branches on the result without pushing it
+ *
+ * The bytecode itself is never rewritten, so the JIT, the verifier and
+ * the debugger all still see the original instructions; pairs are
+ * recognized when they are reached, and only by dispatch loops that
+ * don't need to observe each instruction (see dispatchImpl).
+ */
+bool OPTBLD_INLINE VMExecutionContext::fuseSetLPopC(PC& pc) {
+  PC next = pc + 1;
+  Id local = decodeVariableSizeImm(&next);
+  if (toOp(*next) != OpPopC) return false;
+  assert(local < m_fp->m_func->numLocals());
+  Cell* fr = m_stack.topC();
+  TypedValue* to = tvToCell(frame_local(m_fp, local));
+  DataType oldType = to->m_type;
+  uint64_t oldDatum = to->m_data.num;
+  tvTeleport(fr, to);
+  m_stack.discard();
+  pc = next + 1;
+  tvRefcountedDecRefHelper(oldType, oldDatum);
+  return true;
+}
+
+template<class Cmp>
+bool OPTBLD_INLINE VMExecutionContext::fuseCmpJmp(PC& pc, Cmp cmp) {
+  Op next = toOp(pc[1]);
+  if (next != OpJmpZ && next != OpJmpNZ) return false;
+  auto const c1 = m_stack.topC();
+  auto const c2 = m_stack.indC(1);
+  bool const result = cmp(c2, c1);
+  tvRefcountedDecRefCell(c2);
+  m_stack.popC();
+  m_stack.discard();
+  pc += 1;
+  if (result == (next == OpJmpNZ)) {
+    NEXT();
+    DECODE_JMP(Offset, offset);
+    JMP_SURPRISE_CHECK();
+    pc += offset - 1;
+  } else {
+    pc += 1 + sizeof(Offset);
+  }
+  return true;
+}
+
+static inline bool isFusable(Op op) {
+  switch (op) {
+    case OpSetL:
+    case OpSame: case OpNSame: case OpEq: case OpNeq:
+    case OpLt: case OpLte: case OpGt: case OpGte:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*
+ * Run the instruction at pc together with the one after it, if they
+ * make up a superinstruction.  Returns false, having done nothing,
+ * otherwise.
+ */
+bool OPTBLD_INLINE VMExecutionContext::tryFuse(PC& pc) {
+  switch (toOp(*pc)) {
+    case OpSetL:  return fuseSetLPopC(pc);
+    case OpSame:  return fuseCmpJmp(pc, cellSame);
+    case OpNSame:
+      return fuseCmpJmp(pc, [&] (const Cell* c1, const Cell* c2) {
+        return !cellSame(c1, c2);
+      });
+    case OpEq:
+      return fuseCmpJmp(pc, [&] (const Cell* c1, const Cell* c2) {
+        return cellEqual(c1, c2);
+      });
+    case OpNeq:
+      return fuseCmpJmp(pc, [&] (const Cell* c1, const Cell* c2) {
+        return !cellEqual(c1, c2);
+      });
+    case OpLt:
+      return fuseCmpJmp(pc, [&] (const Cell* c1, const Cell* c2) {
+        return cellLess(c1, c2);
+      });
+    case OpLte:   return fuseCmpJmp(pc, cellLessOrEqual);
+    case OpGt:
+      return fuseCmpJmp(pc, [&] (const Cell* c1, const Cell* c2) {
+        return cellGreater(c1, c2);
+      });
+    case OpGte:   return fuseCmpJmp(pc, cellGreaterOrEqual);
+    default:      return false;
+  }
+}
+
 #undef JMPOP
 #undef JMP_SURPRISE_CHECK
 
@@ -7127,6 +7246,11 @@ OPCODES
 
 static inline void
 profileReturnValue(const DataType dt) {
+  const ActRec* fp = curFrame();
+  const ActRec* sfp = fp->arGetSfp();
+  if (sfp != fp) {
+    recordInstrType(sfp->m_func, sfp->m_func->base() + fp->m_soff, dt);
+  }
   const Func* f = curFunc();
   if (f->isPseudoMain() || f->isClosureBody() || f->isMagic() ||
       Func::isSpecial(f->name()))
@@ -7134,11 +7258,44 @@ profileReturnValue(const DataType dt) {
   recordType(TypeProfileKey(TypeProfileKey::MethodName, f->name()), dt);
 }
 
+/*
+ * Record the per-instruction profile for the instruction at origPc in
+ * func, which has just executed and left us at pc.
+ */
+static inline void
+profileInstr(const Func* func, PC origPc, PC pc) {
+  const Op op = toOp(*origPc);
+  const Offset off = func->unit()->offsetOf(origPc);
+  const bool fellThrough = pc == origPc + instrLen((Op*)origPc);
+  switch (op) {
+    case OpJmpZ:
+    case OpJmpNZ:
+      recordBranch(func, off, !fellThrough);
+      break;
+    case OpFCall:
+    case OpFCallArray:
+      if (!fellThrough) {
+        recordCallTarget(func, off, curFunc());
+      }
+      break;
+    case OpCGetM:
+    case OpCGetS:
+    case OpFCallBuiltin:
+      recordInstrType(func, off, vmsp()->m_type);
+      break;
+    default:
+      break;
+  }
+}
+
 template <int dispatchFlags>
 inline void VMExecutionContext::dispatchImpl(int numInstrs) {
   static const bool limInstrs = dispatchFlags & LimitInstrs;
   static const bool breakOnCtlFlow = dispatchFlags & BreakOnCtlFlow;
   static const bool profile = dispatchFlags & Profile;
+  // Superinstructions execute two instructions at a time, which
+  // nothing stepping, limiting or profiling instructions can allow.
+  static const bool canFuse = !limInstrs && !breakOnCtlFlow && !profile;
   static const void *optabDirect[] = {
 #define O(name, imm, push, pop, flags) \
     &&Label##name,
@@ -7166,6 +7323,8 @@ inline void VMExecutionContext::dispatchImpl(int numInstrs) {
     optab = optabCover;
   }
   DEBUGGER_ATTACHED_ONLY(optab = optabDbg);
+  const bool fuse = canFuse && optab == optabDirect &&
+    RuntimeOption::EvalInterpFuseOps;
   /*
    * Trace-only mapping of opcodes to names.
    */
@@ -7211,8 +7370,15 @@ inline void VMExecutionContext::dispatchImpl(int numInstrs) {
       recordCodeCoverage(pc);                                 \
     }                                                         \
   Label##name: {                                              \
+    if (fuse && isFusable(Op::name) && tryFuse(pc)) {         \
+      SYNC();                                                 \
+      DISPATCH();                                             \
+    }                                                         \
+    const PC origPc = pc;                                     \
+    const Func* const origFunc = profile ? m_fp->m_func : 0;  \
     iop##name(pc);                                            \
     SYNC();                                                   \
+    if (profile && pc) profileInstr(origFunc, origPc, pc);    \
     if (breakOnCtlFlow) {                                     \
       isCtlFlow = instrIsControlFlow(Op::name);               \
       Stats::incOp(Op::name);                                 \
@@ -424,6 +424,9 @@ template<class SerDe> void PreClassEmitter::serdeMetaData(SerDe& sd) {
     ;
 }
 
+// Also used when loading units out of a RepoImage.
+template void PreClassEmitter::serdeMetaData<>(BlobDecoder&);
+
 //=============================================================================
 // PreClassRepoProxy.
 
@@ -120,6 +120,14 @@ void DebugInfo::recordTracelet(TCRange range, const Func* func,
   }
 }
 
+void DebugInfo::forgetRange(TCRange range) {
+  if (range.isAstubs()) {
+    m_astubsDwarfInfo.forgetRange(range);
+  } else {
+    m_aDwarfInfo.forgetRange(range);
+  }
+}
+
 void DebugInfo::debugSync() {
   m_aDwarfInfo.syncChunks();
   m_astubsDwarfInfo.syncChunks();
@@ -38,6 +38,7 @@ class DebugInfo {
   void recordPerfMap(TCRange range, const Func* func, bool exit,
                      bool inPrologue);
   void recordBCInstr(TCRange range, uint32_t op);
+  void forgetRange(TCRange range);
 
   void debugSync();
   static DebugInfo* Get();
@@ -14,6 +14,7 @@
    +----------------------------------------------------------------------+
 */
 #include <stdio.h>
+#include <algorithm>
 #include "hphp/runtime/vm/debug/dwarf.h"
 #include "debug.h"
 #include "hphp/runtime/vm/debug/elfwriter.h"
@@ -289,12 +290,40 @@ DwarfChunk* DwarfInfo::addTracelet(TCRange range, const char* name,
   return f->m_chunk;
 }
 
+/*
+ * Drop the functions overlapping range, whose code is about to be
+ * reused.  A function that addTracelet merged with neighbouring code
+ * goes as a whole.  The chunks they were in get rewritten by the next
+ * syncChunks().
+ */
+void DwarfInfo::forgetRange(TCRange range) {
+  Lock lock(s_lock);
+  // m_functions is keyed by the end of each function's range.
+  FuncDB::iterator it = m_functions.upper_bound(range.begin());
+  while (it != m_functions.end() &&
+         it->second->range.begin() < range.end()) {
+    FunctionInfo* f = it->second;
+    if (DwarfChunk* chunk = f->m_chunk) {
+      vector<FunctionInfo*>& funcs = chunk->m_functions;
+      funcs.erase(std::find(funcs.begin(), funcs.end(), f));
+      chunk->clearSynced();
+    }
+    m_functions.erase(it++);
+    delete f;
+  }
+}
+
 void DwarfInfo::syncChunks() {
   unsigned int i;
   Lock lock(s_lock);
   for (i = 0; i < m_dwarfChunks.size(); i++) {
     if (m_dwarfChunks[i] && !m_dwarfChunks[i]->isSynced()) {
       unregister_gdb_chunk(m_dwarfChunks[i]);
+      if (m_dwarfChunks[i]->m_functions.empty()) {
+        // Everything in it was dropped by forgetRange().
+        m_dwarfChunks[i]->setSynced();
+        continue;
+      }
       ElfWriter e = ElfWriter(m_dwarfChunks[i]);
     }
   }
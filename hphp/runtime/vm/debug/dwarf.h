@@ -179,6 +179,7 @@ struct DwarfInfo {
   DwarfChunk* addTracelet(TCRange range, const char* name,
 			  const Func* func, const Opcode *instr,
 			  bool exit, bool inPrologue);
+  void forgetRange(TCRange range);
   void syncChunks();
 };
 
@@ -17,6 +17,8 @@
 #include "hphp/runtime/vm/event_hook.h"
 #include "hphp/runtime/base/types.h"
 #include "hphp/runtime/vm/func.h"
+#include "hphp/runtime/vm/backup_gc.h"
+#include "hphp/runtime/vm/heap_profiler.h"
 #include "hphp/runtime/vm/jit/translator-inline.h"
 #include "hphp/runtime/base/builtin_functions.h"
 #include "hphp/runtime/base/complex_types.h"
@@ -50,7 +52,14 @@ void EventHook::DisableIntercept() {
 
 ssize_t EventHook::CheckSurprise() {
   ThreadInfo* info = ThreadInfo::s_threadInfo.getNoCheck();
-  return check_request_surprise(info);
+  ssize_t flags = check_request_surprise(info);
+  if (flags & RequestInjectionData::HeapProfileFlag) {
+    HeapProfiler::RecordSample();
+  }
+  if (flags & RequestInjectionData::CollectCyclesFlag) {
+    gc_collect_cycles_near_limit();
+  }
+  return flags;
 }
 
 class ExecutingSetprofileCallbackGuard {
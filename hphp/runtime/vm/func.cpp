@@ -15,6 +15,7 @@
 */
 #include "hphp/runtime/vm/func.h"
 
+#include <sched.h>
 #include <iostream>
 #include <boost/scoped_ptr.hpp>
 
@@ -303,7 +304,7 @@ int Func::numSlotsInFrame() const {
 }
 
 bool Func::checkIterScope(Offset o, Id iterId, bool& itRef) const {
-  const EHEntVec& ehtab = shared()->m_ehtab;
+  const EHEntVec& ehtab = this->ehtab();
   assert(o >= base() && o < past());
   for (unsigned i = 0, n = ehtab.size(); i < n; i++) {
     const EHEnt* eh = &ehtab[i];
@@ -322,7 +323,7 @@ const EHEnt* Func::findEH(Offset o) const {
   const EHEnt* eh = nullptr;
   unsigned int i;
 
-  const EHEntVec& ehtab = shared()->m_ehtab;
+  const EHEntVec& ehtab = this->ehtab();
   for (i = 0; i < ehtab.size(); i++) {
     if (ehtab[i].m_base <= o && o < ehtab[i].m_past) {
       eh = &ehtab[i];
@@ -336,7 +337,7 @@ const FPIEnt* Func::findFPI(Offset o) const {
   const FPIEnt* fe = nullptr;
   unsigned int i;
 
-  const FPIEntVec& fpitab = shared()->m_fpitab;
+  const FPIEntVec& fpitab = this->fpitab();
   for (i = 0; i < fpitab.size(); i++) {
     /*
      * We consider the "FCall" instruction part of the FPI region, but
@@ -353,7 +354,7 @@ const FPIEnt* Func::findFPI(Offset o) const {
 
 const FPIEnt* Func::findPrecedingFPI(Offset o) const {
   assert(o >= base() && o < past());
-  const FPIEntVec& fpitab = shared()->m_fpitab;
+  const FPIEntVec& fpitab = this->fpitab();
   assert(fpitab.size());
   const FPIEnt* fe = &fpitab[0];
   unsigned int i;
@@ -488,7 +489,7 @@ void Func::prettyPrint(std::ostream& out) const {
       out << std::endl;
     }
   }
-  const EHEntVec& ehtab = shared()->m_ehtab;
+  const EHEntVec& ehtab = this->ehtab();
   for (EHEntVec::const_iterator it = ehtab.begin(); it != ehtab.end(); ++it) {
     bool catcher = it->m_type == EHEnt::Type::Catch;
     out << " EH " << (catcher ? "Catch" : "Fault") << " for " <<
@@ -644,7 +645,8 @@ Func::SharedData::SharedData(PreClass* preClass, Id id,
     m_numLocals(0), m_numIterators(0),
     m_past(past), m_line1(line1), m_line2(line2),
     m_info(nullptr), m_refBitPtr(0), m_builtinFuncPtr(nullptr),
-    m_docComment(docComment), m_top(top), m_isClosureBody(false),
+    m_bodyState(BodyLoaded), m_docComment(docComment), m_top(top),
+    m_isClosureBody(false),
     m_isGenerator(false), m_isGeneratorFromClosure(false),
     m_hasGeneratorAsBody(false), m_isGenerated(false),
     m_originalFilename(nullptr) {
@@ -854,45 +856,86 @@ struct EHEntComp {
   }
 };
 
-}
-
-void FuncEmitter::sortEHTab() {
-  std::sort(m_ehtab.begin(), m_ehtab.end(), EHEntComp());
+void sortEHEnts(std::vector<EHEnt>& ehtab) {
+  std::sort(ehtab.begin(), ehtab.end(), EHEntComp());
 
-  for (unsigned int i = 0; i < m_ehtab.size(); i++) {
-    m_ehtab[i].m_parentIndex = -1;
+  for (unsigned int i = 0; i < ehtab.size(); i++) {
+    ehtab[i].m_parentIndex = -1;
     for (int j = i - 1; j >= 0; j--) {
-      if (m_ehtab[j].m_past >= m_ehtab[i].m_past) {
+      if (ehtab[j].m_past >= ehtab[i].m_past) {
         // parent EHEnt better enclose this one.
-        assert(m_ehtab[j].m_base <= m_ehtab[i].m_base);
-        m_ehtab[i].m_parentIndex = j;
+        assert(ehtab[j].m_base <= ehtab[i].m_base);
+        ehtab[i].m_parentIndex = j;
         break;
       }
     }
   }
 }
 
-void FuncEmitter::sortFPITab(bool load) {
-  // Sort it and fill in parent info
-  std::sort(m_fpitab.begin(), m_fpitab.end(), FPIEntComp());
-  for (unsigned int i = 0; i < m_fpitab.size(); i++) {
-    m_fpitab[i].m_parentIndex = -1;
-    m_fpitab[i].m_fpiDepth = 1;
+/*
+ * Sort the FPI table and fill in parent info.  Unless the table was
+ * loaded from the repo (in which case it was already done before it
+ * was saved), also add the space taken up by locals, iterators and
+ * the AR itself to m_fpOff, which doesn't include it when emitted.
+ */
+void sortFPIEnts(std::vector<FPIEnt>& fpitab, bool load,
+                 Id numLocals, Id numIterators) {
+  std::sort(fpitab.begin(), fpitab.end(), FPIEntComp());
+  for (unsigned int i = 0; i < fpitab.size(); i++) {
+    fpitab[i].m_parentIndex = -1;
+    fpitab[i].m_fpiDepth = 1;
     for (int j = i - 1; j >= 0; j--) {
-      if (m_fpitab[j].m_fcallOff > m_fpitab[i].m_fcallOff) {
-        m_fpitab[i].m_parentIndex = j;
-        m_fpitab[i].m_fpiDepth = m_fpitab[j].m_fpiDepth + 1;
+      if (fpitab[j].m_fcallOff > fpitab[i].m_fcallOff) {
+        fpitab[i].m_parentIndex = j;
+        fpitab[i].m_fpiDepth = fpitab[j].m_fpiDepth + 1;
         break;
       }
     }
     if (!load) {
-      // m_fpOff does not include the space taken up by locals, iterators and
-      // the AR itself. Fix it here.
-      m_fpitab[i].m_fpOff += m_numLocals
-        + m_numIterators * kNumIterCells
-        + (m_fpitab[i].m_fpiDepth) * kNumActRecCells;
+      fpitab[i].m_fpOff += numLocals
+        + numIterators * kNumIterCells
+        + (fpitab[i].m_fpiDepth) * kNumActRecCells;
+    }
+  }
+}
+
+}
+
+/*
+ * The first caller to move the func from BodyEncoded to BodyDecoding
+ * decodes; anyone else who needs the tables meanwhile waits for it.
+ * Decoding is short, so they just yield rather than block.
+ */
+void Func::decodeBody() const {
+  SharedData* sd = const_cast<SharedData*>(shared());
+  uint8_t state = BodyEncoded;
+  if (!sd->m_bodyState.compare_exchange_strong(state, BodyDecoding,
+                                               std::memory_order_acquire)) {
+    while (sd->m_bodyState.load(std::memory_order_acquire) != BodyLoaded) {
+      sched_yield();
     }
+    return;
   }
+
+  std::vector<EHEnt> ehtab;
+  std::vector<FPIEnt> fpitab;
+  BlobDecoder(sd->m_lazyBody->data(), sd->m_lazyBody->size())
+    (ehtab)(fpitab);
+  sortEHEnts(ehtab);
+  sortFPIEnts(fpitab, true, sd->m_numLocals, sd->m_numIterators);
+  sd->m_ehtab = ehtab;
+  sd->m_fpitab = fpitab;
+  sd->m_lazyBody.reset();
+  TRACE(2, "decoded EH/FPI tables of %s\n", fullName()->data());
+  sd->m_bodyState.store(BodyLoaded, std::memory_order_release);
+}
+
+void FuncEmitter::sortEHTab() {
+  sortEHEnts(m_ehtab);
+}
+
+void FuncEmitter::sortFPITab(bool load) {
+  sortFPIEnts(m_fpitab, load, m_numLocals, m_numIterators);
 }
 
 void FuncEmitter::addUserAttribute(const StringData* name, TypedValue tv) {
@@ -966,8 +1009,14 @@ Func* FuncEmitter::create(Unit& unit, PreClass* preClass /* = NULL */) const {
   f->m_maxStackCells = m_maxStackCells;
   assert(m_maxStackCells > 0 && "You probably didn't set m_maxStackCells");
   f->shared()->m_staticVars = m_staticVars;
-  f->shared()->m_ehtab = m_ehtab;
-  f->shared()->m_fpitab = m_fpitab;
+  if (m_lazyBody.empty()) {
+    f->shared()->m_ehtab = m_ehtab;
+    f->shared()->m_fpitab = m_fpitab;
+  } else {
+    f->shared()->m_lazyBody.reset(new std::string(m_lazyBody));
+    f->shared()->m_bodyState.store(Func::BodyEncoded,
+                                   std::memory_order_relaxed);
+  }
   f->shared()->m_isClosureBody = m_isClosureBody;
   f->shared()->m_isGenerator = m_isGenerator;
   f->shared()->m_isGeneratorFromClosure = m_isGeneratorFromClosure;
@@ -1062,14 +1111,37 @@ void FuncEmitter::serdeMetaData(SerDe& sd) {
     (m_params)
     (m_localNames)
     (m_staticVars)
-    (m_ehtab)
-    (m_fpitab)
-    (m_userAttributes)
+    ;
+  serdeBody(sd);
+  sd(m_userAttributes)
     (m_retTypeConstraint)
     (m_originalFilename)
     ;
 }
 
+/*
+ * The EH and FPI tables are written as a nested blob, so that loading
+ * a func can hang on to them without decoding them.
+ */
+void FuncEmitter::serdeBody(BlobEncoder& sd) {
+  if (!m_lazyBody.empty()) {
+    sd.encodeBytes(m_lazyBody.data(), m_lazyBody.size());
+    return;
+  }
+  BlobEncoder body;
+  body(m_ehtab)(m_fpitab);
+  sd.encodeBytes(body.data(), body.size());
+}
+
+void FuncEmitter::serdeBody(BlobDecoder& sd) {
+  size_t len;
+  const void* bytes = sd.decodeBytes(len);
+  m_lazyBody.assign(static_cast<const char*>(bytes), len);
+}
+
+// Also used when loading units out of a RepoImage.
+template void FuncEmitter::serdeMetaData<>(BlobDecoder&);
+
 //=============================================================================
 // FuncRepoProxy.
 
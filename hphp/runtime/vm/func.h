@@ -17,6 +17,9 @@
 #ifndef incl_HPHP_VM_FUNC_H_
 #define incl_HPHP_VM_FUNC_H_
 
+#include <atomic>
+#include <memory>
+
 #include "hphp/runtime/vm/type_constraint.h"
 #include "hphp/runtime/vm/repo_helpers.h"
 #include "hphp/runtime/vm/indexed_string_map.h"
@@ -331,8 +334,8 @@ struct Func {
   }
 
   int numIterators() const { return shared()->m_numIterators; }
-  const EHEntVec& ehtab() const { return shared()->m_ehtab; }
-  const FPIEntVec& fpitab() const { return shared()->m_fpitab; }
+  const EHEntVec& ehtab() const { loadBody(); return shared()->m_ehtab; }
+  const FPIEntVec& fpitab() const { loadBody(); return shared()->m_fpitab; }
   Attr attrs() const { return m_attrs; }
   void setAttrs(Attr attrs) { m_attrs = attrs; }
   bool top() const { return shared()->m_top; }
@@ -470,6 +473,13 @@ private:
     ParamInfoVec m_params; // m_params[i] corresponds to parameter i.
     NamedLocalsMap m_localNames; // includes parameter names
     SVInfoVec m_staticVars;
+    // The EH and FPI tables of funcs loaded from the repo aren't needed
+    // until the func is run or translated, so they stay encoded in
+    // m_lazyBody until then, and m_lazyBody is freed once they're
+    // decoded.  m_bodyState is the func's own once-flag for that; see
+    // Func::loadBody.
+    std::atomic<uint8_t> m_bodyState;
+    std::unique_ptr<std::string> m_lazyBody;
     EHEntVec m_ehtab;
     FPIEntVec m_fpitab;
     const StringData* m_docComment;
@@ -498,6 +508,14 @@ private:
 
 private:
   void setFullName();
+  enum BodyState : uint8_t { BodyLoaded, BodyEncoded, BodyDecoding };
+  void loadBody() const {
+    if (UNLIKELY(shared()->m_bodyState.load(std::memory_order_acquire) !=
+                 BodyLoaded)) {
+      decodeBody();
+    }
+  }
+  void decodeBody() const;
   void init(int numParams, bool isGenerator);
   void initPrologues(int numParams, bool isGenerator);
   void appendParam(bool ref, const ParamInfo& info,
@@ -663,6 +681,8 @@ public:
 private:
   void sortEHTab();
   void sortFPITab(bool load);
+  void serdeBody(BlobEncoder& sd);
+  void serdeBody(BlobDecoder& sd);
 
   UnitEmitter& m_ue;
   PreClassEmitter* m_pce;
@@ -688,6 +708,9 @@ private:
 
   EHEntVec m_ehtab;
   FPIEntVec m_fpitab;
+  // Encoded m_ehtab and m_fpitab of a func loaded from the repo; they
+  // are only decoded by the Func when it first needs them.
+  std::string m_lazyBody;
 
   Attr m_attrs;
   DataType m_returnType;
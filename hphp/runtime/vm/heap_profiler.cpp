@@ -0,0 +1,149 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+#include "hphp/runtime/vm/heap_profiler.h"
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include "hphp/util/base.h"
+#include "hphp/util/lock.h"
+#include "hphp/util/mutex.h"
+#include "hphp/util/thread_local.h"
+#include "hphp/runtime/base/execution_context.h"
+#include "hphp/runtime/base/memory/memory_manager.h"
+#include "hphp/runtime/vm/func.h"
+#include "hphp/runtime/vm/unit.h"
+#include "hphp/runtime/vm/jit/translator-inline.h"
+
+namespace HPHP {
+
+//////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Sampled bytes, keyed by folded PHP stack.
+typedef hphp_string_map<int64_t> Profile;
+
+Mutex s_lock;
+Profile s_aggregate;
+Profile s_peakProfile;
+int64_t s_peakUsage;
+
+std::string currentStack() {
+  std::vector<const ActRec*> frames;
+  for (const ActRec* fp = g_vmContext->getFP(); fp;
+       fp = g_vmContext->getPrevVMState(fp)) {
+    frames.push_back(fp);
+  }
+  if (frames.empty()) return "{no PHP frames}";
+
+  std::string stack;
+  for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+    const Func* func = (*it)->m_func;
+    if (!stack.empty()) stack += ';';
+    if (func->isPseudoMain()) {
+      stack += "run_init::";
+      stack += func->unit()->filepath()->data();
+    } else {
+      stack += func->fullName()->data();
+    }
+  }
+  return stack;
+}
+
+std::string dump(const Profile& profile) {
+  std::vector<std::pair<int64_t, const std::string*>> lines;
+  lines.reserve(profile.size());
+  for (auto& entry : profile) {
+    lines.push_back(std::make_pair(entry.second, &entry.first));
+  }
+  std::sort(lines.begin(), lines.end(),
+            [](const std::pair<int64_t, const std::string*>& a,
+               const std::pair<int64_t, const std::string*>& b) {
+              return a.first > b.first;
+            });
+  std::ostringstream out;
+  for (auto& line : lines) {
+    out << *line.second << ' ' << line.first << '\n';
+  }
+  return out.str();
+}
+
+}
+
+// Samples for the request running on this thread.
+static IMPLEMENT_THREAD_LOCAL(Profile, s_requestProfile);
+
+void HeapProfiler::Enable(size_t sampleBytes) {
+  assert(sampleBytes);
+  MemoryManager::s_heapSampleBytes.store(sampleBytes,
+                                         std::memory_order_relaxed);
+}
+
+void HeapProfiler::Disable() {
+  MemoryManager::s_heapSampleBytes.store(0, std::memory_order_relaxed);
+}
+
+bool HeapProfiler::Enabled() {
+  return MemoryManager::s_heapSampleBytes.load(std::memory_order_relaxed);
+}
+
+void HeapProfiler::Clear() {
+  Lock lock(s_lock);
+  s_aggregate.clear();
+  s_peakProfile.clear();
+  s_peakUsage = 0;
+}
+
+void HeapProfiler::RecordSample() {
+  size_t bytes = MemoryManager::TheMemoryManager()->takeHeapSampledBytes();
+  if (!bytes) return;
+  Transl::VMRegAnchor _;
+  (*s_requestProfile)[currentStack()] += bytes;
+}
+
+void HeapProfiler::RequestExit(int64_t peakUsage) {
+  if (s_requestProfile.isNull() || s_requestProfile->empty()) return;
+  Profile& profile = *s_requestProfile;
+  {
+    Lock lock(s_lock);
+    for (auto& entry : profile) {
+      s_aggregate[entry.first] += entry.second;
+    }
+    if (peakUsage > s_peakUsage) {
+      s_peakUsage = peakUsage;
+      s_peakProfile.swap(profile);
+    }
+  }
+  profile.clear();
+}
+
+std::string HeapProfiler::DumpAggregate() {
+  Lock lock(s_lock);
+  return dump(s_aggregate);
+}
+
+std::string HeapProfiler::DumpPeakRequest() {
+  Lock lock(s_lock);
+  std::ostringstream out;
+  out << "# peak usage " << s_peakUsage << '\n' << dump(s_peakProfile);
+  return out.str();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+}
@@ -0,0 +1,67 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+#ifndef incl_HPHP_VM_HEAP_PROFILER_H_
+#define incl_HPHP_VM_HEAP_PROFILER_H_
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace HPHP {
+
+//////////////////////////////////////////////////////////////////////
+
+/*
+ * Sampling profile of which PHP code grows the request heap.
+ *
+ * While enabled, each thread's MemoryManager counts the bytes of fresh
+ * smart_malloc slabs, medium blocks and big blocks, and every sampleBytes
+ * of them it sets the HeapProfile surprise flag.  The next surprise check
+ * (a function entry or loop back-edge, where the VM registers can be
+ * synced) charges the sampled bytes to the PHP stack at that point.
+ *
+ * Profiles are reported as folded stacks ("main;foo;bar <bytes>" per
+ * line), which flame graph tools read directly: one aggregated over every
+ * request since the profiler was enabled, and one for the single request
+ * with the highest peak heap usage.
+ */
+struct HeapProfiler {
+  static void Enable(size_t sampleBytes);
+  static void Disable();
+  static void Clear();
+  static bool Enabled();
+
+  /*
+   * Charge this thread's sampled bytes to the current PHP stack.  Called
+   * from surprise checks.
+   */
+  static void RecordSample();
+
+  /*
+   * Fold the current request's samples into the aggregate profile.
+   * peakUsage is the request's peak smart heap usage.
+   */
+  static void RequestExit(int64_t peakUsage);
+
+  static std::string DumpAggregate();
+  static std::string DumpPeakRequest();
+};
+
+//////////////////////////////////////////////////////////////////////
+
+}
+
+#endif
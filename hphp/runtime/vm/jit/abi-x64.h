@@ -227,6 +227,13 @@ const int kNumServiceReqArgRegs =
    */ \
   REQ(RETRANSLATE) \
   \
+  /*
+   * Under EvalJitPGO, a function-entry profiling translation whose
+   * counter ran out requests that the function be retranslated as a
+   * single optimized region.
+   */ \
+  REQ(RETRANSLATE_OPT) \
+  \
   /*
    * If the max translations is reached for a SrcKey, the last
    * translation in the chain will jump to an interpret request stub.
@@ -47,6 +47,7 @@
 #include "hphp/runtime/vm/jit/linearscan.h"
 #include "hphp/runtime/vm/jit/nativecalls.h"
 #include "hphp/runtime/vm/jit/print.h"
+#include "hphp/runtime/vm/jit/prof-data.h"
 #include "hphp/runtime/vm/jit/layout.h"
 
 using HPHP::Transl::TCA;
@@ -790,7 +791,7 @@ void CodeGenerator::emitReqBindJcc(ConditionCode cc,
       patchAddr,
       uint64_t(extra->taken),
       uint64_t(extra->notTaken),
-      uint64_t(cc)
+      Transl::packJccFirstArg(cc, extra->source)
     );
   }
 
@@ -5344,6 +5345,29 @@ void CodeGenerator::cgIncTransCounter(IRInstruction* inst) {
   m_tx64->emitTransCounterInc(m_as);
 }
 
+void CodeGenerator::cgDecProfCounter(IRInstruction* inst) {
+  auto const transId = inst->extra<DecProfCounter>()->transId;
+  auto const counterAddr = m_tx64->profData()->transCounterAddr(transId);
+  // Racy; losing the occasional count is fine.
+  m_as.    movq   (counterAddr, rAsm);
+  m_as.    decq   (*rAsm);
+}
+
+void CodeGenerator::cgCheckCold(IRInstruction* inst) {
+  auto const transId = inst->extra<CheckCold>()->transId;
+  auto const counterAddr = m_tx64->profData()->transCounterAddr(transId);
+  auto const stub = m_tx64->emitServiceReq(
+    SRFlags::Persistent,
+    REQ_RETRANSLATE_OPT,
+    2ull,
+    uint64_t(m_curTrace->bcOff()),
+    uint64_t(transId)
+  );
+  m_as.    movq   (counterAddr, rAsm);
+  m_as.    decq   (*rAsm);
+  m_as.    jle    (stub);
+}
+
 void CodeGenerator::cgDbgAssertRefCount(IRInstruction* inst) {
   emitAssertRefCount(m_as, m_regs[inst->src(0)].reg());
 }
@@ -5427,6 +5451,7 @@ void CodeGenerator::cgBlock(Block* block, vector<TransBCMapping>* bcMap) {
               m_astubs.code.frontier});
       }
     }
+    if (m_tx64) m_tx64->checkFreeCodeRoom();
     m_curInst = inst;
     auto nuller = folly::makeGuard([&]{ m_curInst = nullptr; });
     auto* addr = cgInst(inst);
@@ -0,0 +1,127 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+#include "hphp/runtime/vm/jit/compile-queue.h"
+
+#include "hphp/runtime/base/program_functions.h"
+#include "hphp/runtime/base/runtime_option.h"
+#include "hphp/runtime/base/thread_init_fini.h"
+#include "hphp/runtime/vm/jit/translator-x64.h"
+#include "hphp/runtime/vm/treadmill.h"
+#include "hphp/util/job_queue.h"
+#include "hphp/util/logger.h"
+#include "hphp/util/trace.h"
+
+namespace HPHP { namespace Transl {
+
+TRACE_SET_MOD(pgo);
+
+//////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct CompileJob {
+  const Func* func;
+  TransID transId;
+};
+
+/*
+ * Translation allocates from the request heap and looks at the VM
+ * context, so each compiler thread keeps a session for its lifetime.
+ * Between jobs it holds nothing the Treadmill protects, so it only
+ * counts as an in-flight request while a job runs; otherwise an idle
+ * compiler thread would stop the Treadmill from ever firing.
+ */
+struct CompileWorker : JobQueueWorker<CompileJob> {
+  CompileWorker() : m_context(nullptr) {}
+
+  virtual void onThreadEnter() {
+    hphp_session_init();
+    m_context = hphp_context_init();
+    Treadmill::finishRequest(g_vmContext->m_currentThreadIdx);
+  }
+
+  virtual void doJob(CompileJob job) {
+    Treadmill::startRequest(g_vmContext->m_currentThreadIdx);
+    try {
+      TranslatorX64::Get()->retranslateOptWorker(job.func, job.transId);
+    } catch (const std::exception& e) {
+      Logger::Error("Optimized retranslation of %s failed: %s",
+                    job.func->fullName()->data(), e.what());
+    }
+    Treadmill::finishRequest(g_vmContext->m_currentThreadIdx);
+  }
+
+  virtual void onThreadExit() {
+    Treadmill::startRequest(g_vmContext->m_currentThreadIdx);
+    hphp_context_exit(m_context, false, false);
+    hphp_session_exit();
+  }
+
+private:
+  ExecutionContext* m_context;
+};
+
+JobQueueDispatcher<CompileJob, CompileWorker>* s_dispatcher;
+
+void compileQueueStart() {
+  if (!RuntimeOption::EvalJit || !RuntimeOption::EvalJitPGO ||
+      !RuntimeOption::RepoAuthoritative ||
+      RuntimeOption::EvalJitCompilerThreads == 0) {
+    return;
+  }
+  s_dispatcher = new JobQueueDispatcher<CompileJob, CompileWorker>(
+    RuntimeOption::EvalJitCompilerThreads,
+    false, // round robin
+    0,     // drop cache timeout
+    false, // drop stack
+    nullptr
+  );
+  s_dispatcher->start();
+  FTRACE(1, "started {} compiler threads\n",
+         RuntimeOption::EvalJitCompilerThreads);
+}
+
+void compileQueueStop() {
+  if (!s_dispatcher) return;
+  s_dispatcher->stop();
+  delete s_dispatcher;
+  s_dispatcher = nullptr;
+}
+
+InitFiniNode s_compileQueueInit(compileQueueStart,
+                                InitFiniNode::When::ProcessInit);
+InitFiniNode s_compileQueueExit(compileQueueStop,
+                                InitFiniNode::When::ProcessExit);
+
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool compileQueueEnabled() {
+  return s_dispatcher != nullptr;
+}
+
+bool enqueueRetranslateOpt(const Func* func, TransID transId) {
+  if (!s_dispatcher) return false;
+  FTRACE(1, "queueing optimized retranslation of {} ({})\n",
+         func->fullName()->data(), transId);
+  s_dispatcher->enqueue(CompileJob { func, transId });
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+}}
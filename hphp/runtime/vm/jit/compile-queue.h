@@ -0,0 +1,54 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+#ifndef incl_HPHP_JIT_COMPILE_QUEUE_H_
+#define incl_HPHP_JIT_COMPILE_QUEUE_H_
+
+#include "hphp/runtime/vm/jit/types.h"
+
+namespace HPHP {
+
+class Func;
+
+namespace Transl {
+
+/*
+ * Pool of compiler threads that perform optimized retranslations (see
+ * TranslatorX64::retranslateOpt) off the request path.
+ *
+ * Profiling translations are specialized on the types in the live
+ * frame, so request threads still produce those themselves.  The
+ * optimized region for a function only depends on the profile, so the
+ * request that notices a function is hot just queues it up here and
+ * keeps running the profiling code.  A compiler thread only holds the
+ * write lease while it picks the region and while it emits and
+ * publishes the code; building and optimizing the HHIR in between
+ * happens without it (see TranslatorX64::retranslateOptWorker).
+ *
+ * The pool is started at process init when EvalJitPGO is on and
+ * EvalJitCompilerThreads is nonzero, and only in RepoAuthoritative
+ * mode, where Funcs live forever.
+ */
+bool compileQueueEnabled();
+
+/*
+ * Queue an optimized retranslation of func, starting from profiling
+ * translation transId.  Returns false if there is no compiler pool.
+ */
+bool enqueueRetranslateOpt(const Func* func, TransID transId);
+
+}}
+
+#endif
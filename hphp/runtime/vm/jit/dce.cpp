@@ -231,12 +231,28 @@ initInstructions(const BlockList& blocks, DceState& state) {
   return wl;
 }
 
+// If tmp is produced by an IncRef, possibly refined through a chain of
+// CheckType/AssertType instructions that are its only users, return
+// the IncRef.  Otherwise return nullptr.
+IRInstruction* findPairedIncRef(SSATmp* tmp, const UseCounts& uses) {
+  auto inst = tmp->inst();
+  while (inst->op() == CheckType || inst->op() == AssertType) {
+    tmp = inst->src(0);
+    if (uses[tmp] != 1) return nullptr;
+    inst = tmp->inst();
+  }
+  return inst->op() == IncRef ? inst : nullptr;
+}
+
 // Perform the following transformations:
 // 1) Change all unconsumed IncRefs to Mov.
 // 2) Mark a conditionally dead DecRefNZ as live if its corresponding IncRef
 //    cannot be eliminated.
 // 3) Eliminates IncRef-DecRef pairs who value is used only by the DecRef and
-//    whose type does not run a destructor with side effects.
+//    whose type does not run a destructor with side effects.  The DecRef
+//    may see the value through type checks, as happens when a region
+//    block re-checks a value an earlier block loaded; in that case the
+//    IncRef becomes a Mov feeding the checks.
 void optimizeRefCount(IRTrace* trace, DceState& state, UseCounts& uses) {
   WorkList decrefs;
   forEachInst(trace, [&](IRInstruction* inst) {
@@ -263,11 +279,9 @@ void optimizeRefCount(IRTrace* trace, DceState& state, UseCounts& uses) {
     }
     if (inst->op() == DecRef) {
       SSATmp* src = inst->src(0);
-      if (uses[src] == 1 && !src->type().canRunDtor()) {
-        IRInstruction* srcInst = src->inst();
-        if (srcInst->op() == IncRef) {
-          decrefs.push_back(inst);
-        }
+      if (uses[src] == 1 && !src->type().canRunDtor() &&
+          findPairedIncRef(src, uses)) {
+        decrefs.push_back(inst);
       }
     }
     // Do copyProp at last. When processing DecRefNZs, we still need to look at
@@ -277,11 +291,17 @@ void optimizeRefCount(IRTrace* trace, DceState& state, UseCounts& uses) {
   for (const IRInstruction* decref : decrefs) {
     assert(decref->op() == DecRef);
     SSATmp* src = decref->src(0);
-    assert(src->inst()->op() == IncRef);
     assert(!src->type().canRunDtor());
-    if (uses[src] == 1) {
-      state[decref].setDead();
-      state[src->inst()].setDead();
+    if (uses[src] != 1) continue;
+    IRInstruction* incref = findPairedIncRef(src, uses);
+    if (!incref) continue;
+    state[decref].setDead();
+    if (incref == src->inst()) {
+      state[incref].setDead();
+    } else {
+      FTRACE(5, "pairing {} with {} across type checks\n",
+             incref->toString(), decref->toString());
+      incref->setOpcode(Mov);
     }
   }
 }
@@ -197,9 +197,10 @@ private:
 struct ReqBindJccData : IRExtraData {
   Offset taken;
   Offset notTaken;
+  Offset source;   // the JmpZ/JmpNZ, or kInvalidOffset if unknown
 
   std::string show() const {
-    return folly::to<std::string>(taken, ',', notTaken);
+    return folly::to<std::string>(taken, ',', notTaken, ',', source);
   }
 };
 
@@ -271,6 +272,15 @@ struct DefInlineFPData : IRExtraData {
   Offset retSPOff;
 };
 
+/*
+ * Id of a profiling translation (see ProfData).
+ */
+struct TransIDData : IRExtraData {
+  explicit TransIDData(Transl::TransID transId) : transId(transId) {}
+  std::string show() const { return folly::to<std::string>(transId); }
+  Transl::TransID transId;
+};
+
 /*
  * FCallArray offsets
  */
@@ -380,6 +390,8 @@ X(ReqBindJmpNZero,              ReqBindJccData);
 X(SideExitGuardLoc,             SideExitGuardData);
 X(SideExitGuardStk,             SideExitGuardData);
 X(CheckDefinedClsEq,            CheckDefinedClsData);
+X(DecProfCounter,               TransIDData);
+X(CheckCold,                    TransIDData);
 
 #undef X
 
@@ -142,13 +142,25 @@ public:
   void recordFixup(CTCA tca, const Fixup& fixup) {
     TRACE(3, "FixupMapImpl::recordFixup: tca %p -> (pcOff %d, spOff %d)\n",
           tca, fixup.m_pcOffset, fixup.m_spOffset);
-    m_fixups.insert(tca, FixupEntry(fixup));
+    insertOrReplace(tca, FixupEntry(fixup));
   }
 
   void recordIndirectFixup(CTCA tca, const IndirectFixup& indirect) {
     TRACE(2, "FixupMapImpl::recordIndirectFixup: tca %p -> ripOff %d\n",
           tca, indirect.returnIpDisp);
-    m_fixups.insert(tca, FixupEntry(indirect));
+    insertOrReplace(tca, FixupEntry(indirect));
+  }
+
+  /*
+   * Forget the fixups for return addresses in code that is about to be
+   * reused (see TranslatorX64::reclaimDeadCode).  The caller must
+   * ensure no frame can still return into that code.
+   */
+  template<class Pred>
+  void forgetIf(Pred isDead) {
+    for (auto& ent : m_fixups) {
+      if (isDead(ent.first)) ent.second = FixupEntry();
+    }
   }
 
   bool getFrameRegs(const ActRec* ar,
@@ -160,7 +172,7 @@ public:
     // frame.
     ar = (const ActRec*)ar->m_savedRbp;
     auto* ent = m_fixups.find(tca);
-    if (!ent) return false;
+    if (!ent || ent->isDead()) return false;
     if (ent->isIndirect()) {
       // Note: if indirect fixups happen frequently enough, we could
       // just compare savedRip to be less than some threshold where
@@ -179,14 +191,31 @@ private:
   union FixupEntry {
     explicit FixupEntry(Fixup f) : fixup(f) {}
     explicit FixupEntry(IndirectFixup f) : indirect(f) {}
+    // Entries can't be removed from the map, so forgotten ones are
+    // marked dead instead.
+    FixupEntry() : firstElem(kDead) {}
+
+    static const int32_t kDead = -2;
 
     int32_t firstElem;
     Fixup fixup;
     IndirectFixup indirect;
 
-    bool isIndirect() const { return firstElem < 0; }
+    bool isIndirect() const { return firstElem == -1; }
+    bool isDead() const { return firstElem == kDead; }
   };
 
+  void insertOrReplace(CTCA tca, const FixupEntry& ent) {
+    // Reused code can record a fixup at an address that already has
+    // one; the old entry was forgotten when the code was freed.
+    if (auto* old = m_fixups.find(tca)) {
+      assert(old->isDead());
+      *old = ent;
+      return;
+    }
+    m_fixups.insert(tca, ent);
+  }
+
   const Opcode* pc(const ActRec* ar, const Func* f, const Fixup& fixup) const {
     assert(f);
     return f->getEntry() + fixup.m_pcOffset;
@@ -1307,6 +1307,14 @@ void HhbcTranslator::emitIncTransCounter() {
   m_tb->gen(IncTransCounter);
 }
 
+void HhbcTranslator::emitDecProfCounter(Transl::TransID transId) {
+  m_tb->gen(DecProfCounter, TransIDData(transId));
+}
+
+void HhbcTranslator::emitCheckCold(Transl::TransID transId) {
+  m_tb->gen(CheckCold, TransIDData(transId));
+}
+
 SSATmp* HhbcTranslator::getStrName(const StringData* knownName) {
   SSATmp* name = popC();
   assert(name->isA(Type::Str) || knownName);
@@ -387,6 +387,8 @@ struct HhbcTranslator {
   void emitStrlen();
   void emitIncStat(int32_t counter, int32_t value, bool force = false);
   void emitIncTransCounter();
+  void emitDecProfCounter(Transl::TransID transId);
+  void emitCheckCold(Transl::TransID transId);
   void emitArrayIdx();
 
 private:
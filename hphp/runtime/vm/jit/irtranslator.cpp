@@ -24,6 +24,7 @@
 
 #include "hphp/runtime/vm/bytecode.h"
 #include "hphp/runtime/vm/runtime.h"
+#include "hphp/runtime/vm/type_profile.h"
 #include "hphp/runtime/base/complex_types.h"
 #include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/vm/jit/targetcache.h"
@@ -37,6 +38,7 @@
 #include "hphp/runtime/vm/jit/codegen.h"
 #include "hphp/runtime/vm/jit/hhbctranslator.h"
 #include "hphp/runtime/vm/jit/print.h"
+#include "hphp/runtime/vm/jit/prof-data.h"
 #include "hphp/runtime/vm/jit/check.h"
 
 // Include last to localize effects to this file
@@ -80,7 +82,7 @@ static const bool debug = false;
 
 #define HHIR_EMIT(op, ...)                      \
   do {                                          \
-    m_hhbcTrans->emit ## op(__VA_ARGS__);       \
+    s_hhbcTrans->emit ## op(__VA_ARGS__);       \
     return;                                     \
   } while (0)
 
@@ -111,13 +113,13 @@ TranslatorX64::irCheckType(X64Assembler& a,
   case Location::Stack:
     {
       uint32_t stackOffset = locPhysicalOffset(l);
-      m_hhbcTrans->guardTypeStack(stackOffset,
+      s_hhbcTrans->guardTypeStack(stackOffset,
                                   JIT::Type::fromRuntimeType(rtt));
     }
     break;
 
   case Location::Local:
-    m_hhbcTrans->guardTypeLocal(l.offset, JIT::Type::fromRuntimeType(rtt));
+    s_hhbcTrans->guardTypeLocal(l.offset, JIT::Type::fromRuntimeType(rtt));
     break;
 
   case Location::Iter:
@@ -296,7 +298,7 @@ Translator::translateUnboxR(const NormalizedInstruction& i) {
   if (i.noOp) {
     // statically proved to be unboxed -- just pass that info to the IR
     TRACE(1, "HHIR: translateUnboxR: output inferred to be Cell\n");
-    m_hhbcTrans->assertTypeLocation(Location(Location::Stack, 0),
+    s_hhbcTrans->assertTypeLocation(Location(Location::Stack, 0),
                                     JIT::Type::Cell);
   } else {
     HHIR_EMIT(UnboxR);
@@ -540,7 +542,7 @@ void Translator::translateContEnter(const NormalizedInstruction& i) {
 
   // ContEnter can't exist in an inlined function right now.  (If it
   // ever can, this curFunc() needs to change.)
-  assert(!m_hhbcTrans->isInlining());
+  assert(!s_hhbcTrans->isInlining());
   const Func* srcFunc = curFunc();
   int32_t callOffsetInUnit = after - srcFunc->base();
 
@@ -1048,9 +1050,40 @@ Translator::translateFCallBuiltin(const NormalizedInstruction& i) {
   HHIR_EMIT(FCallBuiltin, numArgs, numNonDefault, funcId);
 }
 
+/*
+ * Bytecodes that only touch the inlined frame through its locals and
+ * $this, so a callee made of nothing else doesn't need a real ActRec.
+ */
+static bool isFrameFreeOp(const NormalizedInstruction& ni,
+                          const Func* func) {
+  switch (ni.op()) {
+  case OpNull: case OpTrue: case OpFalse: case OpInt: case OpDouble:
+  case OpString: case OpArray:
+  case OpCGetL: case OpCGetL2: case OpSetL: case OpPopC:
+  case OpIssetL: case OpEmptyL: case OpIsNullL: case OpIsNullC:
+  case OpNot: case OpSame: case OpNSame: case OpEq: case OpNeq:
+  case OpLt: case OpLte: case OpGt: case OpGte:
+  case OpAdd: case OpSub: case OpMul: case OpBitAnd: case OpBitOr:
+  case OpBitXor: case OpBitNot: case OpShl: case OpShr: case OpXor:
+  case OpCastBool: case OpCastInt: case OpCastDouble:
+  case OpCheckThis: case OpBareThis: case OpThis: case OpInstanceOfD:
+  case OpRetC:
+    return true;
+  case OpCGetM:
+  case OpSetM:
+    return ni.immVec.locationCode() == LH &&
+      ni.immVecM.size() == 1 &&
+      ni.immVecM.front() == MPT &&
+      !mInstrHasUnknownOffsets(ni, func->cls());
+  default:
+    return false;
+  }
+}
+
 bool shouldIRInline(const Func* curFunc,
                     const Func* func,
-                    const Tracelet& callee) {
+                    const Tracelet& callee,
+                    Offset callOff) {
   if (!RuntimeOption::EvalHHIREnableGenTimeInlining) {
     return false;
   }
@@ -1229,14 +1262,36 @@ bool shouldIRInline(const Func* curFunc,
     return accept("constant printer");
   }
 
-  return refuse("unknown kind of function");
+  /*
+   * Any other small straight-line function, as long as the profile
+   * says this call site is hot and (nearly) always reaches func.  The
+   * callee must not depend on having a real frame, and none of its
+   * instructions may have predicted outputs, since those would need
+   * side exits out of the inlined frame.
+   */
+  auto const share = predictCallTarget(curFunc, callOff, func);
+  if (share < RuntimeOption::EvalHHIRInliningMinCallShare) {
+    return refuse("call site not profiled as monomorphic");
+  }
+  uint32_t numInstrs = 0;
+  for (auto* ni = callee.m_instrStream.first; ni; ni = ni->next) {
+    if (++numInstrs > RuntimeOption::EvalHHIRInliningMaxInstrs) {
+      return refuse("too many instructions");
+    }
+    if (ni->outputPredicted || !isFrameFreeOp(*ni, func)) {
+      FTRACE(1, "shouldIRInline: {} can't be inlined\n",
+             opcodeToName(ni->op()));
+      return refuse("unsupported instruction");
+    }
+  }
+  return accept("small monomorphic callee");
 }
 
 void
 Translator::translateFCall(const NormalizedInstruction& i) {
   auto const numArgs = i.imm[0].u_IVA;
 
-  always_assert(!m_hhbcTrans->isInlining() && "curUnit and curFunc calls");
+  always_assert(!s_hhbcTrans->isInlining() && "curUnit and curFunc calls");
   const Opcode* after = curUnit()->at(nextSrcKey(i).offset());
   const Func* srcFunc = curFunc();
   Offset returnBcOffset =
@@ -1247,20 +1302,21 @@ Translator::translateFCall(const NormalizedInstruction& i) {
    * the call.
    */
   if (i.calleeTrace) {
-    if (!i.calleeTrace->m_inliningFailed && !m_hhbcTrans->isInlining()) {
-      assert(shouldIRInline(curFunc(), i.funcd, *i.calleeTrace));
+    if (!i.calleeTrace->m_inliningFailed && !s_hhbcTrans->isInlining()) {
+      assert(shouldIRInline(curFunc(), i.funcd, *i.calleeTrace,
+                            i.source.offset()));
 
-      m_hhbcTrans->beginInlining(numArgs, i.funcd, returnBcOffset);
+      s_hhbcTrans->beginInlining(numArgs, i.funcd, returnBcOffset);
       static const bool shapeStats = Stats::enabledAny() &&
                                      getenv("HHVM_STATS_INLINESHAPE");
       if (shapeStats) {
-        m_hhbcTrans->profileInlineFunctionShape(traceletShape(*i.calleeTrace));
+        s_hhbcTrans->profileInlineFunctionShape(traceletShape(*i.calleeTrace));
       }
 
       for (auto* ni = i.calleeTrace->m_instrStream.first;
           ni; ni = ni->next) {
-        m_curNI = ni;
-        SCOPE_EXIT { m_curNI = &i; };
+        s_curNI = ni;
+        SCOPE_EXIT { s_curNI = &i; };
         translateInstr(*ni);
       }
       return;
@@ -1269,8 +1325,8 @@ Translator::translateFCall(const NormalizedInstruction& i) {
     static const auto enabled = Stats::enabledAny() &&
                                 getenv("HHVM_STATS_FAILEDINL");
     if (enabled) {
-      m_hhbcTrans->profileFunctionEntry("FailedCandidate");
-      m_hhbcTrans->profileFailedInlShape(traceletShape(*i.calleeTrace));
+      s_hhbcTrans->profileFunctionEntry("FailedCandidate");
+      s_hhbcTrans->profileFailedInlShape(traceletShape(*i.calleeTrace));
     }
   }
 
@@ -1471,7 +1527,7 @@ Translator::translateCIterFree(const NormalizedInstruction& i) {
 // All vector instructions are handled by one HhbcTranslator method.
 #define MII(instr, ...)                                                 \
   void Translator::translate##instr##M(const NormalizedInstruction& ni) { \
-    m_hhbcTrans->emitMInstr(ni);                                        \
+    s_hhbcTrans->emitMInstr(ni);                                        \
   }
 MINSTRS
 MII(FPass)
@@ -1524,7 +1580,7 @@ Translator::passPredictedAndInferredTypes(const NormalizedInstruction& i) {
   if (u == NormalizedInstruction::OutputUse::Inferred) {
     TRACE(1, "irPassPredictedAndInferredTypes: output inferred as %s\n",
           jitType.toString().c_str());
-    m_hhbcTrans->assertTypeStack(0, jitType);
+    s_hhbcTrans->assertTypeStack(0, jitType);
 
   } else if (u == NormalizedInstruction::OutputUse::Used && i.outputPredicted) {
     // If the value was predicted statically by the front-end, it
@@ -1537,11 +1593,11 @@ Translator::passPredictedAndInferredTypes(const NormalizedInstruction& i) {
         !jitType.isCounted()) {
       TRACE(1, "irPassPredictedAndInferredTypes: output inferred as %s\n",
             jitType.toString().c_str());
-      m_hhbcTrans->assertTypeStack(0, JIT::Type::Uncounted);
+      s_hhbcTrans->assertTypeStack(0, JIT::Type::Uncounted);
     } else {
       TRACE(1, "irPassPredictedAndInferredTypes: output predicted as %s\n",
             jitType.toString().c_str());
-      m_hhbcTrans->checkTypeTopOfStack(jitType, i.next->offset());
+      s_hhbcTrans->checkTypeTopOfStack(jitType, i.next->offset());
     }
   }
 }
@@ -1573,16 +1629,16 @@ void Translator::interpretInstr(const NormalizedInstruction& i) {
          i.toString(), poppedCells, arPushedCells);
 
   if (i.changesPC) {
-    m_hhbcTrans->emitInterpOneCF(poppedCells);
+    s_hhbcTrans->emitInterpOneCF(poppedCells);
   } else {
-    m_hhbcTrans->emitInterpOne(outStkType, poppedCells, arPushedCells);
+    s_hhbcTrans->emitInterpOne(outStkType, poppedCells, arPushedCells);
     if (i.outLocal) {
       // HHIR tracks local values and types, so we should inform it about
       // the new local type.  This is done via an overriding type assertion.
       assert(i.outLocal->isLocal());
       int32_t locId = i.outLocal->location.offset;
       JIT::Type newType = JIT::Type::fromRuntimeType(i.outLocal->rtt);
-      m_hhbcTrans->overrideTypeLocal(locId, newType);
+      s_hhbcTrans->overrideTypeLocal(locId, newType);
     }
   }
 }
@@ -1590,24 +1646,24 @@ void Translator::interpretInstr(const NormalizedInstruction& i) {
 void Translator::translateInstr(const NormalizedInstruction& i) {
   FTRACE(1, "\n{:-^60}\n", folly::format("translating {} with stack:\n{}",
                                          i.toString(),
-                                         m_hhbcTrans->showStack()));
+                                         s_hhbcTrans->showStack()));
 
-  m_hhbcTrans->setBcOff(i.source.offset(),
-                        i.breaksTracelet && !m_hhbcTrans->isInlining());
+  s_hhbcTrans->setBcOff(i.source.offset(),
+                        i.breaksTracelet && !s_hhbcTrans->isInlining());
 
   if (i.guardedThis) {
     // Task #2067635: This should really generate an AssertThis
-    m_hhbcTrans->setThisAvailable();
+    s_hhbcTrans->setThisAvailable();
   }
 
   if (moduleEnabled(HPHP::Trace::stats, 2)) {
-    m_hhbcTrans->emitIncStat(Stats::opcodeToIRPreStatCounter(i.op()), 1);
+    s_hhbcTrans->emitIncStat(Stats::opcodeToIRPreStatCounter(i.op()), 1);
   }
   if (RuntimeOption::EnableInstructionCounts ||
       moduleEnabled(HPHP::Trace::stats, 3)) {
     // If the instruction takes a slow exit, the exit trace will
     // decrement the post counter for that opcode.
-    m_hhbcTrans->emitIncStat(Stats::opcodeToIRPostStatCounter(i.op()),
+    s_hhbcTrans->emitIncStat(Stats::opcodeToIRPostStatCounter(i.op()),
                              1, true);
   }
 
@@ -1629,12 +1685,12 @@ void TranslatorX64::irAssertType(const Location& l,
       // tx64LocPhysicalOffset returns positive offsets for stack values,
       // relative to rVmSp
       uint32_t stackOffset = locPhysicalOffset(l);
-      m_hhbcTrans->assertTypeStack(stackOffset,
+      s_hhbcTrans->assertTypeStack(stackOffset,
                                    JIT::Type::fromRuntimeType(rtt));
       break;
     }
     case Location::Local:  // Stack frame's registers; offset == local register
-      m_hhbcTrans->assertTypeLocal(l.offset, JIT::Type::fromRuntimeType(rtt));
+      s_hhbcTrans->assertTypeLocal(l.offset, JIT::Type::fromRuntimeType(rtt));
       break;
 
     case Location::Invalid:           // Unknown location
@@ -1679,7 +1735,7 @@ static bool supportedInterpOne(const NormalizedInstruction* i) {
 }
 
 TranslatorX64::TranslateResult
-TranslatorX64::irTranslateTracelet(Tracelet& t) {
+TranslatorX64::irTranslateTracelet(Tracelet& t, TransKind kind) {
   const SrcKey &sk = t.m_sk;
   SrcRec& srcRec = *getSrcRec(sk);
   assert(srcRec.inProgressTailJumps().size() == 0);
@@ -1691,15 +1747,26 @@ TranslatorX64::irTranslateTracelet(Tracelet& t) {
 
     // after guards, add a counter for the translation if requested
     if (RuntimeOption::EvalJitTransCounters) {
-      m_hhbcTrans->emitIncTransCounter();
+      s_hhbcTrans->emitIncTransCounter();
+    }
+
+    // Profiling translations count their entries; the one at function
+    // entry also triggers the optimized retranslation once it's hot.
+    if (kind == TransProfile) {
+      auto const transId = m_profData->curTransID();
+      if (t.m_sk.offset() == curFunc()->base()) {
+        s_hhbcTrans->emitCheckCold(transId);
+      } else {
+        s_hhbcTrans->emitDecProfCounter(transId);
+      }
     }
 
     emitRB(a, RBTypeTraceletBody, t.m_sk);
     Stats::emitInc(a, Stats::Instr_TC, t.m_numOpcodes);
 
     // Profiling on function entry.
-    if (m_curTrace->m_sk.offset() == curFunc()->base()) {
-      m_hhbcTrans->profileFunctionEntry("Normal");
+    if (s_curTrace->m_sk.offset() == curFunc()->base()) {
+      s_hhbcTrans->profileFunctionEntry("Normal");
     }
 
     /*
@@ -1711,21 +1778,21 @@ TranslatorX64::irTranslateTracelet(Tracelet& t) {
       static const bool enabled = Stats::enabledAny() &&
                                   getenv("HHVM_STATS_FUNCSHAPE");
       if (!enabled) return;
-      if (m_curTrace->m_sk.offset() != curFunc()->base()) return;
-      if (auto last = m_curTrace->m_instrStream.last) {
+      if (s_curTrace->m_sk.offset() != curFunc()->base()) return;
+      if (auto last = s_curTrace->m_instrStream.last) {
         if (last->op() != OpRetC && last->op() != OpRetV) {
           return;
         }
       }
-      m_hhbcTrans->profileSmallFunctionShape(traceletShape(*m_curTrace));
+      s_hhbcTrans->profileSmallFunctionShape(traceletShape(*s_curTrace));
     }();
 
     // Translate each instruction in the tracelet
     for (auto* ni = t.m_instrStream.first; ni; ni = ni->next) {
       try {
         SKTRACE(1, ni->source, "HHIR: translateInstr\n");
-        Nuller<NormalizedInstruction> niNuller(&m_curNI);
-        m_curNI = ni;
+        Nuller<NormalizedInstruction> niNuller(&s_curNI);
+        s_curNI = ni;
         translateInstr(*ni);
       } catch (JIT::FailedIRGen& fcg) {
         // If we haven't tried interpreting ni yet, flag it to be interpreted
@@ -1781,8 +1848,11 @@ TranslatorX64::irTranslateTracelet(Tracelet& t) {
     StackTraceNoHeap::AddExtraLogging(
       "Assertion failure",
       folly::format("{}\n\nActive Trace:\n{}\n",
-                    fa.summary, m_hhbcTrans->trace()->toString()).str());
+                    fa.summary, s_hhbcTrans->trace()->toString()).str());
     abort();
+  } catch (const DataBlockFull&) {
+    // The caller moves to a bigger code block and tries again.
+    throw;
   } catch (const std::exception& e) {
     FTRACE(1, "HHIR: FAILED with exception: {}\n", e.what());
     assert(0);
@@ -1791,7 +1861,7 @@ TranslatorX64::irTranslateTracelet(Tracelet& t) {
 }
 
 void Translator::traceStart(Offset bcStartOffset) {
-  assert(!m_irFactory);
+  assert(!s_irFactory);
 
   Cell* fp = vmfp();
   if (curFunc()->isGenerator()) {
@@ -1802,13 +1872,13 @@ void Translator::traceStart(Offset bcStartOffset) {
          " HHIR during translation ",
          color(ANSI_COLOR_END));
 
-  m_irFactory.reset(new JIT::IRFactory());
-  m_hhbcTrans.reset(new JIT::HhbcTranslator(
-    *m_irFactory, bcStartOffset, fp - vmsp(), curFunc()));
+  s_irFactory = new JIT::IRFactory();
+  s_hhbcTrans = new JIT::HhbcTranslator(
+    *s_irFactory, bcStartOffset, fp - vmsp(), curFunc());
 }
 
 void Translator::traceEnd() {
-  m_hhbcTrans->end();
+  s_hhbcTrans->end();
   FTRACE(1, "{}{:-^40}{}\n",
          color(ANSI_COLOR_BLACK, ANSI_BGCOLOR_GREEN),
          "",
@@ -1816,21 +1886,38 @@ void Translator::traceEnd() {
 }
 
 void TranslatorX64::traceCodeGen() {
+  traceOptimize();
+  traceEmit();
+}
+
+void TranslatorX64::traceOptimize() {
   using namespace JIT;
 
-  HPHP::JIT::IRTrace* trace = m_hhbcTrans->trace();
+  HPHP::JIT::IRTrace* trace = s_hhbcTrans->trace();
+  dumpTrace(kIRLevel, trace, " after initial translation ");
+  assert(checkCfg(trace, *s_irFactory));
+  optimizeTrace(trace, s_hhbcTrans->traceBuilder());
+  dumpTrace(kOptLevel, trace, " after optimizing ");
+  assert(checkCfg(trace, *s_irFactory));
+}
+
+/*
+ * Register-allocate the optimized trace and generate code for it into
+ * a and astubs.  The caller must hold the write lease.
+ */
+void TranslatorX64::traceEmit() {
+  using namespace JIT;
+
+  assert(s_writeLease.amOwner());
+  HPHP::JIT::IRTrace* trace = s_hhbcTrans->trace();
   auto finishPass = [&](const char* msg, int level,
                         const RegAllocInfo* regs = nullptr,
                         const LifetimeInfo* lifetime = nullptr) {
     dumpTrace(level, trace, msg, regs, lifetime);
-    assert(checkCfg(trace, *m_irFactory));
+    assert(checkCfg(trace, *s_irFactory));
   };
 
-  finishPass(" after initial translation ", kIRLevel);
-  optimizeTrace(trace, m_hhbcTrans->traceBuilder());
-  finishPass(" after optimizing ", kOptLevel);
-
-  auto* factory = m_irFactory.get();
+  auto* factory = s_irFactory;
   recordBCInstr(OpTraceletGuard, a, a.code.frontier);
   if (dumpIREnabled() || RuntimeOption::EvalJitCompareHHIR) {
     LifetimeInfo lifetime(factory);
@@ -1859,9 +1946,11 @@ void TranslatorX64::traceCodeGen() {
 
 void Translator::traceFree() {
   FTRACE(1, "HHIR free: arena size: {}\n",
-         m_irFactory->arena().size());
-  m_hhbcTrans.reset();
-  m_irFactory.reset();
+         s_irFactory->arena().size());
+  delete s_hhbcTrans;
+  delete s_irFactory;
+  s_hhbcTrans = nullptr;
+  s_irFactory = nullptr;
 }
 
 }}
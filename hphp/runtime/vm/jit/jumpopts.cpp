@@ -128,6 +128,18 @@ bool jccCanBeDirectExit(Opcode opc) {
     // TODO(#2404341)
 }
 
+/*
+ * The bytecode offset of the instruction that produced the jump ending
+ * block: the last Marker before it in the block.
+ */
+Offset jccSourceOffset(Block* block) {
+  for (auto it = block->backIter(); it != block->begin(); ) {
+    --it;
+    if (it->op() == Marker) return it->extra<Marker>()->bcOff;
+  }
+  return kInvalidOffset;
+}
+
 /*
  * If main trace ends with a conditional jump with no side-effects on
  * exit, followed by the normal ReqBindJmp sequence, convert the whole
@@ -160,6 +172,7 @@ void optimizeCondTraceExit(IRTrace* trace, IRFactory* irFactory) {
   ReqBindJccData data;
   data.taken = jccExitTrace->back()->extra<ReqBindJmp>()->offset;
   data.notTaken = mainExit->back()->extra<ReqBindJmp>()->offset;
+  data.source = jccSourceOffset(jccBlock);
 
   FTRACE(5, "replacing {} with {}\n", jccInst->id(), opcodeName(newOpcode));
   irFactory->replace(
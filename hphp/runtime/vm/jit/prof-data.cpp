@@ -0,0 +1,121 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+#include "hphp/runtime/vm/jit/prof-data.h"
+
+#include <limits>
+
+#include "hphp/util/trace.h"
+#include "hphp/runtime/base/runtime_option.h"
+#include "hphp/runtime/vm/jit/translator.h"
+
+namespace HPHP { namespace JIT {
+
+TRACE_SET_MOD(pgo);
+
+//////////////////////////////////////////////////////////////////////
+
+ProfTransRec::ProfTransRec(TransID id, const RegionDesc& region)
+  : id(id)
+{
+  assert(!region.blocks.empty());
+  auto const& entry = region.blocks.front();
+  startSk = entry->start();
+
+  for (auto const& b : region.blocks) {
+    blocks.push_back({ b->start().offset(), b->length() });
+  }
+
+  auto const& last = region.blocks.back();
+  lastSk = last->start();
+  for (int i = 1; i < last->length(); ++i) {
+    lastSk.advance(last->unit());
+  }
+
+  for (auto const& pred : entry->typePreds()) {
+    if (pred.first == startSk) entryPreds.push_back(pred.second);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+ProfData::ProfData() {}
+
+ProfData::~ProfData() {
+  for (auto chunk : m_counterChunks) free(chunk);
+}
+
+void ProfData::addProfTrans(const RegionDesc& region) {
+  auto const id = curTransID();
+  m_records.emplace_back(id, region);
+  auto const& rec = m_records.back();
+  m_srcKeyTrans[rec.startSk].push_back(id);
+  FTRACE(1, "ProfData: translation {} for {}@{}, {} blocks\n",
+         id, rec.startSk.getFuncId(), rec.startSk.offset(),
+         rec.blocks.size());
+}
+
+int64_t* ProfData::transCounterAddr(TransID id) {
+  SimpleLock lock(m_counterLock);
+  return counterAddrLocked(id);
+}
+
+int64_t* ProfData::counterAddrLocked(TransID id) {
+  // Allocate a new chunk of counters if necessary.
+  while (id >= m_counterChunks.size() * kCountersPerChunk) {
+    auto chunk = (int64_t*)malloc(sizeof(int64_t) * kCountersPerChunk);
+    std::fill(chunk, chunk + kCountersPerChunk,
+              int64_t(RuntimeOption::EvalJitPGOThreshold));
+    m_counterChunks.push_back(chunk);
+  }
+  return &m_counterChunks[id / kCountersPerChunk][id % kCountersPerChunk];
+}
+
+int64_t ProfData::transCount(TransID id) const {
+  SimpleLock lock(m_counterLock);
+  return countLocked(id);
+}
+
+int64_t ProfData::countLocked(TransID id) const {
+  auto const it = m_disarmedCounts.find(id);
+  if (it != m_disarmedCounts.end()) return it->second;
+  if (id / kCountersPerChunk >= m_counterChunks.size()) return 0;
+  auto const counter =
+    m_counterChunks[id / kCountersPerChunk][id % kCountersPerChunk];
+  return int64_t(RuntimeOption::EvalJitPGOThreshold) - counter;
+}
+
+void ProfData::disarmCounter(TransID id) {
+  SimpleLock lock(m_counterLock);
+  if (m_disarmedCounts.count(id)) return;
+  m_disarmedCounts[id] = countLocked(id);
+  *counterAddrLocked(id) = std::numeric_limits<int64_t>::max();
+}
+
+void ProfData::resetCounter(TransID id) {
+  SimpleLock lock(m_counterLock);
+  m_disarmedCounts.erase(id);
+  *counterAddrLocked(id) = RuntimeOption::EvalJitPGOThreshold;
+}
+
+const std::vector<TransID>& ProfData::transAt(SrcKey sk) const {
+  static const std::vector<TransID> s_empty;
+  auto const it = m_srcKeyTrans.find(sk);
+  return it == m_srcKeyTrans.end() ? s_empty : it->second;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+}}
@@ -0,0 +1,148 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+#ifndef incl_HPHP_JIT_PROF_DATA_H_
+#define incl_HPHP_JIT_PROF_DATA_H_
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+#include "hphp/util/base.h"
+#include "hphp/util/lock.h"
+#include "hphp/runtime/vm/hhbc.h"
+#include "hphp/runtime/vm/srckey.h"
+#include "hphp/runtime/vm/jit/types.h"
+#include "hphp/runtime/vm/jit/region_selection.h"
+
+namespace HPHP { namespace JIT {
+
+using Transl::TransID;
+
+//////////////////////////////////////////////////////////////////////
+
+/*
+ * Profiling data gathered by the first tier of the JIT when
+ * EvalJitPGO is enabled.
+ *
+ * Each profiling translation covers one tracelet.  We keep a copy of
+ * the blocks and entry type predictions of the RegionDesc it was
+ * built from, plus an execution counter that the translation itself
+ * decrements on every entry.  Once the counter of a function-entry
+ * translation runs out, the translation requests a retranslation of
+ * the function as a single region (see selectHotRegion), built by
+ * stitching together the hottest profiling translations.
+ *
+ * The counters live in chunks that are never freed or moved, since
+ * the TC embeds their addresses.  Everything else is protected by the
+ * translator write lease.
+ */
+struct ProfTransRec {
+  struct BlockRange {
+    Offset start;
+    int    length;
+  };
+
+  ProfTransRec(TransID id, const RegionDesc& region);
+
+  TransID                            id;
+  SrcKey                             startSk;
+  SrcKey                             lastSk;  // last instruction
+  std::vector<BlockRange>            blocks;
+  std::vector<RegionDesc::TypePred>  entryPreds;
+};
+
+class ProfData : boost::noncopyable {
+public:
+  ProfData();
+  ~ProfData();
+
+  /*
+   * The id the next profiling translation will get if it is
+   * successfully added with addProfTrans.
+   */
+  TransID curTransID() const { return m_records.size(); }
+
+  /*
+   * Record the profiling translation with id curTransID(), built from
+   * region.
+   */
+  void addProfTrans(const RegionDesc& region);
+
+  /*
+   * Address of the counter for profiling translation id.  Counters
+   * start at EvalJitPGOThreshold and are decremented (racily) by the
+   * translation on each entry.
+   */
+  int64_t* transCounterAddr(TransID id);
+
+  /*
+   * Approximate number of times the translation was entered.
+   */
+  int64_t transCount(TransID id) const;
+
+  /*
+   * Stop a counter from ever reaching zero again, so a function-entry
+   * translation stops requesting retranslations.  transCount keeps
+   * returning the count as of this call.
+   */
+  void disarmCounter(TransID id);
+
+  /*
+   * Restart the countdown for a function-entry translation whose
+   * retranslation was deferred.
+   *
+   * The counter functions don't need the write lease: request threads
+   * call resetCounter when they can't get it.  They serialize on
+   * m_counterLock instead.
+   */
+  void resetCounter(TransID id);
+
+  const ProfTransRec* transRec(TransID id) const {
+    assert(id < m_records.size());
+    return &m_records[id];
+  }
+
+  /*
+   * All profiling translations starting at sk, in creation order.
+   */
+  const std::vector<TransID>& transAt(SrcKey sk) const;
+
+  bool optimized(FuncId funcId) const {
+    return m_optimized.count(funcId);
+  }
+  void setOptimized(FuncId funcId) {
+    m_optimized.insert(funcId);
+  }
+
+private:
+  static const size_t kCountersPerChunk = 4096;
+
+  int64_t* counterAddrLocked(TransID id);
+  int64_t countLocked(TransID id) const;
+
+  std::vector<ProfTransRec> m_records;
+  // Guards m_counterChunks and m_disarmedCounts.
+  mutable SimpleMutex m_counterLock;
+  std::vector<int64_t*> m_counterChunks;
+  hphp_hash_map<TransID, int64_t> m_disarmedCounts;
+  hphp_hash_map<SrcKey, std::vector<TransID>, SrcKey::Hasher> m_srcKeyTrans;
+  hphp_hash_set<FuncId> m_optimized;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+}}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+#include "hphp/runtime/base/memory/smart_containers.h"
+#include "hphp/runtime/base/runtime_option.h"
+#include "hphp/runtime/vm/jit/prof-data.h"
+#include "hphp/runtime/vm/jit/region_selection.h"
+
+namespace HPHP { namespace JIT {
+
+TRACE_SET_MOD(pgo);
+
+//////////////////////////////////////////////////////////////////////
+
+namespace {
+
+/*
+ * Returns whether the translation for the region built so far may
+ * simply continue with the instruction after last.
+ *
+ * translateRegion lays blocks out in order, so we can only stitch
+ * profiling translations together across a conditional jump's
+ * fall-through edge; the taken edge stays a side exit.  Anything else
+ * that ends a tracelet (calls, returns, switches, backward jumps)
+ * ends the region.
+ */
+bool canFallThrough(const Unit* unit, SrcKey last) {
+  auto const op = toOp(*unit->at(last.offset()));
+  return op == OpJmpZ || op == OpJmpNZ;
+}
+
+}
+
+//////////////////////////////////////////////////////////////////////
+
+RegionDescPtr selectHotRegion(Transl::TransID transId,
+                              const ProfData& profData,
+                              const Func* func) {
+  auto const unit = func->unit();
+  auto const entryCount = profData.transCount(transId);
+  auto const minCount =
+    entryCount * RuntimeOption::EvalJitPGOMinBlockCountPercent / 100;
+
+  auto region = smart::make_unique<RegionDesc>();
+  smart::hash_set<SrcKey,SrcKey::Hasher> visited;
+
+  auto rec = profData.transRec(transId);
+  FTRACE(1, "selectHotRegion: {} from translation {} ({} entries)\n",
+         func->fullName()->data(), transId, entryCount);
+
+  while (true) {
+    visited.insert(rec->startSk);
+
+    auto const firstBlock = region->blocks.size();
+    for (auto const& range : rec->blocks) {
+      region->blocks.emplace_back(
+        smart::make_unique<RegionDesc::Block>(func, range.start, range.length)
+      );
+    }
+    for (auto const& pred : rec->entryPreds) {
+      region->blocks[firstBlock]->addPredicted(rec->startSk, pred);
+    }
+
+    if (!canFallThrough(unit, rec->lastSk)) break;
+
+    auto const nextSk = rec->lastSk.advanced(unit);
+    if (visited.count(nextSk)) break;
+
+    // Of the profiling translations at the fall-through, take the one
+    // that was entered most often, if it's hot enough to be worth the
+    // extra code.
+    const ProfTransRec* next = nullptr;
+    int64_t nextCount = 0;
+    for (auto const id : profData.transAt(nextSk)) {
+      auto const count = profData.transCount(id);
+      if (count > nextCount) {
+        next = profData.transRec(id);
+        nextCount = count;
+      }
+    }
+    if (!next || nextCount < minCount) {
+      FTRACE(2, "  stopping at {}: hottest successor has {} entries\n",
+             nextSk.offset(), nextCount);
+      break;
+    }
+    FTRACE(2, "  following fall-through to translation {} ({} entries)\n",
+           next->id, nextCount);
+    rec = next;
+  }
+
+  FTRACE(3, "{}", show(*region));
+  return region;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+}}
@@ -135,7 +135,6 @@ bool RegionDesc::Block::typePredListCmp(TypePredList::const_reference a,
 
 //////////////////////////////////////////////////////////////////////
 
-namespace {
 RegionDescPtr createRegion(const Transl::Tracelet& tlet) {
   if (tlet.m_refDeps.size()) {
     // We don't support reffiness guards yet.
@@ -212,7 +211,6 @@ RegionDescPtr createRegion(const Transl::Tracelet& tlet) {
          tlet.toString(), show(*region));
   return region;
 }
-}
 
 RegionDescPtr selectRegion(const RegionContext& context,
                            const Transl::Tracelet* t) {
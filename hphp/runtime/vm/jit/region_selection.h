@@ -25,6 +25,7 @@
 #include "hphp/runtime/base/memory/smart_containers.h"
 #include "hphp/runtime/vm/srckey.h"
 #include "hphp/runtime/vm/jit/type.h"
+#include "hphp/runtime/vm/jit/types.h"
 
 namespace HPHP {
 namespace Transl {
@@ -32,6 +33,8 @@ struct Tracelet;
 }
 namespace JIT {
 
+class ProfData;
+
 //////////////////////////////////////////////////////////////////////
 
 /*
@@ -218,6 +221,25 @@ struct RegionContext::PreLiveAR {
  */
 RegionDescPtr selectRegion(const RegionContext&, const Transl::Tracelet*);
 
+/*
+ * Convert an analyzed Tracelet into an equivalent RegionDesc, with the
+ * Tracelet's guards as predictions on its first instruction.
+ *
+ * Returns nullptr if the Tracelet has guards a RegionDesc can't
+ * express (reffiness guards).
+ */
+RegionDescPtr createRegion(const Transl::Tracelet&);
+
+/*
+ * Select the region for the optimized retranslation of func, which was
+ * profiled under EvalJitPGO.  The region starts at the function-entry
+ * profiling translation transId and follows the hottest profiled
+ * fall-through successors.
+ */
+RegionDescPtr selectHotRegion(Transl::TransID transId,
+                              const ProfData& profData,
+                              const Func* func);
+
 /*
  * Debug stringification for various things.
  */
@@ -114,6 +114,32 @@ void SrcRec::newTranslation(TCA newStart) {
   m_inProgressTailJumps.clear();
 }
 
+/*
+ * Put newStart in front of all existing translations, so it is the
+ * first one tried.  Its fallback jumps go to the old first translation,
+ * so the rest of the chain stays reachable if its guards fail.
+ */
+void SrcRec::prependTranslation(TCA newStart) {
+  if (m_translations.empty()) {
+    newTranslation(newStart);
+    return;
+  }
+
+  TRACE(1, "SrcRec(%p)::prependTranslation @%p\n", this, newStart);
+
+  auto const oldTop = m_translations.front();
+  for (auto& br : m_inProgressTailJumps) {
+    patch(br, oldTop);
+  }
+  m_inProgressTailJumps.clear();
+
+  m_translations.insert(m_translations.begin(), newStart);
+  if (!hasDebuggerGuard()) {
+    atomic_release_store(&m_topTranslation, newStart);
+  }
+  patchIncomingBranches(newStart);
+}
+
 void SrcRec::addDebuggerGuard(TCA dbgGuard, TCA dbgBranchGuardSrc) {
   assert(!m_dbgBranchGuardSrc);
 
@@ -223,6 +249,7 @@ size_t SrcDB::invalidateCode(const Eval::PhpFile* file) {
       for (/* already inited*/; i < deferredSrcKeys->size(); i++) {
         tx64->invalidateSrcKey((*deferredSrcKeys)[i]);
       }
+      tx64->retireDeadCode();
       TRACE(1, "SrcDB::invalidateCode: file %p has %zd srcKeys\n", file,
             entry->second->size());
       m_deps.erase(entry);
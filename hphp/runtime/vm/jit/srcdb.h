@@ -16,6 +16,8 @@
 #ifndef incl_HPHP_SRCDB_H_
 #define incl_HPHP_SRCDB_H_
 
+#include <algorithm>
+
 #include <boost/noncopyable.hpp>
 
 #include "hphp/util/asm-x64.h"
@@ -102,6 +104,7 @@ struct SrcRec {
   void chainFrom(IncomingBranch br);
   void emitFallbackJump(TCA from, int cc = -1);
   void newTranslation(TCA newStart);
+  void prependTranslation(TCA newStart);
   void replaceOldTranslations();
   void addDebuggerGuard(TCA dbgGuard, TCA m_dbgBranchGuardSrc);
   bool hasDebuggerGuard() const { return m_dbgBranchGuardSrc != nullptr; }
@@ -111,6 +114,25 @@ struct SrcRec {
     return m_translations;
   }
 
+  /*
+   * Drop the incoming branches and tail fallback jumps that live in
+   * code for which isDead returns true, so they are never patched
+   * after that code has been reused.
+   */
+  template<class Pred>
+  void forgetBranchesFrom(Pred isDead) {
+    auto forget = [&](vector<IncomingBranch>& branches) {
+      branches.erase(
+        std::remove_if(branches.begin(), branches.end(),
+                       [&](const IncomingBranch& br) {
+                         return isDead(br.toSmash());
+                       }),
+        branches.end());
+    };
+    forget(m_incomingBranches);
+    forget(m_tailFallbackJumps);
+  }
+
   /*
    * The anchor translation is a retranslate request for the current
    * SrcKey that will continue the tracelet chain.
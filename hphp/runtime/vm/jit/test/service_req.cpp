@@ -0,0 +1,34 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+#include "hphp/runtime/vm/jit/translator-x64.h"
+
+#include "gtest/gtest.h"
+
+namespace HPHP { namespace Transl {
+
+TEST(ServiceReq, JccFirstArgRoundTrip) {
+  const ConditionCode ccs[] = { CC_O, CC_Z, CC_NZ, CC_L, CC_G };
+  const Offset offs[] = { 0, 1, 4096, kInvalidOffset };
+  for (auto cc : ccs) {
+    for (auto off : offs) {
+      auto arg = packJccFirstArg(cc, off);
+      EXPECT_EQ(cc, jccFirstArgCC(arg));
+      EXPECT_EQ(off, jccFirstArgOffset(arg));
+    }
+  }
+}
+
+} }
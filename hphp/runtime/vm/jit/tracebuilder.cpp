@@ -284,6 +284,7 @@ void TraceBuilder::updateTrackedState(IRInstruction* inst) {
     }
     // fallthrough
   case AssertLoc:
+  case CheckLoc:
   case GuardLoc:
     setLocalType(inst->extra<LocalId>()->locId,
                  inst->typeParam());
@@ -555,19 +556,27 @@ SSATmp* TraceBuilder::cseLookup(IRInstruction* inst,
 SSATmp* TraceBuilder::preOptimizeCheckLoc(IRInstruction* inst) {
   auto const locId = inst->extra<CheckLoc>()->locId;
 
-  if (auto const prevValue = getLocalValue(locId)) {
-    always_assert(false && "WTF");
-    return gen(
+  /*
+   * Multi-block regions re-check the entry predictions of every block
+   * they contain, but earlier blocks have often already loaded, stored
+   * or checked the same local.  If we know its value, check the value
+   * instead so the simplifier can drop the guard when the type is
+   * already known to match, and so later uses see the refined tmp.
+   * CheckType doesn't look inside boxes, so refs still go to memory.
+   */
+  auto const prevValue = getLocalValue(locId);
+  if (prevValue && !prevValue->type().maybeBoxed() &&
+      !inst->typeParam().maybeBoxed()) {
+    auto const checked = gen(
       CheckType, inst->typeParam(), inst->taken(), prevValue
     );
+    setLocalValue(locId, checked);
+    inst->convertToNop();
+    return nullptr;
   }
 
   auto const prevType = getLocalType(locId);
-  if (prevType != Type::None) {
-    always_assert(false && "WTF2");
-    // It doesn't make sense to be checking something that's deemed to
-    // fail.
-    assert(prevType == inst->typeParam());
+  if (prevType != Type::None && prevType.subtypeOf(inst->typeParam())) {
     inst->convertToNop();
   }
 
@@ -16,6 +16,7 @@
 
 #include "hphp/runtime/vm/jit/translator-runtime.h"
 
+#include "hphp/runtime/base/array/hphp_array.h"
 #include "hphp/runtime/ext/ext_function.h"
 #include "hphp/runtime/vm/member_operations.h"
 #include "hphp/runtime/vm/type_constraint.h"
@@ -76,6 +77,17 @@ ArrayData* array_add(ArrayData* a1, ArrayData* a2) {
 }
 
 HOT_FUNC_VM void setNewElem(TypedValue* base, Cell val) {
+  // Appending to an unshared packed array needs none of SetNewElem's
+  // type dispatch.
+  TypedValue* cell = tvToCell(base);
+  if (cell->m_type == KindOfArray) {
+    ArrayData* a = cell->m_data.parr;
+    if (LIKELY(a->isHphpArray()) &&
+        !(val.m_type == KindOfArray && val.m_data.parr == a) &&
+        static_cast<HphpArray*>(a)->appendPacked(tvCellAsCVarRef(&val))) {
+      return;
+    }
+  }
   SetNewElem<false>(base, &val);
 }
 
@@ -46,6 +46,7 @@ typedef __sighandler_t *sighandler_t;
 #include <boost/scoped_ptr.hpp>
 
 #include "folly/Format.h"
+#include "folly/ScopeGuard.h"
 
 #include "hphp/util/asm-x64.h"
 #include "hphp/util/bitops.h"
@@ -86,7 +87,9 @@ typedef __sighandler_t *sighandler_t;
 #include "hphp/runtime/vm/type_profile.h"
 #include "hphp/runtime/vm/member_operations.h"
 #include "hphp/runtime/vm/jit/abi-x64.h"
+#include "hphp/runtime/vm/jit/compile-queue.h"
 #include "hphp/runtime/vm/jit/hhbctranslator.h"
+#include "hphp/runtime/vm/jit/prof-data.h"
 #include "hphp/runtime/vm/jit/region_selection.h"
 
 #include "hphp/runtime/vm/jit/translator-x64-internal.h"
@@ -587,6 +590,152 @@ TCA TranslatorX64::retranslate(const TranslArgs& args) {
   return translate(args);
 }
 
+/*
+ * Retranslate the function containing the profiling translation
+ * transId as a single region built from its profile, and make the
+ * result the first translation tried at the function entry.
+ *
+ * Returns nullptr if no new translation was made; the caller should
+ * keep using the profiling translations.  That includes the case where
+ * the work was handed to a compiler thread (see compile-queue.h).
+ */
+TCA TranslatorX64::retranslateOpt(TransID transId, bool align) {
+  LeaseHolder writer(s_writeLease);
+  if (!writer) {
+    // Try again later rather than on every entry.  The counters have
+    // their own lock, so this is safe without the lease.
+    m_profData->resetCounter(transId);
+    return nullptr;
+  }
+
+  auto const func = curFunc();
+  auto const funcId = func->getFuncId();
+  assert(m_profData->transRec(transId)->startSk.getFuncId() == funcId);
+
+  if (m_profData->optimized(funcId)) {
+    // Some other profiling translation at this entry got there first.
+    m_profData->disarmCounter(transId);
+    return nullptr;
+  }
+  if (!warmedUp()) {
+    m_profData->resetCounter(transId);
+    return nullptr;
+  }
+
+  // Whatever happens below, we only try this once per function.
+  m_profData->setOptimized(funcId);
+  m_profData->disarmCounter(transId);
+
+  if (enqueueRetranslateOpt(func, transId)) return nullptr;
+  return translateOpt(func, transId, align);
+}
+
+/*
+ * Pick the region retranslateOpt should compile for transId, or return
+ * nullptr if there shouldn't be one.  The caller must hold the write
+ * lease.
+ */
+JIT::RegionDescPtr TranslatorX64::selectOptRegion(const Func* func,
+                                                  TransID transId) {
+  assert(s_writeLease.amOwner());
+  auto const sk = m_profData->transRec(transId)->startSk;
+
+  if (isDebuggerAttachedProcess() && isSrcKeyInBL(func->unit(), sk)) {
+    SKTRACE(1, sk, "selectOptRegion abort due to debugger\n");
+    return nullptr;
+  }
+  if (getSrcRec(sk)->translations().size() >=
+        RuntimeOption::EvalJitMaxTranslations) {
+    return nullptr;
+  }
+
+  auto region = JIT::selectHotRegion(transId, *m_profData, func);
+  if (region) {
+    SKTRACE(1, sk, "selectOptRegion: %zu blocks\n", region->blocks.size());
+  }
+  return region;
+}
+
+TCA TranslatorX64::translateOpt(const Func* func, TransID transId,
+                                bool align) {
+  auto const region = selectOptRegion(func, transId);
+  if (!region) return nullptr;
+  auto const sk = region->blocks.front()->start();
+  return translate(TranslArgs(sk, align).region(region.get()));
+}
+
+/*
+ * Entry point for compiler threads.
+ *
+ * Only region selection and code generation happen under the write
+ * lease.  Building and optimizing the region's HHIR, which is most of
+ * the work, happens without it, so request threads and other compiler
+ * threads can translate in the meantime.
+ *
+ * There is no live frame for func on this thread, so, as in
+ * Translator::analyzeCallee, we translate against a fake one: an
+ * ActRec with no $this and uninitialized locals.  Nothing in the
+ * optimized region depends on it, since its type guards come from the
+ * profile.
+ */
+void TranslatorX64::retranslateOptWorker(const Func* func, TransID transId) {
+  // traceStart() needs the live generator stack for these.
+  if (func->isGenerator()) return;
+
+  JIT::RegionDescPtr region;
+  {
+    BlockingLeaseHolder writer(s_writeLease);
+    if (!writer) return;
+    region = selectOptRegion(func, transId);
+  }
+  if (!region) return;
+  auto const sk = region->blocks.front()->start();
+
+  auto const numSlots = func->numSlotsInFrame();
+  std::unique_ptr<Cell[]> frame(new Cell[numSlots + kNumActRecCells]);
+  for (int i = 0; i < numSlots; ++i) {
+    tvWriteUninit(&frame[i]);
+  }
+  auto const fakeAR = reinterpret_cast<ActRec*>(&frame[numSlots]);
+  fakeAR->m_savedRbp = 0;
+  fakeAR->m_savedRip = 0xbaabaa;  // should never be inspected
+  fakeAR->m_func = func;
+  fakeAR->m_soff = 0xb00b00;      // should never be inspected
+  fakeAR->initNumArgs(func->numParams());
+  fakeAR->m_varEnv = nullptr;
+  fakeAR->m_this = nullptr;
+
+  auto const oldFP = vmfp();
+  auto const oldSP = vmsp();
+  auto const oldPC = vmpc();
+  vmfp() = reinterpret_cast<Cell*>(fakeAR);
+  vmsp() = &frame[0];
+  vmpc() = func->unit()->at(sk.offset());
+  SCOPE_EXIT {
+    vmfp() = oldFP;
+    vmsp() = oldSP;
+    vmpc() = oldPC;
+    if (s_irFactory) traceFree();
+  };
+
+  traceStart(sk.offset());
+  try {
+    if (irGenRegion(*region) != Success) return;
+    traceOptimize();
+  } catch (const std::exception& e) {
+    FTRACE(1, "retranslateOptWorker: building {} failed with '{}'\n",
+           func->fullName()->data(), e.what());
+    return;
+  }
+
+  BlockingLeaseHolder writer(s_writeLease);
+  if (!writer) return;
+  TCA start DEBUG_ONLY =
+    translate(TranslArgs(sk, true).region(region.get()).prebuilt(true));
+  TRACE(1, "retranslateOptWorker: %s -> %p\n",
+        func->fullName()->data(), start);
+}
+
 // Only use comes from HHIR's cgExitTrace() case TraceExitType::SlowNoProgress
 TCA TranslatorX64::retranslateAndPatchNoIR(SrcKey sk,
                                            bool   align,
@@ -825,7 +974,20 @@ TranslatorX64::translate(const TranslArgs& args) {
     }
   }
 
-  AHotSelector ahs(this, curFunc()->attrs() & AttrHot);
+  bool hot = curFunc()->attrs() & AttrHot;
+  if (m_profData && RuntimeOption::EvalJitPGOOptimizedInAHot) {
+    // Put optimized region translations in ahot, and nothing else, in
+    // the order they are made.  Profiling translations are short-lived
+    // and stay out of it.
+    hot = args.m_region != nullptr;
+  }
+  AHotSelector ahs(this, hot);
+
+  TCA reused;
+  if (!hot && !args.m_prebuilt && reuseTC() &&
+      translateInFreeCode(args, reused)) {
+    return reused;
+  }
 
   if (args.m_align) {
     moveToAlign(a, kNonFallthroughAlign);
@@ -833,7 +995,9 @@ TranslatorX64::translate(const TranslArgs& args) {
 
   TCA start = a.code.frontier;
 
-  translateWork(args);
+  if (!translateWork(args)) {
+    return nullptr;
+  }
 
   SKTRACE(1, args.m_sk, "translate moved head from %p to %p\n",
           getTopTranslation(args.m_sk), start);
@@ -1843,7 +2007,7 @@ TranslatorX64::emitCondJmp(SrcKey skTaken, SrcKey skNotTaken,
                  old,
                  uint64_t(skTaken.offset()),
                  uint64_t(skNotTaken.offset()),
-                 uint64_t(cc));
+                 packJccFirstArg(cc, kInvalidOffset));
 
   a.jcc(cc, stub); // MUST use 4-byte immediate form
   a.jmp(stub); // MUST use 4-byte immediate form
@@ -1898,18 +2062,32 @@ TranslatorX64::bindJmp(TCA toSmash, SrcKey destSk,
  *              j<CC> stubJmpccSecond:offTaken
  *              nop5
  * offNotTaken:
+ *
+ * If warmup recorded enough executions of the branch at offJmp, its
+ * profile predicts better than one execution does, and the side it
+ * favors is laid out as the fallthrough.  When that isn't the side this execution
+ * took, we continue through the stubJmpccSecond stub, which translates
+ * the other side and patches the branch to it.
  */
 TCA
 TranslatorX64::bindJmpccFirst(TCA toSmash,
                               Offset offTaken, Offset offNotTaken,
+                              Offset offJmp,
                               bool taken,
                               ConditionCode cc,
                               bool& smashed) {
   const Func* f = curFunc();
   LeaseHolder writer(s_writeLease);
   if (!writer) return nullptr;
-  Offset offWillExplore = taken ? offTaken : offNotTaken;
-  Offset offWillDefer = taken ? offNotTaken : offTaken;
+  bool layoutTaken = taken;
+  if (offJmp != kInvalidOffset) {
+    double pTaken = predictBranchTaken(f, offJmp);
+    if (pTaken >= 0) {
+      layoutTaken = pTaken >= 0.5;
+    }
+  }
+  Offset offWillExplore = layoutTaken ? offTaken : offNotTaken;
+  Offset offWillDefer = layoutTaken ? offNotTaken : offTaken;
   SrcKey dest(f, offWillExplore);
   TRACE(3, "bindJmpccFirst: explored %d, will defer %d; overwriting cc%02x "
         "taken %d\n",
@@ -1917,7 +2095,7 @@ TranslatorX64::bindJmpccFirst(TCA toSmash,
 
   // We want the branch to point to whichever side has not been explored
   // yet.
-  if (taken) cc = ccNegate(cc);
+  if (layoutTaken) cc = ccNegate(cc);
   TCA stub =
     emitServiceReq(SRFlags::None, REQ_BIND_JMPCC_SECOND, 3,
                    toSmash, uint64_t(offWillDefer), uint64_t(cc));
@@ -1955,7 +2133,7 @@ TranslatorX64::bindJmpccFirst(TCA toSmash,
   as.jcc(cc, stub);
   getSrcRec(dest)->chainFrom(IncomingBranch::jmpFrom(as.code.frontier));
   TRACE(5, "bindJmpccFirst: overwrote with cc%02x taken %d\n", cc, taken);
-  return tDest;
+  return layoutTaken == taken ? tDest : stub;
 }
 
 // smashes a jcc to point to a new destination
@@ -2102,7 +2280,7 @@ TranslatorX64::checkRefs(X64Assembler& a,
 
     int entryArDelta = it->first;
 
-    m_hhbcTrans->guardRefs(entryArDelta,
+    s_hhbcTrans->guardRefs(entryArDelta,
                            it->second.m_mask,
                            it->second.m_vals);
   }
@@ -2405,9 +2583,10 @@ bool TranslatorX64::handleServiceRequest(TReqInfo& info,
     TCA toSmash = (TCA)args[0];
     Offset offTaken = (Offset)args[1];
     Offset offNotTaken = (Offset)args[2];
-    ConditionCode cc = ConditionCode(args[3]);
+    ConditionCode cc = jccFirstArgCC(args[3]);
+    Offset offJmp = jccFirstArgOffset(args[3]);
     bool taken = int64_t(args[4]) & 1;
-    start = bindJmpccFirst(toSmash, offTaken, offNotTaken,
+    start = bindJmpccFirst(toSmash, offTaken, offNotTaken, offJmp,
                            taken, cc, smashed);
     // SrcKey: we basically need to emulate the fail
     sk = SrcKey(curFunc(), taken ? offTaken : offNotTaken);
@@ -2435,6 +2614,16 @@ bool TranslatorX64::handleServiceRequest(TReqInfo& info,
     SKTRACE(2, sk, "retranslated @%p\n", start);
   } break;
 
+  case REQ_RETRANSLATE_OPT: {
+    sk = SrcKey(curFunc(), (Offset)args[0]);
+    start = retranslateOpt((TransID)args[1], true);
+    SKTRACE(2, sk, "retranslated-OPT @%p\n", start);
+    if (!start) {
+      // Keep running the profiling translations.
+      start = getTranslation(TranslArgs(sk, true));
+    }
+  } break;
+
   case REQ_INTERPRET: {
     Offset off = args[0];
     int numInstrs = args[1];
@@ -2554,6 +2743,174 @@ TCA TranslatorX64::getFreeStub() {
   return ret;
 }
 
+void FreeCodeList::push(TCA start, size_t len) {
+  assert(len);
+  m_bytes += len;
+  auto next = m_ranges.lower_bound(start);
+  if (next != m_ranges.end() && start + len == next->first) {
+    len += next->second;
+    next = m_ranges.erase(next);
+  }
+  if (next != m_ranges.begin()) {
+    auto prev = std::prev(next);
+    assert(prev->first + prev->second <= start);
+    if (prev->first + prev->second == start) {
+      prev->second += len;
+      return;
+    }
+  }
+  m_ranges.insert(next, std::make_pair(start, len));
+}
+
+bool FreeCodeList::popLargest(size_t minLen, TCA& start, size_t& len) {
+  auto best = m_ranges.end();
+  for (auto it = m_ranges.begin(); it != m_ranges.end(); ++it) {
+    if (it->second >= minLen &&
+        (best == m_ranges.end() || it->second > best->second)) {
+      best = it;
+    }
+  }
+  if (best == m_ranges.end()) return false;
+  start = best->first;
+  len = best->second;
+  m_bytes -= len;
+  m_ranges.erase(best);
+  return true;
+}
+
+class ReclaimCodeTrigger : public Treadmill::WorkItem {
+  std::vector<std::pair<TCA,size_t>> m_ranges;
+ public:
+  explicit ReclaimCodeTrigger(std::vector<std::pair<TCA,size_t>>&& ranges)
+    : m_ranges(std::move(ranges)) {
+    TRACE(3, "ReclaimCodeTrigger @ %p, %zd ranges\n", this, m_ranges.size());
+  }
+  virtual void operator()() {
+    TRACE(3, "ReclaimCodeTrigger: Firing @ %p\n", this);
+    if (!TranslatorX64::Get()->reclaimDeadCode(m_ranges)) {
+      // Couldn't get the write lease; retry.
+      enqueue(new ReclaimCodeTrigger(std::move(m_ranges)));
+    }
+  }
+};
+
+bool TranslatorX64::reuseTC() const {
+  // Translations are only ever invalidated outside RepoAuthoritative
+  // mode.
+  return RuntimeOption::EvalJitReuseTC && !RuntimeOption::RepoAuthoritative;
+}
+
+/*
+ * Called after invalidating a batch of SrcKeys: once every request
+ * that might still be running the dead translations has finished,
+ * their code can be reused.
+ */
+void TranslatorX64::retireDeadCode() {
+  assert(s_writeLease.amOwner());
+  if (m_deadCode.empty()) return;
+  TRACE(1, "retiring %zd dead translations\n", m_deadCode.size());
+  Treadmill::WorkItem::enqueue(new ReclaimCodeTrigger(std::move(m_deadCode)));
+  m_deadCode.clear();
+}
+
+bool TranslatorX64::reclaimDeadCode(
+    const std::vector<std::pair<TCA,size_t>>& ranges) {
+  LeaseHolder writer(s_writeLease);
+  if (!writer) return false;
+
+  std::map<TCA,size_t> dead(ranges.begin(), ranges.end());
+  auto isDead = [&](CTCA addr) {
+    auto it = dead.upper_bound(const_cast<TCA>(addr));
+    if (it == dead.begin()) return false;
+    --it;
+    return addr < it->first + it->second;
+  };
+
+  // Nothing may patch the dead code or unwind through it once it is
+  // reused, so drop the branches it registered with other SrcRecs and
+  // its fixups and catch traces.
+  for (auto& ent : m_srcDB) {
+    ent.second->forgetBranchesFrom(isDead);
+  }
+  m_fixupMap.forgetIf(isDead);
+  for (auto& ent : m_catchTraceMap) {
+    if (isDead(ent.first)) ent.second = nullptr;
+  }
+
+  // Nor should anything that looks up translations by address find the
+  // dead ones: drop them from the TransDB and the gdb symbols.
+  for (auto const& range : dead) {
+    m_transDB.erase(m_transDB.lower_bound(range.first),
+                    m_transDB.lower_bound(range.first + range.second));
+    if (!RuntimeOption::EvalJitNoGdb) {
+      m_debugInfo.forgetRange(Debug::TCRange(range.first,
+                                             range.first + range.second,
+                                             false));
+    }
+    m_freeCode.push(range.first, range.second);
+  }
+  TRACE(1, "reclaimed %zd translations, %zd bytes of free code\n",
+        ranges.size(), m_freeCode.bytes());
+  return true;
+}
+
+void TranslatorX64::forgetCatchTraces(TCA start, size_t len) {
+  for (auto& ent : m_catchTraceMap) {
+    if (ent.first >= start && ent.first < start + len) ent.second = nullptr;
+  }
+}
+
+/*
+ * Try to emit the translation for args into a block of reclaimed code
+ * space.  Returns false if there was no big enough block or the
+ * translation didn't fit in it; nothing was emitted then and the
+ * caller should translate at the main frontier.  Otherwise result is
+ * what translate() should return.
+ */
+bool TranslatorX64::translateInFreeCode(const TranslArgs& args,
+                                        TCA& result) {
+  TCA blockStart;
+  size_t blockLen;
+  auto const minBlock =
+    std::max<size_t>(RuntimeOption::EvalJitReuseTCMinBlock,
+                     2 * kFreeCodeSlack);
+  if (!m_freeCode.popLargest(minBlock, blockStart, blockLen)) {
+    return false;
+  }
+
+  TCA frontier = nullptr;
+  bool translated = false;
+  try {
+    FreeCodeSelector fcs(this, blockStart, blockLen);
+    if (args.m_align) {
+      moveToAlign(a, kNonFallthroughAlign);
+    }
+    result = a.code.frontier;
+    translated = translateWork(args);
+    frontier = a.code.frontier;
+  } catch (const DataBlockFull&) {
+    TRACE(1, "translation didn't fit in %zd free bytes at %p\n",
+          blockLen, blockStart);
+    // Failed attempts may have registered catch traces in the block.
+    forgetCatchTraces(blockStart, blockLen);
+    m_freeCode.push(blockStart, blockLen);
+    return false;
+  }
+
+  if (!translated) {
+    result = nullptr;
+    frontier = blockStart;
+  } else {
+    Stats::inc(Stats::TC_Reused);
+  }
+  auto const blockEnd = blockStart + blockLen;
+  if (frontier < blockEnd) {
+    forgetCatchTraces(frontier, blockEnd - frontier);
+    m_freeCode.push(frontier, blockEnd - frontier);
+  }
+  return true;
+}
+
 /*
  * RAII bookmark for temporarily rewinding a.code.frontier.
  */
@@ -3206,13 +3563,13 @@ void dumpTranslationInfo(const Tracelet& t, TCA postGuards) {
   }
 }
 
-void
+bool
 TranslatorX64::translateWork(const TranslArgs& args) {
   auto sk = args.m_sk;
   std::unique_ptr<Tracelet> tp = analyze(sk);
   Tracelet& t = *tp;
-  m_curTrace = &t;
-  Nuller<Tracelet> ctNuller(&m_curTrace);
+  s_curTrace = &t;
+  Nuller<Tracelet> ctNuller(&s_curTrace);
 
   SKTRACE(1, sk, "translateWork\n");
   assert(m_srcDB.find(sk));
@@ -3224,6 +3581,14 @@ TranslatorX64::translateWork(const TranslArgs& args) {
   SrcRec&                 srcRec = *getSrcRec(sk);
   TransKind               transKind = TransInterp;
 
+  // Under EvalJitPGO, functions get profiling translations until
+  // retranslateOpt replaces them with an optimized region.
+  JIT::RegionDescPtr profRegion;
+  if (m_profData && !args.m_region &&
+      !m_profData->optimized(sk.getFuncId())) {
+    profRegion = JIT::createRegion(t);
+  }
+
   auto resetState = [&] {
     a.code.frontier = start;
     astubs.code.frontier = stubStart;
@@ -3240,25 +3605,47 @@ TranslatorX64::translateWork(const TranslArgs& args) {
     assert(srcRec.inProgressTailJumps().empty());
   };
 
-  if (!args.m_interp && !checkTranslationLimit(t.m_sk, srcRec)) {
-    // Attempt to create a region at this SrcKey
-    JIT::RegionContext rContext { curFunc(), args.m_sk.offset() };
-    FTRACE(2, "populating live context for region\n");
-    populateLiveContext(rContext);
-    auto region = JIT::selectRegion(rContext, &t);
+  // Running out of room in reclaimed code space (see FreeCodeSelector
+  // and checkFreeCodeRoom) throws DataBlockFull out of here; leave
+  // things as we found them.
+  auto fullGuard = folly::makeGuard([&] {
+    if (s_irFactory) traceFree();
+    resetState();
+  });
+
+  bool const atLimit = !args.m_interp && !args.m_region &&
+    checkTranslationLimit(t.m_sk, srcRec);
+  if (!args.m_interp && !atLimit) {
+    JIT::RegionDescPtr selected;
+    if (!args.m_region && !profRegion) {
+      // Attempt to create a region at this SrcKey
+      JIT::RegionContext rContext { curFunc(), args.m_sk.offset() };
+      FTRACE(2, "populating live context for region\n");
+      populateLiveContext(rContext);
+      selected = JIT::selectRegion(rContext, &t);
+    }
+    auto const region = args.m_region ? args.m_region : selected.get();
+    bool regionTranslated = false;
 
     TranslateResult result = Retry;
     while (result == Retry) {
-      traceStart(sk.offset());
+      if (!args.m_prebuilt) traceStart(sk.offset());
 
       // Try translating a region if we have one, then fall back to using the
       // Tracelet.
       if (region) {
         try {
           assertCleanState();
-          result = translateRegion(*region);
+          if (args.m_prebuilt) {
+            traceEmit();
+            result = Success;
+          } else {
+            result = translateRegion(*region);
+          }
           FTRACE(2, "translateRegion finished with result {}\n",
                  translateResultName(result));
+        } catch (const DataBlockFull&) {
+          throw;
         } catch (const std::exception& e) {
           FTRACE(1, "translateRegion failed with '{}'\n", e.what());
           result = Failure;
@@ -3268,11 +3655,13 @@ TranslatorX64::translateWork(const TranslArgs& args) {
           traceStart(sk.offset());
           resetState();
         }
+        regionTranslated = result == Success;
       }
-      if (!region || result == Failure) {
+      if (!region || (result == Failure && !args.m_region)) {
         FTRACE(1, "trying irTranslateTracelet\n");
         assertCleanState();
-        result = irTranslateTracelet(*tp);
+        result = irTranslateTracelet(*tp, profRegion ? TransProfile
+                                                     : TransNormalIR);
       }
 
       if (result != Success) {
@@ -3285,23 +3674,44 @@ TranslatorX64::translateWork(const TranslArgs& args) {
 
     if (result == Success) {
       // Translation succeeded. Mark it as such.
-      transKind = TransNormalIR;
+      transKind = args.m_region && regionTranslated ? TransOptimize :
+                  profRegion                        ? TransProfile  :
+                                                      TransNormalIR;
     }
   }
 
+  if (args.m_region && transKind == TransInterp) {
+    // Optimized retranslation failed; keep the profiling translations.
+    assertCleanState();
+    fullGuard.dismiss();
+    return false;
+  }
+
   if (transKind == TransInterp) {
     assertCleanState();
+    /*
+     * If the chain is full because the types at sk keep changing, only
+     * bail out to the interpreter for the first instruction.  The state
+     * it leaves behind is the VM state, so the JIT can pick up again at
+     * the next instruction with guards specialized to whatever types
+     * are live there, instead of interpreting the whole tracelet every
+     * time this polymorphic entry is reached.
+     */
+    auto const numInstrs =
+      atLimit && RuntimeOption::EvalJitLimitBailout ? 1 : t.m_numOpcodes;
     TRACE(1,
           "emitting %d-instr interp request for failed translation\n",
-          int(t.m_numOpcodes));
+          int(numInstrs));
+    checkFreeCodeRoom();
     // Add a counter for the translation if requested
     if (RuntimeOption::EvalJitTransCounters) {
       emitTransCounterInc(a);
     }
     a.    jmp(emitServiceReq(REQ_INTERPRET, 2ull, uint64_t(t.m_sk.offset()),
-                             uint64_t(t.m_numOpcodes)));
+                             uint64_t(numInstrs)));
     // Fall through.
   }
+  fullGuard.dismiss();
 
   for (uint i = 0; i < m_pendingFixups.size(); i++) {
     TCA tca = m_pendingFixups[i].m_tca;
@@ -3321,16 +3731,29 @@ TranslatorX64::translateWork(const TranslArgs& args) {
                        false, false);
   recordGdbTranslation(sk, curFunc(), astubs, stubStart,
                        false, false);
+  if (transKind == TransProfile) {
+    m_profData->addProfTrans(*profRegion);
+  }
+
   // SrcRec::newTranslation() makes this code reachable. Do this last;
   // otherwise there's some chance of hitting in the reader threads whose
   // metadata is not yet visible.
+  if (reuseTC()) {
+    m_transSizes[start] = a.code.frontier - start;
+  }
+
   TRACE(1, "newTranslation: %p  sk: (func %d, bcOff %d)\n",
       start, sk.getFuncId(), sk.offset());
-  srcRec.newTranslation(start);
+  if (transKind == TransOptimize) {
+    srcRec.prependTranslation(start);
+  } else {
+    srcRec.newTranslation(start);
+  }
   TRACE(1, "tx64: %zd-byte tracelet\n", a.code.frontier - start);
   if (Trace::moduleEnabledRelease(Trace::tcspace, 1)) {
     Trace::traceRelease(getUsage().c_str());
   }
+  return true;
 }
 
 /*
@@ -3408,12 +3831,14 @@ asm_label(a, loopHead);
 }
 
 TranslatorX64::TranslatorX64()
-: m_numNativeTrampolines(0),
+: m_displacedA(nullptr),
+  m_numNativeTrampolines(0),
   m_trampolineSize(0),
   m_defClsHelper(0),
   m_funcPrologueRedispatch(0),
   m_numHHIRTrans(0),
-  m_catchTraceMap(128)
+  m_catchTraceMap(128),
+  m_inFreeCode(false)
 {
   static const size_t kRoundUp = 2 << 20;
   const size_t kAHotSize = RuntimeOption::VMTranslAHotSize;
@@ -3702,6 +4127,13 @@ TCA TranslatorX64::emitUnaryStub(X64Assembler& a, CppCall c) {
 
 void TranslatorX64::registerCatchTrace(CTCA ip, TCA trace) {
   FTRACE(1, "registerCatchTrace: afterCall: {} trace: {}\n", ip, trace);
+  // Code emitted into reclaimed space may have a call returning to an
+  // address that had a catch trace before; it was forgotten when the
+  // space was reclaimed, so just replace it.
+  if (TCA* old = m_catchTraceMap.find(ip)) {
+    *old = trace;
+    return;
+  }
   m_catchTraceMap.insert(ip, trace);
 }
 
@@ -3856,16 +4288,19 @@ std::string TranslatorX64::getUsage() {
   size_t tcUsage = TargetCache::s_frontier;
   size_t persistentUsage =
     TargetCache::s_persistent_frontier - TargetCache::s_persistent_start;
+  size_t freeUsage = m_freeCode.bytes();
   Util::string_printf(
     usage,
     "tx64: %9zd bytes (%" PRId64 "%%) in ahot.code\n"
     "tx64: %9zd bytes (%" PRId64 "%%) in a.code\n"
+    "tx64: %9zd bytes (%" PRId64 "%%) reclaimed in a.code\n"
     "tx64: %9zd bytes (%" PRId64 "%%) in astubs.code\n"
     "tx64: %9zd bytes (%" PRId64 "%%) in m_globalData\n"
     "tx64: %9zd bytes (%" PRId64 "%%) in targetCache\n"
     "tx64: %9zd bytes (%" PRId64 "%%) in persistentCache\n",
     aHotUsage,  100 * aHotUsage / ahot.code.size,
     aUsage,     100 * aUsage / a.code.size,
+    freeUsage,  100 * freeUsage / a.code.size,
     stubsUsage, 100 * stubsUsage / astubs.code.size,
     dataUsage, 100 * dataUsage / m_globalData.size,
     tcUsage,
@@ -4062,9 +4497,19 @@ void TranslatorX64::invalidateSrcKey(SrcKey sk) {
   assert(sr);
   /*
    * Since previous translations aren't reachable from here, we know we
-   * just created some garbage in the TC. We currently have no mechanism
-   * to reclaim this.
+   * just created some garbage in the TC.  Under EvalJitReuseTC we hand
+   * their main code to retireDeadCode for reuse; anything in astubs
+   * stays, since freed request stubs may live in the middle of it.
+   * Debugger guards are patched in place, so leave those alone.
    */
+  if (reuseTC() && !sr->hasDebuggerGuard()) {
+    for (auto tca : sr->translations()) {
+      auto it = m_transSizes.find(tca);
+      if (it == m_transSizes.end()) continue;
+      m_deadCode.push_back(*it);
+      m_transSizes.erase(it);
+    }
+  }
   sr->replaceOldTranslations();
 }
 
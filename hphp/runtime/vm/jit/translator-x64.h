@@ -17,6 +17,7 @@
 #define incl_HPHP_RUNTIME_VM_TRANSLATOR_X64_H_
 
 #include <signal.h>
+#include <map>
 #include <memory>
 #include <boost/noncopyable.hpp>
 
@@ -28,6 +29,7 @@
 #include "hphp/util/ringbuffer.h"
 #include "hphp/runtime/vm/debug/debug.h"
 #include "hphp/runtime/vm/jit/abi-x64.h"
+#include "hphp/runtime/vm/jit/region_selection.h"
 
 namespace HPHP { class ExecutionContext; }
 
@@ -65,6 +67,21 @@ struct FreeStubList {
   void push(TCA stub);
 };
 
+/*
+ * Main code space of invalidated translations that no thread can be
+ * running anymore, kept as disjoint ranges with adjacent ones
+ * coalesced.  Only touched while holding the write lease.
+ */
+struct FreeCodeList {
+  FreeCodeList() : m_bytes(0) {}
+  void push(TCA start, size_t len);
+  bool popLargest(size_t minLen, TCA& start, size_t& len);
+  size_t bytes() const { return m_bytes; }
+ private:
+  std::map<TCA,size_t> m_ranges;
+  size_t m_bytes;
+};
+
 struct CppCall {
   explicit CppCall(void *p) : m_kind(Direct), m_fptr(p) {}
   explicit CppCall(int off) : m_kind(Virtual), m_offset(off) {}
@@ -100,6 +117,8 @@ typedef X64Assembler Asm;
 
 constexpr size_t kJmpTargetAlign = 16;
 constexpr size_t kNonFallthroughAlign = 64;
+// Room checkFreeCodeRoom insists on before each IR instruction.
+constexpr size_t kFreeCodeSlack = 1024;
 constexpr int kJmpLen = 5;
 constexpr int kCallLen = 5;
 constexpr int kJmpccLen = 6;
@@ -113,6 +132,21 @@ constexpr int kTestImmRegLen = 5;  // only for rax -- special encoding
 constexpr size_t kX64CacheLineSize = 64;
 constexpr size_t kX64CacheLineMask = kX64CacheLineSize - 1;
 
+/*
+ * REQ_BIND_JMPCC_FIRST uses all five service request argument registers,
+ * so its condition code shares a word with the offset of the JmpZ/JmpNZ
+ * it was emitted for (kInvalidOffset if there isn't one).
+ */
+inline uint64_t packJccFirstArg(ConditionCode cc, Offset jmpOff) {
+  return uint32_t(cc) | uint64_t(uint32_t(jmpOff)) << 32;
+}
+inline ConditionCode jccFirstArgCC(uint64_t arg) {
+  return ConditionCode(uint32_t(arg));
+}
+inline Offset jccFirstArgOffset(uint64_t arg) {
+  return Offset(int32_t(arg >> 32));
+}
+
 enum class TestAndSmashFlags {
   kAlignJccImmediate,
   kAlignJcc,
@@ -144,24 +178,59 @@ class TranslatorX64 : public Translator
       if (m_hot) {
         m_save = tx->a;
         tx->a = tx->ahot;
+        m_prevDisplaced = tx->m_displacedA;
+        tx->m_displacedA = &m_save;
       }
     }
     ~AHotSelector() {
       if (m_hot) {
         m_tx->ahot = m_tx->a;
         m_tx->a = m_save;
+        m_tx->m_displacedA = m_prevDisplaced;
       }
     }
    private:
     TranslatorX64* m_tx;
     Asm            m_save;
+    Asm*           m_prevDisplaced;
     bool           m_hot;
   };
 
+  /*
+   * Points a at a block of reclaimed code space (see m_freeCode) for
+   * the duration of one translation.
+   */
+  class FreeCodeSelector {
+   public:
+    FreeCodeSelector(TranslatorX64* tx, TCA start, size_t len)
+        : m_tx(tx)
+        , m_save(tx->a)
+        , m_prevDisplaced(tx->m_displacedA) {
+      assert(!tx->m_inFreeCode);
+      tx->a.code.init(start, len);
+      tx->a.code.bounded = true;
+      tx->m_displacedA = &m_save;
+      tx->m_inFreeCode = true;
+    }
+    ~FreeCodeSelector() {
+      m_tx->a = m_save;
+      m_tx->m_displacedA = m_prevDisplaced;
+      m_tx->m_inFreeCode = false;
+    }
+   private:
+    TranslatorX64* m_tx;
+    Asm            m_save;
+    Asm*           m_prevDisplaced;
+  };
+
   Asm                    ahot;
   Asm                    a;
   Asm                    astubs;
   Asm                    atrampolines;
+  // The main code assembler while a is temporarily pointed elsewhere
+  // by an AHotSelector or FreeCodeSelector, so its code can still be
+  // patched.
+  Asm*                   m_displacedA;
   PointerMap             trampolineMap;
   int                    m_numNativeTrampolines;
   size_t                 m_trampolineSize; // size of each trampoline
@@ -189,6 +258,8 @@ class TranslatorX64 : public Translator
   uint64_t               m_numHHIRTrans;
 
   virtual void traceCodeGen();
+  void traceOptimize();
+  void traceEmit();
 
   FixupMap                   m_fixupMap;
   UnwindInfoHandle           m_unwindRegistrar;
@@ -212,7 +283,12 @@ private:
   void drawCFG(std::ofstream& out) const;
   static vector<PhysReg> x64TranslRegs();
 
-  Asm& getAsmFor(TCA addr) { return asmChoose(addr, a, ahot, astubs); }
+  Asm& getAsmFor(TCA addr) {
+    if (m_displacedA && m_displacedA->code.isValidAddress(addr)) {
+      return *m_displacedA;
+    }
+    return asmChoose(addr, a, ahot, astubs);
+  }
   void emitIncRef(X64Assembler &a, PhysReg base, DataType dtype);
   void emitIncRef(PhysReg base, DataType);
   void emitIncRefGenericRegSafe(PhysReg base, int disp, PhysReg tmp);
@@ -281,6 +357,7 @@ private:
     for (typename T::const_iterator i = keys.begin(); i != keys.end(); ++i) {
       invalidateSrcKey(*i);
     }
+    retireDeadCode();
   }
 
   void registerCatchTrace(CTCA ip, TCA trace);
@@ -352,8 +429,27 @@ public:
   FreeStubList m_freeStubs;
   bool freeRequestStub(TCA stub);
   TCA getFreeStub();
+
+  /*
+   * Reuse of the main code space of invalidated translations, under
+   * EvalJitReuseTC.  invalidateSrcKey moves the ranges of the dead
+   * translations to m_deadCode; once the Treadmill says no request
+   * can still be running them, reclaimDeadCode forgets everything that
+   * refers to them and hands them to m_freeCode, which translate()
+   * tries before growing the main code frontier.
+   */
+  FreeCodeList m_freeCode;
+  bool m_inFreeCode;  // a points into m_freeCode, see FreeCodeSelector
+  hphp_hash_map<TCA,size_t> m_transSizes;
+  std::vector<std::pair<TCA,size_t>> m_deadCode;
+  bool reuseTC() const;
+  bool translateInFreeCode(const TranslArgs& args, TCA& result);
+  void retireDeadCode();
+  bool reclaimDeadCode(const std::vector<std::pair<TCA,size_t>>& ranges);
+  void forgetCatchTraces(TCA start, size_t len);
   bool checkTranslationLimit(SrcKey, const SrcRec&) const;
-  TranslateResult irTranslateTracelet(Tracelet& t);
+  TranslateResult irTranslateTracelet(Tracelet& t,
+                                      TransKind kind = TransNormalIR);
 
   void irAssertType(const Location& l, const RuntimeType& rtt);
   void checkType(Asm&, const Location& l, const RuntimeType& rtt,
@@ -419,16 +515,19 @@ public:
   TCA createTranslation(const TranslArgs& args);
   TCA retranslate(const TranslArgs& args);
   TCA translate(const TranslArgs& args);
-  void translateWork(const TranslArgs& args);
+  bool translateWork(const TranslArgs& args);
 
   TCA lookupTranslation(SrcKey sk) const;
   TCA retranslateOpt(TransID transId, bool align);
+  TCA translateOpt(const Func* func, TransID transId, bool align);
+  JIT::RegionDescPtr selectOptRegion(const Func* func, TransID transId);
   TCA retranslateAndPatchNoIR(SrcKey sk,
                               bool   align,
                               TCA    toSmash);
   TCA bindJmp(TCA toSmash, SrcKey dest, ServiceRequest req, bool& smashed);
   TCA bindJmpccFirst(TCA toSmash,
                      Offset offTrue, Offset offFalse,
+                     Offset offJmp,
                      bool toTake,
                      ConditionCode cc,
                      bool& smashed);
@@ -461,6 +560,8 @@ public:
   TCA emitNativeTrampoline(TCA helperAddress);
 
 public:
+  void retranslateOptWorker(const Func* func, TransID transId);
+
   /*
    * enterTC is the main entry point for the translator from the
    * bytecode interpreter (see enterVMWork).  It operates on behalf of
@@ -531,6 +632,20 @@ private:
 public: // Only for HackIR
   void emitReqRetransNoIR(Asm& as, const SrcKey& sk);
 
+  /*
+   * Reclaimed code space can't grow.  FreeCodeSelector marks it
+   * bounded, so any write that doesn't fit throws DataBlockFull and
+   * translateInFreeCode retries at the main frontier.  Code generation
+   * also calls this between IR instructions to give up early, before
+   * most of a translation that won't fit has been emitted, once less
+   * than kFreeCodeSlack bytes are left.
+   */
+  void checkFreeCodeRoom() {
+    if (UNLIKELY(m_inFreeCode) && !a.code.canEmit(kFreeCodeSlack)) {
+      throw DataBlockFull();
+    }
+  }
+
 private:
   // asize + astubssize + gdatasize + trampolinesblocksize
   size_t m_totalSize;
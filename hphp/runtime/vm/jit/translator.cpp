@@ -42,6 +42,7 @@
 #include "hphp/runtime/vm/jit/annotation.h"
 #include "hphp/runtime/vm/jit/hhbctranslator.h"
 #include "hphp/runtime/vm/jit/irfactory.h"
+#include "hphp/runtime/vm/jit/prof-data.h"
 #include "hphp/runtime/vm/jit/region_selection.h"
 #include "hphp/runtime/vm/jit/targetcache.h"
 #include "hphp/runtime/vm/jit/translator-inline.h"
@@ -726,6 +727,19 @@ predictOutputs(const Tracelet& t,
   } else if (hasImmVector(ni->op())) {
     pred = predictMVec(ni);
   }
+  if (pred.second < kAccept) {
+    // Per-instruction profile; calls are recorded at their return offset.
+    auto sk = ni->source;
+    if (isFCallStar(ni->op())) sk.advance(curUnit());
+    auto const instrPred = predictInstrType(curFunc(), sk.offset());
+    if (instrPred.second > pred.second) {
+      pred = instrPred;
+      TRACE(1, "prediction for instruction at %d: %d, %f\n",
+            ni->source.offset(),
+            pred.first,
+            pred.second);
+    }
+  }
   if (debug && pred.second < kAccept) {
     if (const StringData* invName = fcallToFuncName(ni)) {
       pred = predictType(TypeProfileKey(TypeProfileKey::MethodName, invName));
@@ -3034,7 +3048,8 @@ static bool shouldAnalyzeCallee(const NormalizedInstruction* fcall,
 
 extern bool shouldIRInline(const Func* curFunc,
                            const Func* func,
-                           const Tracelet& callee);
+                           const Tracelet& callee,
+                           Offset callOff);
 
 void Translator::analyzeCallee(TraceletContext& tas,
                                Tracelet& parent,
@@ -3155,7 +3170,8 @@ void Translator::analyzeCallee(TraceletContext& tas,
    * (potentially increasing the specificity of guards), and we don't
    * want to do that unnecessarily.
    */
-  if (!shouldIRInline(callerFunc, target, *subTrace)) {
+  if (!shouldIRInline(callerFunc, target, *subTrace,
+                      fcall->source.offset())) {
     if (UNLIKELY(Stats::enabledAny() && getenv("HHVM_STATS_FAILEDINL"))) {
       subTrace->m_inliningFailed = true;
       // Save the trace for stats purposes but don't waste time doing any
@@ -3545,14 +3561,20 @@ breakBB:
   return retval;
 }
 
+__thread const Tracelet* Translator::s_curTrace;
+__thread const NormalizedInstruction* Translator::s_curNI;
+__thread JIT::IRFactory* Translator::s_irFactory;
+__thread JIT::HhbcTranslator* Translator::s_hhbcTrans;
+
 Translator::Translator()
-  : m_curTrace(nullptr)
-  , m_curNI(nullptr)
-  , m_resumeHelper(nullptr)
+  : m_resumeHelper(nullptr)
   , m_createdTime(Timer::GetCurrentTimeMicros())
   , m_analysisDepth(0)
 {
   initInstrInfo();
+  if (RuntimeOption::EvalJitPGO) {
+    m_profData.reset(new JIT::ProfData());
+  }
 }
 
 Translator::~Translator() {
@@ -3626,7 +3648,7 @@ const char* Translator::translateResultName(TranslateResult r) {
 
 /*
  * Similar to applyInputMetaData, but designed to be used during ir
- * generation. Reads and writes types of values using m_hhbcTrans. This will
+ * generation. Reads and writes types of values using s_hhbcTrans. This will
  * eventually replace applyInputMetaData.
  */
 void Translator::readMetaData(Unit::MetaHandle& handle,
@@ -3672,7 +3694,7 @@ void Translator::readMetaData(Unit::MetaHandle& handle,
       base + (info.m_arg & ~Unit::MetaInfo::VectorArg) : info.m_arg;
     auto updateType = [&]{
       auto& input = *inst.inputs[arg];
-      input.rtt = m_hhbcTrans->rttFromLocation(input.location);
+      input.rtt = s_hhbcTrans->rttFromLocation(input.location);
     };
 
     switch (info.m_kind) {
@@ -3693,20 +3715,20 @@ void Translator::readMetaData(Unit::MetaHandle& handle,
         // These 'predictions' mean the type is InitNull or the predicted type,
         // so we assert InitNull | t, then guard t. This allows certain
         // optimizations in the IR.
-        m_hhbcTrans->assertTypeLocation(loc, Type::InitNull | t);
-        m_hhbcTrans->checkTypeLocation(loc, t, offset);
+        s_hhbcTrans->assertTypeLocation(loc, Type::InitNull | t);
+        s_hhbcTrans->checkTypeLocation(loc, t, offset);
         updateType();
         break;
       }
       case Unit::MetaInfo::Kind::DataTypeInferred: {
-        m_hhbcTrans->assertTypeLocation(
+        s_hhbcTrans->assertTypeLocation(
           inst.inputs[arg]->location,
           Type::fromDataType(DataType(info.m_data)));
         updateType();
         break;
       }
       case Unit::MetaInfo::Kind::String: {
-        m_hhbcTrans->assertString(inst.inputs[arg]->location,
+        s_hhbcTrans->assertString(inst.inputs[arg]->location,
                                   inst.unit()->lookupLitstrId(info.m_data));
         updateType();
         break;
@@ -3777,7 +3799,20 @@ static Location toLocation(const RegionDesc::Location& loc) {
 
 Translator::TranslateResult
 Translator::translateRegion(const RegionDesc& region) {
-  FTRACE(1, "translateRegion starting with:\n{}\n", show(region));
+  auto const result = irGenRegion(region);
+  if (result != Success) return result;
+  traceCodeGen();
+  return Success;
+}
+
+/*
+ * The part of translateRegion that doesn't touch the translation cache:
+ * emit HHIR for region into the trace set up by traceStart().  This
+ * doesn't need the write lease.
+ */
+Translator::TranslateResult
+Translator::irGenRegion(const RegionDesc& region) {
+  FTRACE(1, "irGenRegion starting with:\n{}\n", show(region));
   assert(!region.blocks.empty());
 
   for (auto const& block : region.blocks) {
@@ -3793,9 +3828,9 @@ Translator::translateRegion(const RegionDesc& region) {
       for (; predIt != predEnd && predIt->first == sk; ++predIt) {
         auto const& pred = predIt->second;
         if (block == region.blocks.front() && i == 0) {
-          m_hhbcTrans->guardTypeLocation(toLocation(pred.location), pred.type);
+          s_hhbcTrans->guardTypeLocation(toLocation(pred.location), pred.type);
         } else {
-          m_hhbcTrans->checkTypeLocation(toLocation(pred.location), pred.type,
+          s_hhbcTrans->checkTypeLocation(toLocation(pred.location), pred.type,
                                          sk.offset());
         }
       }
@@ -3823,7 +3858,7 @@ Translator::translateRegion(const RegionDesc& region) {
       // getInputs.
       int stackOff = 1;
       getInputs(startSk, &inst, stackOff, inputInfos, [&](int i) {
-          return m_hhbcTrans->traceBuilder()->getLocalType(i);
+          return s_hhbcTrans->traceBuilder()->getLocalType(i);
         });
       if (inputInfos.needsRefCheck) {
         // Not supported yet.
@@ -3838,7 +3873,7 @@ Translator::translateRegion(const RegionDesc& region) {
       std::vector<DynLocation> dynLocs;
       dynLocs.reserve(inputInfos.size());
       auto newDynLoc = [&](const InputInfo& ii) {
-        dynLocs.emplace_back(ii.loc, m_hhbcTrans->rttFromLocation(ii.loc));
+        dynLocs.emplace_back(ii.loc, s_hhbcTrans->rttFromLocation(ii.loc));
         FTRACE(2, "rttFromLocation: {} -> {}\n",
                ii.loc.pretty(), dynLocs.back().rtt.pretty());
         return &dynLocs.back();
@@ -3852,14 +3887,13 @@ Translator::translateRegion(const RegionDesc& region) {
       // inst's inputs.
       readMetaData(metaHand, inst);
 
-      Util::Nuller<NormalizedInstruction> niNuller(&m_curNI);
-      m_curNI = &inst;
+      Util::Nuller<NormalizedInstruction> niNuller(&s_curNI);
+      s_curNI = &inst;
       translateInstr(inst);
     }
   }
 
   traceEnd();
-  traceCodeGen();
   return Success;
 }
 
@@ -4010,10 +4044,12 @@ static const char *transKindStr[] = {
   "Normal_HHIR",
   "Anchor",
   "Prologue",
+  "Profile",
+  "Optimize",
 };
 
 const char *getTransKindName(TransKind kind) {
-  assert(kind >= 0 && kind <= TransProlog);
+  assert(kind >= 0 && kind <= TransOptimize);
   return transKindStr[kind];
 }
 
@@ -48,6 +48,7 @@ namespace JIT {
 class HhbcTranslator;
 class IRFactory;
 class RegionDesc;
+class ProfData;
 }
 namespace Debug {
 class DebugInfo;
@@ -562,6 +563,8 @@ enum TransKind {
   TransNormalIR = 1,
   TransAnchor   = 2,
   TransProlog   = 3,
+  TransProfile  = 4,
+  TransOptimize = 5,
 };
 
 const char* getTransKindName(TransKind kind);
@@ -642,6 +645,8 @@ struct TranslArgs {
       , m_src(nullptr)
       , m_align(align)
       , m_interp(false)
+      , m_region(nullptr)
+      , m_prebuilt(false)
     {}
 
   TranslArgs& sk(const SrcKey& sk) {
@@ -660,11 +665,21 @@ struct TranslArgs {
     m_interp = interp;
     return *this;
   }
+  TranslArgs& region(const RegionDesc* region) {
+    m_region = region;
+    return *this;
+  }
+  TranslArgs& prebuilt(bool prebuilt) {
+    m_prebuilt = prebuilt;
+    return *this;
+  }
 
   SrcKey m_sk;
   TCA m_src;
   bool m_align;
   bool m_interp;
+  const RegionDesc* m_region; // optimized retranslation, see retranslateOpt
+  bool m_prebuilt; // m_region's optimized HHIR is already on this thread
 };
 
 #define INSTRS \
@@ -920,15 +935,17 @@ public:
   SrcKey nextSrcKey(const NormalizedInstruction& i);
 
   // Currently translating trace or instruction---only valid during
-  // translate phase.
-  const Tracelet*              m_curTrace;
-  const NormalizedInstruction* m_curNI;
+  // translate phase.  Thread-local, like s_irFactory and s_hhbcTrans,
+  // because compiler threads build HHIR without the write lease.
+  static __thread const Tracelet*              s_curTrace;
+  static __thread const NormalizedInstruction* s_curNI;
 
 protected:
   void requestResetHighLevelTranslator();
 
   void populateImmediates(NormalizedInstruction&);
   TranslateResult translateRegion(const RegionDesc& region);
+  TranslateResult irGenRegion(const RegionDesc& region);
 
   TCA m_resumeHelper;
   TCA m_resumeHelperRet;
@@ -940,11 +957,15 @@ protected:
 
   int64_t              m_createdTime;
 
-  std::unique_ptr<JIT::IRFactory> m_irFactory;
-  std::unique_ptr<JIT::HhbcTranslator> m_hhbcTrans;
+  // Owned; created by traceStart() and destroyed by traceFree().
+  static __thread JIT::IRFactory* s_irFactory;
+  static __thread JIT::HhbcTranslator* s_hhbcTrans;
 
   SrcDB              m_srcDB;
 
+  // Only non-null when EvalJitPGO is on.
+  std::unique_ptr<JIT::ProfData> m_profData;
+
   static Lease s_writeLease;
   static volatile bool s_replaceInFlight;
 
@@ -1030,6 +1051,10 @@ public:
 
   uint32_t addTranslation(const TransRec& transRec);
 
+  JIT::ProfData* profData() const {
+    return m_profData.get();
+  }
+
   // helpers for srcDB.
   SrcRec* getSrcRec(SrcKey sk) {
     // TODO: add a insert-or-find primitive to THM
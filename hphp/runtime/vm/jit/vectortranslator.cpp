@@ -15,6 +15,7 @@
 */
 
 #include "hphp/runtime/base/strings.h"
+#include "hphp/runtime/base/array/hphp_array.h"
 #include "hphp/runtime/vm/member_operations.h"
 #include "hphp/runtime/vm/jit/hhbctranslator.h"
 #include "hphp/runtime/vm/jit/ir.h"
@@ -1466,9 +1467,24 @@ void HhbcTranslator::VectorTranslator::emitUnsetProp() {
 }
 #undef HELPER_TABLE
 
+// Integer reads from packed HphpArrays index the element vector directly,
+// skipping the virtual call and hash probe.
+static inline TypedValue* fastGetCell(ArrayData* a, int64_t key) {
+  if (LIKELY(a->isHphpArray())) {
+    if (auto tv = static_cast<HphpArray*>(a)->nvGetPacked(key)) {
+      return tvToCell(tv);
+    }
+  }
+  return a->nvGetCell(key);
+}
+
+static inline TypedValue* fastGetCell(ArrayData* a, StringData* key) {
+  return a->nvGetCell(key);
+}
+
 static inline TypedValue* checkedGetCell(ArrayData* a, StringData* key) {
   int64_t i;
-  return UNLIKELY(key->isStrictlyInteger(i)) ? a->nvGetCell(i)
+  return UNLIKELY(key->isStrictlyInteger(i)) ? fastGetCell(a, i)
                                              : a->nvGetCell(key);
 }
 
@@ -1480,7 +1496,7 @@ template<KeyType keyType, bool checkForInt>
 static inline TypedValue arrayGetImpl(
   ArrayData* a, typename KeyTypeTraits<keyType>::rawType key) {
   TypedValue* ret = checkForInt ? checkedGetCell(a, key)
-                                : a->nvGetCell(key);
+                                : fastGetCell(a, key);
   tvRefcountedIncRef(ret);
   return *ret;
 }
@@ -1746,9 +1762,20 @@ void HhbcTranslator::VectorTranslator::emitIssetEmptyElem(bool isEmpty) {
 }
 #undef HELPER_TABLE
 
+static inline TypedValue* fastGet(ArrayData* a, int64_t key) {
+  if (LIKELY(a->isHphpArray())) {
+    if (auto tv = static_cast<HphpArray*>(a)->nvGetPacked(key)) return tv;
+  }
+  return a->nvGet(key);
+}
+
+static inline TypedValue* fastGet(ArrayData* a, StringData* key) {
+  return a->nvGet(key);
+}
+
 static inline TypedValue* checkedGet(ArrayData* a, StringData* key) {
   int64_t i;
-  return UNLIKELY(key->isStrictlyInteger(i)) ? a->nvGet(i)
+  return UNLIKELY(key->isStrictlyInteger(i)) ? fastGet(a, i)
                                              : a->nvGet(key);
 }
 
@@ -1760,7 +1787,7 @@ template<KeyType keyType, bool checkForInt>
 static inline uint64_t arrayIssetImpl(
   ArrayData* a, typename KeyTypeTraits<keyType>::rawType key) {
   TypedValue* value = checkForInt ? checkedGet(a, key)
-                                  : a->nvGet(key);
+                                  : fastGet(a, key);
   Variant* var = &tvAsVariant(value);
   return var && !var->isNull();
 }
@@ -1916,10 +1943,26 @@ void HhbcTranslator::VectorTranslator::emitEmptyElem() {
   emitIssetEmptyElem(true);
 }
 
+// Integer writes to unshared packed HphpArrays store the element
+// directly, like fastGet above.
+static inline ArrayData* fastSet(ArrayData* a, int64_t key,
+                                 CVarRef value, bool copy) {
+  if (LIKELY(a->isHphpArray()) && !copy &&
+      static_cast<HphpArray*>(a)->setPacked(key, value)) {
+    return a;
+  }
+  return a->set(key, value, copy);
+}
+
+static inline ArrayData* fastSet(ArrayData* a, StringData* key,
+                                 CVarRef value, bool copy) {
+  return a->set(key, value, copy);
+}
+
 static inline ArrayData* checkedSet(ArrayData* a, StringData* key,
                                     CVarRef value, bool copy) {
   int64_t i;
-  return UNLIKELY(key->isStrictlyInteger(i)) ? a->set(i, value, copy)
+  return UNLIKELY(key->isStrictlyInteger(i)) ? fastSet(a, i, value, copy)
                                              : a->set(key, value, copy);
 }
 
@@ -1936,7 +1979,7 @@ static inline typename ShuffleReturn<setRef>::return_type arraySetImpl(
                 "KeyType::Any is not supported in arraySetMImpl");
   const bool copy = a->getCount() > 1;
   ArrayData* ret = checkForInt ? checkedSet(a, key, value, copy)
-                               : a->set(key, value, copy);
+                               : fastSet(a, key, value, copy);
 
   return arrayRefShuffle<setRef>(a, ret, setRef ? ref->tv() : nullptr);
 }
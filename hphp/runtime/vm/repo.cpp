@@ -15,6 +15,7 @@
 */
 
 #include "hphp/runtime/vm/repo.h"
+#include "hphp/runtime/vm/repo_image.h"
 #include "hphp/util/logger.h"
 #include "hphp/util/trace.h"
 #include "hphp/util/repo_schema.h"
@@ -113,6 +114,14 @@ Unit* Repo::loadUnit(const std::string& name, const MD5& md5) {
   if (m_dbc == nullptr) {
     return nullptr;
   }
+  if (RepoImage* image = RepoImage::get()) {
+    if (Unit* unit = image->loadUnit(name, md5)) {
+      if (UNLIKELY(RuntimeOption::RepoImageVerify)) {
+        return image->verify(unit, m_urp.load(name, md5));
+      }
+      return unit;
+    }
+  }
   return m_urp.load(name, md5);
 }
 
@@ -157,10 +166,37 @@ bool Repo::GetFileHashStmt::get(const char *path, MD5& md5) {
   return false;
 }
 
+void Repo::GetFilePathsStmt::get(std::vector<std::string>& paths) {
+  try {
+    RepoTxn txn(m_repo);
+    if (!prepared()) {
+      std::stringstream ssSelect;
+      ssSelect << "SELECT path FROM "
+               << m_repo.table(m_repoId, "FileMd5") << ";";
+      txn.prepare(*this, ssSelect.str());
+    }
+    RepoTxnQuery query(txn, *this);
+    do {
+      query.step();
+      if (query.row()) {
+        const char* path;
+        size_t size;
+        query.getText(0, path, size);
+        paths.push_back(std::string(path, size));
+      }
+    } while (!query.done());
+    txn.commit();
+  } catch (RepoExc& re) {
+  }
+}
+
 bool Repo::findFile(const char *path, const string &root, MD5& md5) {
   if (m_dbc == nullptr) {
     return false;
   }
+  if (RepoImage* image = RepoImage::get()) {
+    if (image->findFile(path, root, md5)) return true;
+  }
   int repoId;
   for (repoId = RepoIdCount - 1; repoId >= 0; --repoId) {
     if (*path == '/' && !root.empty() &&
@@ -180,6 +216,15 @@ bool Repo::findFile(const char *path, const string &root, MD5& md5) {
   return false;
 }
 
+void Repo::enumerateFiles(std::vector<std::string>& paths) {
+  if (m_dbc == nullptr) {
+    return;
+  }
+  for (int repoId = RepoIdCount - 1; repoId >= 0; --repoId) {
+    getFilePaths(repoId).get(paths);
+  }
+}
+
 bool Repo::insertMd5(UnitOrigin unitOrigin, UnitEmitter* ue, RepoTxn& txn) {
   const StringData* path = ue->getFilepath();
   const MD5& md5 = ue->md5();
@@ -76,6 +76,8 @@ class Repo : public RepoProxy {
 
   Unit* loadUnit(const std::string& name, const MD5& md5);
   bool findFile(const char* path, const std::string& root, MD5& md5);
+  // Append the path of every file in the repo to paths.
+  void enumerateFiles(std::vector<std::string>& paths);
   bool insertMd5(UnitOrigin unitOrigin, UnitEmitter* ue, RepoTxn& txn);
   void commitMd5(UnitOrigin unitOrigin, UnitEmitter *ue);
 
@@ -83,7 +85,8 @@ class Repo : public RepoProxy {
 #define RP_GOP(o) RP_OP(Get##o, get##o)
 #define RP_OPS \
   RP_IOP(FileHash) \
-  RP_GOP(FileHash)
+  RP_GOP(FileHash) \
+  RP_GOP(FilePaths)
   class InsertFileHashStmt : public RepoProxy::Stmt {
     public:
       InsertFileHashStmt(Repo& repo, int repoId) : Stmt(repo, repoId) {}
@@ -94,6 +97,11 @@ class Repo : public RepoProxy {
       GetFileHashStmt(Repo& repo, int repoId) : Stmt(repo, repoId) {}
       bool get(const char* path, MD5& md5);
   };
+  class GetFilePathsStmt : public RepoProxy::Stmt {
+    public:
+      GetFilePathsStmt(Repo& repo, int repoId) : Stmt(repo, repoId) {}
+      void get(std::vector<std::string>& paths);
+  };
 #define RP_OP(c, o) \
  public: \
   c##Stmt& o(int repoId) { return *m_##o[repoId]; } \
@@ -0,0 +1,614 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include "hphp/runtime/vm/repo_image.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hphp/runtime/base/runtime_option.h"
+#include "hphp/runtime/base/tv_comparisons.h"
+#include "hphp/runtime/vm/blob_helper.h"
+#include "hphp/runtime/vm/repo.h"
+#include "hphp/util/logger.h"
+#include "hphp/util/repo_schema.h"
+#include "hphp/util/trace.h"
+
+namespace HPHP {
+
+TRACE_SET_MOD(hhbc);
+
+//////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const char kMagic[] = "HHVM repo image";
+const uint32_t kVersion = 2;
+
+}
+
+struct RepoImage::Header {
+  char     magic[16];
+  char     schema[64];
+  uint32_t version;
+  uint32_t nUnits;
+  uint32_t nPaths;
+  uint32_t pad;
+  int64_t  repoMtime;
+  uint64_t unitIndexOff;
+  uint64_t pathIndexOff;
+  uint64_t pathsOff;
+  uint64_t recordsOff;
+  uint64_t size;
+};
+
+struct RepoImage::UnitEntry {
+  uint64_t md5[2];
+  uint64_t off;                 // from the start of the unit records
+  uint64_t len;
+};
+
+struct RepoImage::PathEntry {
+  uint64_t off;                 // from the start of the paths
+  uint32_t len;
+  uint32_t pad;
+  uint64_t md5[2];
+};
+
+namespace {
+
+bool md5Less(const uint64_t* a, const uint64_t* b) {
+  return a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]);
+}
+
+int pathCmp(const char* a, size_t alen, const char* b, size_t blen) {
+  int c = memcmp(a, b, std::min(alen, blen));
+  if (c) return c;
+  return alen < blen ? -1 : alen > blen ? 1 : 0;
+}
+
+/*
+ * Sections of a unit record that hold a variable number of rows are a
+ * row count followed by the rows, encoded separately so the count can
+ * come first.
+ */
+void encodeSection(BlobEncoder& rec, uint32_t n, const BlobEncoder& rows) {
+  rec(n);
+  rec.encodeBytes(rows.size() ? rows.data() : "", rows.size());
+}
+
+BlobDecoder decodeSection(BlobDecoder& rec, uint32_t& n) {
+  rec(n);
+  size_t len;
+  const void* rows = rec.decodeBytes(len);
+  return BlobDecoder(rows, len);
+}
+
+bool sameMainReturn(const TypedValue* a, const TypedValue* b) {
+  return a->m_type == b->m_type &&
+         (a->m_type == KindOfUninit || tvSame(a, b));
+}
+
+}
+
+//////////////////////////////////////////////////////////////////////
+
+RepoImage* RepoImage::s_image;
+
+void RepoImage::Init() {
+  assert(!s_image);
+  auto const& path = RuntimeOption::RepoImagePath;
+  if (!RuntimeOption::RepoAuthoritative || path.empty()) return;
+
+  Repo& repo = Repo::get();
+  struct stat st;
+  std::string central = repo.repoName(RepoIdCentral);
+  if (stat(central.c_str(), &st) != 0) {
+    Logger::Warning("Not using repo image %s: can't stat repo %s",
+                    path.c_str(), central.c_str());
+    return;
+  }
+  if ((s_image = open(path, st.st_mtime))) return;
+
+  Logger::Info("Building repo image %s from %s",
+               path.c_str(), central.c_str());
+  if (build(repo, path, st.st_mtime)) {
+    s_image = open(path, st.st_mtime);
+  }
+}
+
+RepoImage::RepoImage(const char* base, size_t size)
+  : m_base(base)
+  , m_size(size)
+{}
+
+RepoImage::~RepoImage() {
+  munmap(const_cast<char*>(m_base), m_size);
+}
+
+const RepoImage::Header& RepoImage::header() const {
+  return *reinterpret_cast<const Header*>(m_base);
+}
+
+RepoImage* RepoImage::open(const std::string& path, time_t repoMtime) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+    close(fd);
+    return nullptr;
+  }
+  size_t size = st.st_size;
+  void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return nullptr;
+
+  auto const& h = *static_cast<const Header*>(base);
+  if (memcmp(h.magic, kMagic, sizeof kMagic) != 0 ||
+      h.version != kVersion ||
+      strncmp(h.schema, kRepoSchemaId, sizeof h.schema) != 0 ||
+      h.repoMtime != int64_t(repoMtime) ||
+      h.size != size ||
+      h.unitIndexOff + h.nUnits * sizeof(UnitEntry) > h.pathIndexOff ||
+      h.pathIndexOff + h.nPaths * sizeof(PathEntry) > h.pathsOff ||
+      h.pathsOff > h.recordsOff || h.recordsOff > size) {
+    TRACE(1, "RepoImage: %s is stale or not an image\n", path.c_str());
+    munmap(base, size);
+    return nullptr;
+  }
+  TRACE(1, "RepoImage: mapped %s, %u units, %u paths\n",
+        path.c_str(), h.nUnits, h.nPaths);
+  return new RepoImage(static_cast<const char*>(base), size);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool RepoImage::build(Repo& repo, const std::string& path,
+                      time_t repoMtime) {
+  std::vector<UnitEntry> units;
+  std::vector<char> records;
+  std::map<std::string, MD5> paths;
+
+  try {
+    RepoTxn txn(repo);
+    auto table = [&](const char* name) {
+      return repo.table(RepoIdCentral, name);
+    };
+    RepoStmt unitStmt(repo);
+    RepoStmt litstrStmt(repo);
+    RepoStmt arrayStmt(repo);
+    RepoStmt preClassStmt(repo);
+    RepoStmt mergeableStmt(repo);
+    RepoStmt funcStmt(repo);
+    RepoStmt pathStmt(repo);
+    txn.prepare(unitStmt,
+                "SELECT unitSn,md5,bc,bc_meta,mainReturn,mergeable,"
+                "lines,typedefs FROM " + table("Unit") +
+                " ORDER BY unitSn ASC;");
+    txn.prepare(litstrStmt,
+                "SELECT litstr FROM " + table("UnitLitstr") +
+                " WHERE unitSn == @unitSn ORDER BY litstrId ASC;");
+    txn.prepare(arrayStmt,
+                "SELECT array FROM " + table("UnitArray") +
+                " WHERE unitSn == @unitSn ORDER BY arrayId ASC;");
+    txn.prepare(preClassStmt,
+                "SELECT name,hoistable,extraData FROM " + table("PreClass") +
+                " WHERE unitSn == @unitSn ORDER BY preClassId ASC;");
+    txn.prepare(mergeableStmt,
+                "SELECT mergeableIx,mergeableKind,mergeableId,"
+                "mergeableValue FROM " + table("UnitMergeables") +
+                " WHERE unitSn == @unitSn ORDER BY mergeableIx ASC;");
+    txn.prepare(funcStmt,
+                "SELECT preClassId,name,top,extraData FROM " + table("Func") +
+                " WHERE unitSn == @unitSn ORDER BY funcSn ASC;");
+    txn.prepare(pathStmt,
+                "SELECT f.path,f.md5 FROM " + table("FileMd5") +
+                " AS f, " + table("Unit") + " AS u"
+                " WHERE f.md5 == u.md5 ORDER BY unitSn ASC;");
+
+    // Runs stmt for one unit and encodes each row with f, as a
+    // section of rec.
+    auto section = [&](RepoStmt& stmt, int64_t unitSn, BlobEncoder& rec,
+                       std::function<void(RepoQuery&, BlobEncoder&)> f) {
+      BlobEncoder rows;
+      uint32_t n = 0;
+      RepoTxnQuery query(txn, stmt);
+      query.bindInt64("@unitSn", unitSn);
+      do {
+        query.step();
+        if (query.row()) {
+          f(query, rows);
+          ++n;
+        }
+      } while (!query.done());
+      encodeSection(rec, n, rows);
+    };
+
+    RepoTxnQuery unitQuery(txn, unitStmt);
+    do {
+      unitQuery.step();
+      if (!unitQuery.row()) continue;
+
+      int64_t unitSn;               /**/ unitQuery.getInt64(0, unitSn);
+      MD5 md5;                      /**/ unitQuery.getMd5(1, md5);
+      const void* bc; size_t bclen; /**/ unitQuery.getBlob(2, bc, bclen);
+      const void* bcMeta;
+      size_t bcMetaLen;             /**/ unitQuery.getBlob(3, bcMeta,
+                                                           bcMetaLen);
+      TypedValue mainReturn;        /**/ unitQuery.getTypedValue(4,
+                                                                 mainReturn);
+      bool mergeable;               /**/ unitQuery.getBool(5, mergeable);
+      const void* lines;
+      size_t linesLen;              /**/ unitQuery.getBlob(6, lines, linesLen);
+      const void* typedefs;
+      size_t typedefsLen;           /**/ unitQuery.getBlob(7, typedefs,
+                                                           typedefsLen);
+
+      BlobEncoder rec;
+      rec(unitSn);
+      rec.encodeBytes(bc, bclen);
+      rec.encodeBytes(bcMetaLen ? bcMeta : "", bcMetaLen);
+      rec(mainReturn);
+      rec(mergeable);
+      rec.encodeBytes(lines, linesLen);
+      rec.encodeBytes(typedefs, typedefsLen);
+
+      section(litstrStmt, unitSn, rec, [](RepoQuery& q, BlobEncoder& rows) {
+        StringData* litstr; /**/ q.getStaticString(0, litstr);
+        rows(static_cast<const StringData*>(litstr));
+      });
+      section(arrayStmt, unitSn, rec, [](RepoQuery& q, BlobEncoder& rows) {
+        StringData* array; /**/ q.getStaticString(0, array);
+        rows(static_cast<const StringData*>(array));
+      });
+      section(preClassStmt, unitSn, rec,
+              [](RepoQuery& q, BlobEncoder& rows) {
+        StringData* name;          /**/ q.getStaticString(0, name);
+        int hoistable;             /**/ q.getInt(1, hoistable);
+        const void* extra; size_t extraLen; /**/ q.getBlob(2, extra,
+                                                           extraLen);
+        rows(static_cast<const StringData*>(name))(hoistable);
+        rows.encodeBytes(extra, extraLen);
+      });
+      section(mergeableStmt, unitSn, rec,
+              [](RepoQuery& q, BlobEncoder& rows) {
+        int mergeableIx;   /**/ q.getInt(0, mergeableIx);
+        int mergeableKind; /**/ q.getInt(1, mergeableKind);
+        Id mergeableId;    /**/ q.getInt(2, mergeableId);
+        rows(mergeableIx)(mergeableKind)(mergeableId);
+        if (mergeableKind != UnitMergeKindReqDoc) {
+          TypedValue value; /**/ q.getTypedValue(3, value);
+          rows(value);
+        }
+      });
+      section(funcStmt, unitSn, rec, [](RepoQuery& q, BlobEncoder& rows) {
+        Id preClassId;     /**/ q.getId(0, preClassId);
+        StringData* name;  /**/ q.getStaticString(1, name);
+        bool top;          /**/ q.getBool(2, top);
+        const void* extra; size_t extraLen; /**/ q.getBlob(3, extra,
+                                                           extraLen);
+        rows(preClassId)(static_cast<const StringData*>(name))(top);
+        rows.encodeBytes(extra, extraLen);
+      });
+
+      UnitEntry ent;
+      ent.md5[0] = md5.q[0];
+      ent.md5[1] = md5.q[1];
+      ent.off = records.size();
+      ent.len = rec.size();
+      units.push_back(ent);
+      auto const p = static_cast<const char*>(rec.data());
+      records.insert(records.end(), p, p + rec.size());
+    } while (!unitQuery.done());
+
+    RepoTxnQuery pathQuery(txn, pathStmt);
+    do {
+      pathQuery.step();
+      if (!pathQuery.row()) continue;
+      const char* p; size_t len; /**/ pathQuery.getText(0, p, len);
+      MD5 md5;                   /**/ pathQuery.getMd5(1, md5);
+      // Later units win, like in Repo::GetFileHashStmt.
+      paths[std::string(p, len)] = md5;
+    } while (!pathQuery.done());
+
+    txn.commit();
+  } catch (RepoExc& re) {
+    Logger::Warning("Failed to build repo image %s: %s",
+                    path.c_str(), re.msg().c_str());
+    return false;
+  }
+
+  std::sort(units.begin(), units.end(),
+            [](const UnitEntry& a, const UnitEntry& b) {
+              return md5Less(a.md5, b.md5);
+            });
+  std::vector<PathEntry> pathIndex;
+  std::string pathStrings;
+  for (auto const& p : paths) {
+    PathEntry ent;
+    ent.off = pathStrings.size();
+    ent.len = p.first.size();
+    ent.pad = 0;
+    ent.md5[0] = p.second.q[0];
+    ent.md5[1] = p.second.q[1];
+    pathIndex.push_back(ent);
+    pathStrings += p.first;
+  }
+
+  // Lay the file out: header, indexes, path strings, then records.
+  Header h;
+  memset(&h, 0, sizeof h);
+  memcpy(h.magic, kMagic, sizeof kMagic);
+  strncpy(h.schema, kRepoSchemaId, sizeof h.schema);
+  h.version = kVersion;
+  h.nUnits = units.size();
+  h.nPaths = pathIndex.size();
+  h.repoMtime = repoMtime;
+  h.unitIndexOff = sizeof(Header);
+  h.pathIndexOff = h.unitIndexOff + units.size() * sizeof(UnitEntry);
+  h.pathsOff = h.pathIndexOff + pathIndex.size() * sizeof(PathEntry);
+  h.recordsOff = h.pathsOff + pathStrings.size();
+  h.size = h.recordsOff + records.size();
+
+  // Write to a temporary and rename it into place, so other processes
+  // never map a partial image.
+  std::string tmp = path + ".tmp." + std::to_string(getpid());
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (!f) {
+    Logger::Warning("Failed to create repo image %s", tmp.c_str());
+    return false;
+  }
+  bool ok =
+    fwrite(&h, sizeof h, 1, f) == 1 &&
+    fwrite(units.data(), sizeof(UnitEntry), units.size(), f) ==
+      units.size() &&
+    fwrite(pathIndex.data(), sizeof(PathEntry), pathIndex.size(), f) ==
+      pathIndex.size() &&
+    fwrite(pathStrings.data(), 1, pathStrings.size(), f) ==
+      pathStrings.size() &&
+    fwrite(records.data(), 1, records.size(), f) == records.size();
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    Logger::Warning("Failed to write repo image %s", path.c_str());
+    unlink(tmp.c_str());
+    return false;
+  }
+  Logger::Info("Built repo image %s: %zu units, %zu paths, %" PRIu64
+               " bytes", path.c_str(), units.size(), pathIndex.size(),
+               h.size);
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+const RepoImage::UnitEntry* RepoImage::findUnit(const MD5& md5) const {
+  auto const& h = header();
+  auto const begin =
+    reinterpret_cast<const UnitEntry*>(m_base + h.unitIndexOff);
+  auto const end = begin + h.nUnits;
+  auto const it = std::lower_bound(
+    begin, end, md5.q,
+    [](const UnitEntry& ent, const uint64_t* key) {
+      return md5Less(ent.md5, key);
+    });
+  if (it == end || it->md5[0] != md5.q[0] || it->md5[1] != md5.q[1]) {
+    return nullptr;
+  }
+  return it;
+}
+
+bool RepoImage::findPath(const char* path, size_t len, MD5& md5) const {
+  auto const& h = header();
+  auto const begin =
+    reinterpret_cast<const PathEntry*>(m_base + h.pathIndexOff);
+  auto const end = begin + h.nPaths;
+  auto const paths = m_base + h.pathsOff;
+  auto const it = std::lower_bound(
+    begin, end, path,
+    [&](const PathEntry& ent, const char* key) {
+      return pathCmp(paths + ent.off, ent.len, key, len) < 0;
+    });
+  if (it == end || pathCmp(paths + it->off, it->len, path, len) != 0) {
+    return false;
+  }
+  md5.q[0] = it->md5[0];
+  md5.q[1] = it->md5[1];
+  return true;
+}
+
+bool RepoImage::findFile(const char* path, const std::string& root,
+                         MD5& md5) const {
+  size_t len = strlen(path);
+  if (*path == '/' && !root.empty() &&
+      !strncmp(root.c_str(), path, root.size()) &&
+      findPath(path + root.size(), len - root.size(), md5)) {
+    TRACE(3, "RepoImage loaded file hash for '%s'\n", path + root.size());
+    return true;
+  }
+  if (findPath(path, len, md5)) {
+    TRACE(3, "RepoImage loaded file hash for '%s'\n", path);
+    return true;
+  }
+  return false;
+}
+
+Unit* RepoImage::loadUnit(const std::string& name, const MD5& md5) const {
+  auto const ent = findUnit(md5);
+  if (!ent) return nullptr;
+
+  UnitEmitter ue(md5);
+  ue.setFilepath(StringData::GetStaticString(name));
+  // Debug info (source locations) still comes from the SQLite repo, so
+  // the unit needs to know where it lives there.
+  ue.setRepoId(RepoIdCentral);
+
+  BlobDecoder rec(m_base + header().recordsOff + ent->off, ent->len);
+  int64_t unitSn;
+  rec(unitSn);
+  ue.setSn(unitSn);
+
+  size_t len;
+  const void* bytes = rec.decodeBytes(len);
+  ue.setBc(static_cast<const uchar*>(bytes), len);
+  bytes = rec.decodeBytes(len);
+  ue.setBcMeta(static_cast<const uchar*>(bytes), len);
+
+  TypedValue mainReturn;
+  rec(mainReturn);
+  ue.setMainReturn(&mainReturn);
+  bool mergeable;
+  rec(mergeable);
+  ue.setMergeOnly(mergeable);
+
+  {
+    bytes = rec.decodeBytes(len);
+    LineTable lines;
+    BlobDecoder(bytes, len)(lines);
+    ue.setLines(lines);
+  }
+  bytes = rec.decodeBytes(len);
+  BlobDecoder(bytes, len)(ue.m_typedefs);
+
+  uint32_t n;
+  {
+    BlobDecoder rows = decodeSection(rec, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      const StringData* litstr;
+      rows(litstr);
+      Id id UNUSED = ue.mergeLitstr(litstr);
+      assert(id == Id(i));
+    }
+  }
+  {
+    BlobDecoder rows = decodeSection(rec, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      const StringData* array;
+      rows(array);
+      String s(const_cast<StringData*>(array));
+      Variant v = unserialize_from_string(s);
+      Id id UNUSED = ue.mergeArray(v.asArrRef().get(), array);
+      assert(id == Id(i));
+    }
+  }
+  {
+    BlobDecoder rows = decodeSection(rec, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      const StringData* name;
+      int hoistable;
+      rows(name)(hoistable);
+      bytes = rows.decodeBytes(len);
+      BlobDecoder extraBlob(bytes, len);
+      PreClassEmitter* pce = ue.newPreClassEmitter(
+        name, (PreClass::Hoistable)hoistable);
+      pce->serdeMetaData(extraBlob);
+      assert(pce->id() == Id(i));
+    }
+  }
+  {
+    BlobDecoder rows = decodeSection(rec, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      int mergeableIx;
+      int mergeableKind;
+      Id mergeableId;
+      rows(mergeableIx)(mergeableKind)(mergeableId);
+      if (mergeableKind == UnitMergeKindReqDoc) {
+        ue.insertMergeableInclude(mergeableIx,
+                                  (UnitMergeKind)mergeableKind, mergeableId);
+      } else {
+        TypedValue mergeableValue;
+        rows(mergeableValue);
+        ue.insertMergeableDef(mergeableIx, (UnitMergeKind)mergeableKind,
+                              mergeableId, mergeableValue);
+      }
+    }
+  }
+  {
+    BlobDecoder rows = decodeSection(rec, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      Id preClassId;
+      const StringData* name;
+      bool top;
+      rows(preClassId)(name)(top);
+      bytes = rows.decodeBytes(len);
+      BlobDecoder extraBlob(bytes, len);
+
+      FuncEmitter* fe;
+      if (preClassId < 0) {
+        fe = ue.newFuncEmitter(name);
+      } else {
+        PreClassEmitter* pce = ue.pce(preClassId);
+        fe = ue.newMethodEmitter(name, pce);
+        bool added UNUSED = pce->addMethod(fe);
+        assert(added);
+      }
+      fe->setTop(top);
+      fe->serdeMetaData(extraBlob);
+      fe->finish(fe->past(), true);
+      ue.recordFunction(fe);
+    }
+  }
+
+  TRACE(3, "RepoImage loaded '%s' (0x%016" PRIx64 "%016" PRIx64 ")\n",
+        name.c_str(), md5.q[0], md5.q[1]);
+  return ue.create();
+}
+
+Unit* RepoImage::verify(Unit* fromImage, Unit* fromRepo) const {
+  if (!fromRepo) {
+    Logger::Error("Repo image has unit %s, but the repo doesn't",
+                  fromImage->filepath()->data());
+    return fromImage;
+  }
+  // Literal strings and arrays are interned, so they must be the very
+  // same objects; the pretty printer covers classes, functions and
+  // bytecode.
+  bool same =
+    fromImage->bclen() == fromRepo->bclen() &&
+    !memcmp(fromImage->entry(), fromRepo->entry(), fromRepo->bclen()) &&
+    fromImage->numLitstrs() == fromRepo->numLitstrs() &&
+    fromImage->numArrays() == fromRepo->numArrays() &&
+    fromImage->isMergeOnly() == fromRepo->isMergeOnly() &&
+    sameMainReturn(fromImage->getMainReturn(), fromRepo->getMainReturn()) &&
+    fromImage->toString() == fromRepo->toString();
+  for (Id i = 0; same && i < Id(fromRepo->numLitstrs()); ++i) {
+    same = fromImage->lookupLitstrId(i) == fromRepo->lookupLitstrId(i);
+  }
+  for (Id i = 0; same && i < Id(fromRepo->numArrays()); ++i) {
+    same = fromImage->lookupArrayId(i) == fromRepo->lookupArrayId(i);
+  }
+  if (!same) {
+    Logger::Error("Repo image unit %s doesn't match the repo",
+                  fromRepo->filepath()->data());
+    delete fromImage;
+    return fromRepo;
+  }
+  TRACE(3, "RepoImage verified '%s'\n", fromRepo->filepath()->data());
+  delete fromRepo;
+  return fromImage;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+}
@@ -0,0 +1,114 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010-2013 Facebook, Inc. (http://www.facebook.com)     |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef incl_HPHP_VM_REPO_IMAGE_H_
+#define incl_HPHP_VM_REPO_IMAGE_H_
+
+#include <string>
+#include <boost/noncopyable.hpp>
+
+#include "hphp/runtime/base/md5.h"
+
+namespace HPHP {
+
+class Repo;
+class Unit;
+
+/*
+ * Read-only image of the central repo, for RepoAuthoritative mode.
+ *
+ * Loading a unit out of SQLite takes half a dozen queries, each
+ * stepping through rows and copying their columns.  The image holds
+ * the same rows, packed per unit into a single file that is mmap()ed
+ * once at startup:
+ *
+ *   Header
+ *   unit index   {md5, offset, length}, sorted by md5
+ *   path index   {path offset, path length, md5}, sorted by path
+ *   paths
+ *   unit records one BlobEncoder record per unit
+ *
+ * The header gives each section's offset in the file, and index
+ * entries give offsets from the start of their own section, so no
+ * part of the image records where another part landed: the writer
+ * lays each section out independently and the mapping is used in
+ * place, wherever it lands, with nothing to fix up.  Finding a file or
+ * a unit is a binary search; loading a unit decodes its record
+ * straight out of the mapping, with bytecode and strings copied
+ * directly from it.
+ *
+ * Init() maps the image at process startup.  If Repo.Image.Path
+ * doesn't name an image that matches the repo (same schema, same
+ * modification time), it builds one from the central repo first, so
+ * deployments that want to avoid paying for that at startup can build
+ * it ahead of time by running hhvm once against the new repo.
+ */
+class RepoImage : boost::noncopyable {
+ public:
+  /*
+   * Map (building it first if need be) the image for this process.
+   * Called once from hphp_process_init, before anything can load a
+   * unit.
+   */
+  static void Init();
+
+  /*
+   * The image for the current process, or nullptr if there is none:
+   * we're not in RepoAuthoritative mode, Repo.Image.Path is unset, or
+   * the image couldn't be opened or built.
+   */
+  static RepoImage* get() { return s_image; }
+
+  ~RepoImage();
+
+  /*
+   * Same contract as Repo::findFile and Repo::loadUnit.  Both return
+   * false/nullptr if the image doesn't have the file, so callers can
+   * fall back to the SQLite repo.
+   */
+  bool findFile(const char* path, const std::string& root, MD5& md5) const;
+  Unit* loadUnit(const std::string& name, const MD5& md5) const;
+
+  /*
+   * For Repo.Image.Verify: compare a unit loaded from the image with
+   * the same unit loaded from SQLite.  Returns the one to use, and
+   * frees the other; on a mismatch, that's the SQLite one.
+   */
+  Unit* verify(Unit* fromImage, Unit* fromRepo) const;
+
+ private:
+  struct Header;
+  struct UnitEntry;
+  struct PathEntry;
+
+  RepoImage(const char* base, size_t size);
+
+  static RepoImage* open(const std::string& path, time_t repoMtime);
+  static bool build(Repo& repo, const std::string& path, time_t repoMtime);
+
+  const Header& header() const;
+  const UnitEntry* findUnit(const MD5& md5) const;
+  bool findPath(const char* path, size_t len, MD5& md5) const;
+
+  static RepoImage* s_image;
+
+  const char* m_base;
+  size_t m_size;
+};
+
+}
+
+#endif
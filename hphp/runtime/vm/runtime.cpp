@@ -183,6 +183,11 @@ concat_si(StringData* v1, int64_t v2) {
     int is_negative;
     intstart = conv_10(v2, &is_negative, intbuf + sizeof(intbuf), &len2);
   }
+  if (v1->getCount() == 1) {
+    // We own the only reference; append in place like concat_ss.
+    v1->append(intstart, len2);
+    return v1;
+  }
   StringSlice s1 = v1->slice();
   StringSlice s2(intstart, len2);
   StringData* ret = NEW(StringData)(s1, s2);
@@ -200,6 +205,16 @@ concat_tv(DataType t1, uint64_t v1, DataType t2, uint64_t v2) {
   const char *s1, *s2;
   size_t s1len, s2len;
   bool free1, free2;
+  if (IS_STRING_TYPE(t1) && ((StringData*)v1)->getCount() == 1) {
+    // Append in place, so that e.g. `$s .= 1.5` in a loop doesn't copy $s
+    // every iteration.
+    StringData* str = (StringData*)v1;
+    tvPairToCString(t2, v2, &s2, &s2len, &free2);
+    str->append(s2, s2len);
+    if (free2) free((void*)s2);
+    tvRefcountedDecRefHelper(t2, v2);
+    return str;
+  }
   tvPairToCString(t1, v1, &s1, &s1len, &free1);
   tvPairToCString(t2, v2, &s2, &s2len, &free2);
   StringSlice r1(s1, s1len);
@@ -16,7 +16,10 @@
 #include "hphp/runtime/vm/type_profile.h"
 #include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/base/stats.h"
+#include "hphp/runtime/vm/func.h"
+#include "hphp/runtime/vm/unit.h"
 #include "hphp/runtime/vm/jit/translator.h"
+#include "hphp/util/repo_schema.h"
 #include "hphp/util/trace.h"
 
 #include <string.h>
@@ -95,7 +98,88 @@ static const double kMinInstances = 99.0;
 typedef ValueProfile ValueProfileLine[kLineSize];
 static ValueProfileLine* profiles;
 
-static ValueProfileLine*
+/*
+ * Per-instruction profiles.
+ *
+ * These are keyed by the md5 of the instruction's unit and its offset,
+ * rather than by name, so they stay meaningful across restarts and
+ * across machines running the same code.  Besides the type the
+ * instruction produced, they count branch directions for conditional
+ * jumps and the most frequent callee for calls.
+ *
+ * kNumInstrEntries: ~128K entries, (sizeof(InstrProfile) == 48) B -> 6MB.
+ */
+struct InstrProfile {
+  uint64_t m_tag;
+  Counter m_totalSamples;
+  Counter m_samples[MaxNumDataTypesIndex];
+  Counter m_taken;
+  Counter m_notTaken;
+  Counter m_calls;
+  Counter m_calleeHits;
+  uint32_t m_callee;  // hash of the callee's full name
+
+  uint32_t weight() const {
+    return uint32_t(m_totalSamples) + m_taken + m_notTaken + m_calls;
+  }
+};
+
+static const int kNumInstrEntries = 1 << 17;
+static const int kNumInstrLines = kNumInstrEntries / kLineSize;
+static const int kNumInstrLinesMask = kNumInstrLines - 1;
+
+typedef InstrProfile InstrProfileLine[kLineSize];
+static InstrProfileLine* instrProfiles;
+
+/*
+ * Layout of the file at EvalJitProfilePath:
+ *
+ *   ProfileHeader
+ *   ValueProfileLine[kNumLines]
+ *   InstrProfileLine[kNumInstrLines]
+ *
+ * The header names the format version and the build that wrote the
+ * file.  A profile from any other build is ignored, or overwritten when
+ * recording, since type names and bytecode offsets need not mean the
+ * same thing to it.
+ */
+static const uint64_t kProfileMagic = 0x464f525076686868ull; // "hhhvPROF"
+static const uint32_t kProfileVersion = 2;
+
+struct ProfileHeader {
+  uint64_t m_magic;
+  uint32_t m_version;
+  uint32_t m_numRequests;  // requests recorded into this profile
+  char m_buildId[128];
+};
+
+static ProfileHeader* header;
+
+/*
+ * Set if we loaded a complete profile recorded by a previous run.  The
+ * JIT can then use it right away instead of profiling on its own.
+ */
+static bool preloaded;
+
+static const size_t kProfileFileSize = sizeof(ProfileHeader) +
+  sizeof(ValueProfileLine) * kNumLines +
+  sizeof(InstrProfileLine) * kNumInstrLines;
+
+static bool headerMatches(const ProfileHeader* h) {
+  return h->m_magic == kProfileMagic &&
+    h->m_version == kProfileVersion &&
+    !strncmp(h->m_buildId, kRepoSchemaId, sizeof(h->m_buildId) - 1);
+}
+
+static void headerInit(ProfileHeader* h) {
+  h->m_magic = kProfileMagic;
+  h->m_version = kProfileVersion;
+  h->m_numRequests = 0;
+  strncpy(h->m_buildId, kRepoSchemaId, sizeof(h->m_buildId) - 1);
+  h->m_buildId[sizeof(h->m_buildId) - 1] = '\0';
+}
+
+static void*
 profileInitMmap() {
   const std::string& path = RuntimeOption::EvalJitProfilePath;
   if (path.empty()) {
@@ -111,7 +195,7 @@ profileInitMmap() {
     return nullptr;
   }
 
-  size_t len = sizeof(ValueProfileLine) * kNumLines;
+  size_t len = kProfileFileSize;
   int retval = ftruncate(fd, len);
   if (retval < 0) {
     perror("truncate");
@@ -124,24 +208,54 @@ profileInitMmap() {
     (RuntimeOption::EvalJitProfileRecord ? PROT_WRITE : 0);
   void* mmapRet = mmap(0, len, flags, MAP_SHARED, // Yes, shared.
                        fd, 0);
+  close(fd);
   if (mmapRet == MAP_FAILED) {
     perror("mmap");
     TRACE(0, "profileInit: mmap %s failed: %s\n", path.c_str(),
           strerror(errno));
     return nullptr;
   }
-  return (ValueProfileLine*)mmapRet;
+
+  auto h = (ProfileHeader*)mmapRet;
+  if (RuntimeOption::EvalJitProfileRecord) {
+    if (!headerMatches(h)) {
+      TRACE(0, "profileInit: discarding stale profile %s\n", path.c_str());
+      memset(mmapRet, 0, len);
+      headerInit(h);
+    }
+    return mmapRet;
+  }
+
+  // Only use a profile that's complete; we won't be writing to it, so
+  // we'd have nowhere to put the rest of the warmup samples.
+  if (!headerMatches(h) ||
+      h->m_numRequests < RuntimeOption::EvalJitWarmupRequests) {
+    TRACE(0, "profileInit: ignoring %s profile %s\n",
+          headerMatches(h) ? "incomplete" : "stale", path.c_str());
+    munmap(mmapRet, len);
+    return nullptr;
+  }
+  TRACE(1, "profileInit: preloaded profile of %u requests\n",
+        h->m_numRequests);
+  preloaded = true;
+  return mmapRet;
 }
 
 void
 profileInit() {
   if (!profiles) {
-    profiles = profileInitMmap();
-    if (!profiles) {
+    auto base = (char*)profileInitMmap();
+    if (!base) {
       TRACE(1, "profileInit: anonymous memory.\n");
-      profiles = (ValueProfileLine*)calloc(sizeof(ValueProfileLine), kNumLines);
-      assert(profiles);
+      base = (char*)calloc(kProfileFileSize, 1);
+      assert(base);
+      headerInit((ProfileHeader*)base);
     }
+    header = (ProfileHeader*)base;
+    base += sizeof(ProfileHeader);
+    profiles = (ValueProfileLine*)base;
+    base += sizeof(ValueProfileLine) * kNumLines;
+    instrProfiles = (InstrProfileLine*)base;
   }
 }
 
@@ -157,8 +271,9 @@ profileInit() {
 bool __thread profileOn = false;
 static int64_t numRequests;
 
-static inline bool warmedUp() {
-  return (numRequests >= RuntimeOption::EvalJitWarmupRequests) ||
+bool warmedUp() {
+  return preloaded ||
+    (numRequests >= RuntimeOption::EvalJitWarmupRequests) ||
     (RuntimeOption::ClientExecutionMode() &&
      !RuntimeOption::EvalJitProfileRecord);
 }
@@ -182,6 +297,9 @@ profileRequestStart() {
 
 void profileRequestEnd() {
   numRequests++; // racy RMW; ok to miss a rare few.
+  if (profileOn && header) {
+    header->m_numRequests++; // likewise
+  }
 }
 
 enum class KeyToVPMode {
@@ -294,6 +412,118 @@ PredVal predictType(TypeProfileKey key) {
   return std::make_pair(pred, maxProb);
 }
 
+static inline uint64_t
+instrKey(const Func* func, Offset off) {
+  auto const md5 = func->unit()->md5();
+  // Zero tags mark empty entries.
+  return hash_int64_pair(md5.q[0] ^ md5.q[1], off) | 1;
+}
+
+static inline InstrProfile*
+keyToIP(const Func* func, Offset off, KeyToVPMode mode) {
+  assert(instrProfiles);
+  uint64_t h = instrKey(func, off);
+  int hidx = (h >> kLineSizeLog2) & kNumInstrLinesMask;
+  InstrProfileLine& l = instrProfiles[hidx];
+  int replaceCandidate = 0;
+  uint32_t minWeight = UINT_MAX;
+  for (int i = 0; i < kLineSize; i++) {
+    if (l[i].m_tag == h) return &l[i];
+    if (mode == KeyToVPMode::Write && l[i].weight() < minWeight) {
+      replaceCandidate = i;
+      minWeight = l[i].weight();
+    }
+  }
+  if (mode == KeyToVPMode::Write) {
+    InstrProfile& ip = l[replaceCandidate];
+    TRACE(1, "Killing instr profile %" PRIx64 " in favor of %s@%d\n",
+          ip.m_tag, func->fullName()->data(), off);
+    memset(&ip, 0, sizeof ip);
+    // As in keyToVP: zero first, then claim.
+    Util::compiler_membar();
+    ip.m_tag = h;
+    return &ip;
+  }
+  return nullptr;
+}
+
+static inline void inc(Counter& c) {
+  if (c != kMaxCounter) c++;
+}
+
+void recordInstrType(const Func* func, Offset off, DataType dt) {
+  if (!instrProfiles || !shouldProfile()) return;
+  if (dt == KindOfStaticString) dt = KindOfString;
+  InstrProfile* prof = keyToIP(func, off, KeyToVPMode::Write);
+  if (prof->m_totalSamples != kMaxCounter) {
+    prof->m_totalSamples++;
+    inc(prof->m_samples[getDataTypeIndex(dt)]);
+  }
+}
+
+void recordBranch(const Func* func, Offset off, bool taken) {
+  if (!instrProfiles || !shouldProfile()) return;
+  InstrProfile* prof = keyToIP(func, off, KeyToVPMode::Write);
+  inc(taken ? prof->m_taken : prof->m_notTaken);
+}
+
+void recordCallTarget(const Func* func, Offset off, const Func* callee) {
+  if (!instrProfiles || !shouldProfile()) return;
+  InstrProfile* prof = keyToIP(func, off, KeyToVPMode::Write);
+  if (prof->m_calls == kMaxCounter) return;
+  prof->m_calls++;
+  // We only track the first callee seen; that's enough to tell whether
+  // the site is monomorphic.
+  uint32_t h = uint32_t(callee->fullName()->hash());
+  if (prof->m_calleeHits == 0) {
+    prof->m_callee = h;
+    prof->m_calleeHits = 1;
+  } else if (prof->m_callee == h) {
+    prof->m_calleeHits++;
+  }
+}
+
+PredVal predictInstrType(const Func* func, Offset off) {
+  PredVal kNullPred = std::make_pair(KindOfUninit, 0.0);
+  if (!instrProfiles) return kNullPred;
+  const InstrProfile* prof = keyToIP(func, off, KeyToVPMode::Read);
+  if (!prof || prof->m_totalSamples < kMinInstances) return kNullPred;
+  double total = prof->m_totalSamples;
+  double maxProb = 0.0;
+  DataType pred = KindOfUninit;
+  for (int i = 0; i < MaxNumDataTypesIndex; ++i) {
+    double prob = (1.0 * prof->m_samples[i]) / total;
+    if (prob > maxProb) {
+      maxProb = prob;
+      pred = getDataTypeValue(i);
+    }
+  }
+  TRACE(2, "predictInstrType: %s@%d numSamples %d pred %d prob %g\n",
+        func->fullName()->data(), off, prof->m_totalSamples, pred, maxProb);
+  if (maxProb > 1.0) maxProb = 1.0;
+  return std::make_pair(pred, maxProb);
+}
+
+double predictBranchTaken(const Func* func, Offset off) {
+  if (!instrProfiles) return -1.0;
+  const InstrProfile* prof = keyToIP(func, off, KeyToVPMode::Read);
+  if (!prof) return -1.0;
+  double total = double(prof->m_taken) + prof->m_notTaken;
+  if (total < kMinInstances) return -1.0;
+  return prof->m_taken / total;
+}
+
+double predictCallTarget(const Func* func, Offset off, const Func* callee) {
+  if (!instrProfiles) return 0.0;
+  const InstrProfile* prof = keyToIP(func, off, KeyToVPMode::Read);
+  if (!prof || prof->m_calls < kMinInstances ||
+      prof->m_callee != uint32_t(callee->fullName()->hash())) {
+    return 0.0;
+  }
+  double share = double(prof->m_calleeHits) / prof->m_calls;
+  return share > 1.0 ? 1.0 : share;
+}
+
 bool isProfileOpcode(const PC& pc) {
   return *pc == OpRetC || *pc == OpCGetM;
 }
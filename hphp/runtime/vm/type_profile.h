@@ -22,6 +22,7 @@
 namespace HPHP {
 
 class StringData;
+class Func;
 
 
 struct TypeProfileKey {
@@ -49,6 +50,26 @@ void recordType(TypeProfileKey sk, DataType dt);
 std::pair<DataType, double> predictType(TypeProfileKey key);
 bool isProfileOpcode(const PC& pc);
 
+/*
+ * Per-instruction profiles; best-effort like the above.  The result of
+ * FCall and FCallArray is recorded at the return offset, i.e. the
+ * offset of the instruction following the call.
+ *
+ * predictBranchTaken returns the fraction of executions that took the
+ * branch, or a negative value if there's too little data.
+ * predictCallTarget returns the fraction of calls that went to callee.
+ */
+void recordInstrType(const Func* func, Offset off, DataType dt);
+void recordBranch(const Func* func, Offset off, bool taken);
+void recordCallTarget(const Func* func, Offset off, const Func* callee);
+std::pair<DataType, double> predictInstrType(const Func* func, Offset off);
+double predictBranchTaken(const Func* func, Offset off);
+double predictCallTarget(const Func* func, Offset off, const Func* callee);
+
+// True once EvalJitWarmupRequests requests have started, after which
+// profiling data stops being collected.
+bool warmedUp();
+
 extern __thread bool profileOn;
 inline bool shouldProfile() {
   return profileOn;
@@ -627,6 +627,55 @@ Class* Unit::defClass(const PreClass* preClass,
   }
 }
 
+static bool classDepsDefined(const PreClass* preClass) {
+  if (preClass->parent()->size() != 0 &&
+      !Unit::lookupClass(preClass->parent())) {
+    return false;
+  }
+  for (auto const& name : preClass->interfaces()) {
+    if (!Unit::lookupClass(name)) return false;
+  }
+  for (auto const& name : preClass->usedTraits()) {
+    if (!Unit::lookupClass(name)) return false;
+  }
+  return true;
+}
+
+size_t Unit::prebuildClasses(const std::vector<Unit*>& units) {
+  std::vector<const PreClass*> pending;
+  for (auto unit : units) {
+    for (auto const& pcls : unit->preclasses()) {
+      pending.push_back(pcls.get());
+    }
+  }
+
+  // Classes can only be built once everything they extend, implement
+  // or use is defined, and nothing here is allowed to autoload, so keep
+  // going around until a pass makes no progress.
+  size_t defined = 0;
+  for (;;) {
+    std::vector<const PreClass*> blocked;
+    for (auto preClass : pending) {
+      if (lookupClass(preClass->namedEntity())) continue;
+      if (!classDepsDefined(preClass)) {
+        blocked.push_back(preClass);
+        continue;
+      }
+      try {
+        if (defClass(preClass, false)) ++defined;
+      } catch (const std::exception& e) {
+        // The class is broken in a way the first request to define it
+        // will report; don't let it hold up the rest.
+        TRACE(1, "prebuilding class %s failed: %s\n",
+              preClass->name()->data(), e.what());
+      }
+    }
+    if (blocked.size() == pending.size()) break;
+    pending.swap(blocked);
+  }
+  return defined;
+}
+
 bool Unit::aliasClass(Class* original, const StringData* alias) {
   auto const aliasNe = Unit::GetNamedEntity(alias);
 
@@ -476,6 +476,16 @@ struct Unit {
   static Class* defClass(const HPHP::PreClass* preClass,
                          bool failIsFatal = true);
   static bool aliasClass(Class* original, const StringData* alias);
+
+  /*
+   * Create the Class for every PreClass in units whose parent,
+   * interfaces and traits can be resolved without autoloading, so that
+   * later requests defining them find a Class to reuse instead of
+   * building one.  Must be called from within a session; the classes
+   * are defined in that session as a side effect.  Returns the number
+   * of classes defined.
+   */
+  static size_t prebuildClasses(const std::vector<Unit*>& units);
   void defTypedef(Id id);
 
   static TypedValue* lookupCns(const StringData* cnsName);
@@ -698,6 +708,7 @@ private:
 
 class UnitEmitter {
   friend class UnitRepoProxy;
+  friend class RepoImage;
   friend class ::HPHP::Compiler::Peephole;
  public:
   explicit UnitEmitter(const MD5& md5);
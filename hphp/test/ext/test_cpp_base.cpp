@@ -24,10 +24,20 @@
 #include "hphp/runtime/ext/ext_mysql.h"
 #include "hphp/runtime/ext/ext_curl.h"
 #include "hphp/runtime/base/shared/shared_store_base.h"
+#include "hphp/runtime/base/shared/concurrent_shared_store.h"
+#include "hphp/runtime/base/program_functions.h"
 #include "hphp/runtime/base/runtime_option.h"
 #include "hphp/runtime/base/server/ip_block_map.h"
+#include "hphp/runtime/base/server/unit_preloader.h"
+#include "hphp/runtime/base/file_repository.h"
+#include "hphp/runtime/vm/runtime.h"
+#include "hphp/runtime/vm/unit.h"
 #include "hphp/test/ext/test_mysql_info.h"
 #include "hphp/system/systemlib.h"
+#include "hphp/util/async_func.h"
+
+#include <fstream>
+#include <sys/mman.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -39,11 +49,18 @@ TestCppBase::TestCppBase() {
 bool TestCppBase::RunTests(const std::string &which) {
   bool ret = true;
   RUN_TEST(TestSmartAllocator);
+  RUN_TEST(TestSmartMallocSizeClasses);
+  RUN_TEST(TestSlabCache);
   RUN_TEST(TestString);
   RUN_TEST(TestArray);
+  RUN_TEST(TestArrayKeyAtPageEnd);
   RUN_TEST(TestObject);
   RUN_TEST(TestVariant);
   RUN_TEST(TestIpBlockMap);
+  RUN_TEST(TestLockFreeSharedStore);
+  RUN_TEST(TestStaticStrings);
+  RUN_TEST(TestUnitPreloader);
+  RUN_TEST(TestPrebuildClasses);
   return ret;
 }
 
@@ -118,6 +135,133 @@ bool TestCppBase::TestSmartAllocator() {
   return Count(true);
 }
 
+namespace {
+
+/*
+ * These run on a thread of their own, outside any request, so rollback()
+ * can throw away the whole heap without pulling it out from under the
+ * test harness.
+ */
+class HeapChecker {
+public:
+  HeapChecker() : m_errors(0) {}
+
+  void check(bool ok, const char* what) {
+    if (!ok) {
+      printf("%s\n", what);
+      ++m_errors;
+    }
+  }
+
+  void sizeClasses() {
+    MemoryManager* mm = MemoryManager::TheMemoryManager();
+    const int64_t& usage = mm->getStats().usage;
+    const size_t kHeader = 16; // medium blocks carry a SweepNode
+    // 4 classes per power of two, from kMaxSmartSize up to kMaxMediumSize
+    std::vector<size_t> classes;
+    for (unsigned lg = 11; lg < 20; ++lg) {
+      for (size_t step = 1; step <= 4; ++step) {
+        classes.push_back((size_t(1) << lg) + (step << (lg - 2)));
+      }
+    }
+    check(classes.size() == 36, "36 medium size classes");
+    check(classes.back() == MemoryManager::kMaxMediumSize,
+          "the last class is kMaxMediumSize");
+
+    // 2040 bytes plus an 8-byte header is the largest small block.
+    size_t lo = 2041;
+    for (size_t cls : classes) {
+      for (size_t nbytes : { lo, cls - kHeader }) {
+        int64_t before = usage;
+        void* p = smart_malloc(nbytes);
+        check(usage - before == int64_t(cls), "usage grows by the class");
+        memset(p, 0x5c, nbytes);
+        smart_free(p);
+        check(usage == before, "free gives back the class");
+        void* q = smart_malloc(nbytes);
+        check(q == p, "a freed block is reused for its class");
+        smart_free(q);
+      }
+      lo = cls - kHeader + 1;
+    }
+
+    // Free lists are LIFO, whatever size in the class is asked for.
+    void* blocks[3];
+    for (auto& b : blocks) b = smart_malloc(5000);
+    for (auto b : blocks) smart_free(b);
+    check(smart_malloc(4100) == blocks[2], "free list round trip");
+    check(smart_malloc(5120 - kHeader) == blocks[1], "free list round trip");
+    check(smart_malloc(4500) == blocks[0], "free list round trip");
+    mm->rollback();
+  }
+
+  void slabCache() {
+    MemoryManager* mm = MemoryManager::TheMemoryManager();
+    auto const saved = RuntimeOption::EvalRequestHeapCacheSlabs;
+    auto slabOf = [] (void* p) {
+      return (char*)(uintptr_t(p) & ~uintptr_t(SLAB_SIZE - 1));
+    };
+
+    RuntimeOption::EvalRequestHeapCacheSlabs = 0;
+    mm->rollback();
+    smart_malloc(64);
+    // The malloc'd slab is freed before the new limit is picked up.
+    RuntimeOption::EvalRequestHeapCacheSlabs = 2;
+    mm->rollback();
+
+    // Cached slabs are SLAB_SIZE-aligned mappings: a small slab and a
+    // medium chunk each start with the first block's header.
+    char* small = (char*)smart_malloc(64);
+    char* medium = (char*)smart_malloc(100000);
+    check(uintptr_t(small - 8) % SLAB_SIZE == 0, "small slab is aligned");
+    check(uintptr_t(medium - 16) % SLAB_SIZE == 0, "medium chunk is aligned");
+    mm->rollback();
+
+    // The next request gets the same two slabs back.
+    char* small2 = slabOf(smart_malloc(64));
+    char* medium2 = slabOf(smart_malloc(100000));
+    check((small2 == slabOf(small) && medium2 == slabOf(medium)) ||
+          (small2 == slabOf(medium) && medium2 == slabOf(small)),
+          "cached slabs are reused");
+    // A third slab goes over the limit, so rollback unmaps it.
+    for (unsigned i = 0; i < SLAB_SIZE / 2048 + 1; ++i) smart_malloc(2040);
+    mm->rollback();
+
+    // Lowering the limit unmaps what's cached; slabs come from malloc.
+    RuntimeOption::EvalRequestHeapCacheSlabs = 0;
+    mm->rollback();
+    memset(smart_malloc(64), 0, 64);
+    mm->rollback();
+    RuntimeOption::EvalRequestHeapCacheSlabs = saved;
+    mm->rollback();
+  }
+
+  int errors() const { return m_errors; }
+
+private:
+  int m_errors;
+};
+
+bool runHeapChecker(void (HeapChecker::*func)()) {
+  HeapChecker checker;
+  AsyncFunc<HeapChecker> f(&checker, func);
+  f.start();
+  f.waitForEnd();
+  return checker.errors() == 0;
+}
+
+}
+
+bool TestCppBase::TestSmartMallocSizeClasses() {
+  VERIFY(runHeapChecker(&HeapChecker::sizeClasses));
+  return Count(true);
+}
+
+bool TestCppBase::TestSlabCache() {
+  VERIFY(runHeapChecker(&HeapChecker::slabCache));
+  return Count(true);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // data types
 
@@ -606,6 +750,39 @@ bool TestCppBase::TestArray() {
   return Count(true);
 }
 
+/*
+ * Keys whose last byte is the last byte of a page followed by an
+ * unmapped page: looking one up by an equal key must compare the bytes
+ * without reading past either key.
+ */
+bool TestCppBase::TestArrayKeyAtPageEnd() {
+  const size_t kPage = sysconf(_SC_PAGESIZE);
+  char* pages[2];
+  for (auto& p : pages) {
+    p = (char*)mmap(nullptr, 2 * kPage, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    VERIFY(p != MAP_FAILED);
+    VERIFY(mprotect(p + kPage, kPage, PROT_NONE) == 0);
+  }
+  const char kBytes[] = "abcdefghijklmnopqrstuvwxyz";
+  for (int len = 1; len <= 20; ++len) {
+    // Each key's terminating NUL is the last byte of its page.
+    char* a = pages[0] + kPage - 1 - len;
+    char* b = pages[1] + kPage - 1 - len;
+    memcpy(a, kBytes, len); a[len] = '\0';
+    memcpy(b, kBytes, len); b[len] = '\0';
+
+    Array arr = Array::Create();
+    arr.set(String(a, len, AttachLiteral), len);
+    VS(arr[String(b, len, AttachLiteral)], len);
+    b[len - 1] = 'Z';
+    VERIFY(!arr.exists(String(b, len, AttachLiteral)));
+  }
+  for (auto p : pages) munmap(p, 2 * kPage);
+
+  return Count(true);
+}
+
 bool TestCppBase::TestObject() {
   {
     String s = "O:1:\"B\":1:{s:3:\"obj\";O:1:\"A\":1:{s:1:\"a\";i:10;}}";
@@ -941,3 +1118,455 @@ bool TestCppBase::TestIpBlockMap() {
 
   return Count(true);
 }
+
+///////////////////////////////////////////////////////////////////////////////
+// apc
+
+namespace {
+
+const int kApcWriters = 4;
+// Enough keys in total to outgrow the table's initial buckets while the
+// writers are running.
+const int kApcKeysPerWriter = 2048;
+const int kApcKeys = kApcWriters * kApcKeysPerWriter;
+const int kApcRounds = 4;
+const int kApcPrimed = 16;
+
+String apcKey(int i) {
+  return String("lockfree." + std::to_string(i));
+}
+
+/*
+ * Each writer owns a range of keys and checks its own view of them
+ * exactly; readers fetch every key and check only that whatever they see
+ * is a value that was stored under it.  Every value stored under key i
+ * is i plus a multiple of kApcKeys.
+ */
+class ApcWorker {
+public:
+  ApcWorker(SharedStore& store, int first, std::atomic<int>& errors,
+            std::atomic<bool>& done)
+    : m_store(store), m_first(first), m_errors(errors), m_done(done) {}
+
+  void write() {
+    hphp_session_init();
+    auto context = hphp_context_init();
+    for (int round = 0; round < kApcRounds; ++round) {
+      for (int i = m_first; i < m_first + kApcKeysPerWriter; ++i) {
+        String key = apcKey(i);
+        int64_t val = i + int64_t(round) * kApcKeys;
+        Variant v;
+        if (!m_store.store(key, val, 0) || !m_store.get(key, v) ||
+            !v.isInteger() || v.toInt64() != val) {
+          ++m_errors;
+        }
+        if (i & 1) {
+          if (!m_store.erase(key) || m_store.exists(key)) ++m_errors;
+        }
+      }
+    }
+    hphp_context_exit(context, false, false);
+    hphp_session_exit();
+  }
+
+  void read() {
+    hphp_session_init();
+    auto context = hphp_context_init();
+    while (!m_done.load()) {
+      for (int i = 0; i < kApcKeys; ++i) {
+        Variant v;
+        if (m_store.get(apcKey(i), v) &&
+            (!v.isInteger() || v.toInt64() < i ||
+             (v.toInt64() - i) % kApcKeys != 0)) {
+          ++m_errors;
+        }
+      }
+    }
+    hphp_context_exit(context, false, false);
+    hphp_session_exit();
+  }
+
+private:
+  SharedStore& m_store;
+  int m_first;
+  std::atomic<int>& m_errors;
+  std::atomic<bool>& m_done;
+};
+
+typedef boost::shared_ptr<ApcWorker> ApcWorkerPtr;
+typedef AsyncFunc<ApcWorker> ApcWorkerFunc;
+typedef boost::shared_ptr<ApcWorkerFunc> ApcWorkerFuncPtr;
+
+std::vector<ApcWorkerFuncPtr>
+startApcWorkers(const std::vector<ApcWorkerPtr>& workers,
+                void (ApcWorker::*func)()) {
+  std::vector<ApcWorkerFuncPtr> funcs;
+  for (auto& w : workers) {
+    funcs.push_back(ApcWorkerFuncPtr(new ApcWorkerFunc(w.get(), func)));
+    funcs.back()->start();
+  }
+  return funcs;
+}
+
+void waitForApcWorkers(const std::vector<ApcWorkerFuncPtr>& funcs) {
+  for (auto& f : funcs) f->waitForEnd();
+}
+
+}
+
+bool TestCppBase::TestLockFreeSharedStore() {
+  LockFreeTableSharedStore lockfree(0);
+  SharedStore& store = lockfree;
+
+  // primed keys
+  {
+    std::vector<std::string> keys;
+    for (int i = 0; i < kApcPrimed; ++i) {
+      keys.push_back("primed." + std::to_string(i));
+    }
+    std::vector<SharedStore::KeyValuePair> vars(kApcPrimed);
+    for (int i = 0; i < kApcPrimed; ++i) {
+      vars[i].key = keys[i].c_str();
+      vars[i].len = keys[i].size();
+      store.constructPrime(int64_t(i), vars[i]);
+    }
+    store.prime(vars);
+    store.primeDone();
+  }
+  VS(store.size(), kApcPrimed);
+  for (int i = 0; i < kApcPrimed; ++i) {
+    Variant v;
+    VERIFY(store.get(String("primed." + std::to_string(i)), v));
+    VS(v, i);
+  }
+  {
+    bool found;
+    VS(store.inc("primed.0", 5, found), 5);
+    VERIFY(found);
+    VERIFY(store.cas("primed.1", 1, 10));
+    VERIFY(!store.cas("primed.1", 1, 11));
+    VERIFY(!store.store("primed.2", "two", 0, false));
+    VERIFY(store.store("primed.2", "two", 0));
+    VERIFY(store.erase("primed.3"));
+    VERIFY(!store.exists("primed.3"));
+    Variant v;
+    VERIFY(store.get("primed.0", v)); VS(v, 5);
+    VERIFY(store.get("primed.1", v)); VS(v, 10);
+    VERIFY(store.get("primed.2", v)); VS(v, "two");
+    VS(store.size(), kApcPrimed - 1);
+  }
+
+  // concurrent insert/replace/erase, growing the table under traffic
+  std::atomic<int> errors(0);
+  std::atomic<bool> done(false);
+  std::vector<ApcWorkerPtr> workers;
+  for (int i = 0; i < kApcWriters; ++i) {
+    workers.push_back(ApcWorkerPtr(
+      new ApcWorker(store, i * kApcKeysPerWriter, errors, done)));
+  }
+  {
+    auto readers = startApcWorkers(workers, &ApcWorker::read);
+    waitForApcWorkers(startApcWorkers(workers, &ApcWorker::write));
+    done = true;
+    waitForApcWorkers(readers);
+  }
+
+  VS(errors.load(), 0);
+  VS(store.size(), kApcPrimed - 1 + kApcKeys / 2);
+  for (int i = 0; i < kApcKeys; ++i) {
+    Variant v;
+    if (i & 1) {
+      VERIFY(!store.get(apcKey(i), v));
+    } else {
+      VERIFY(store.get(apcKey(i), v));
+      VS(v, i + int64_t(kApcRounds - 1) * kApcKeys);
+    }
+  }
+
+  // clear, with readers running
+  bool cleared;
+  {
+    done = false;
+    auto readers = startApcWorkers(workers, &ApcWorker::read);
+    cleared = store.clear();
+    done = true;
+    waitForApcWorkers(readers);
+  }
+  VERIFY(cleared);
+  VS(errors.load(), 0);
+  VS(store.size(), 0);
+  VERIFY(!store.exists(apcKey(0)));
+  VERIFY(!store.exists("primed.0"));
+
+  VERIFY(store.store(apcKey(0), 42, 0));
+  Variant v;
+  VERIFY(store.get(apcKey(0), v));
+  VS(v, 42);
+  VS(store.size(), 1);
+
+  return Count(true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// static strings
+
+namespace {
+
+const int kStaticStringWorkers = 4;
+
+std::string staticName(size_t i) {
+  return "static.string." + std::to_string(i);
+}
+
+/*
+ * Every interner interns every name, each starting at a different point
+ * so they race to insert the same strings; readers look names up
+ * without the lock and check whatever they find.
+ */
+class StaticStringWorker {
+public:
+  StaticStringWorker(size_t count, size_t first, std::atomic<int>& errors,
+                     std::atomic<bool>& done)
+    : m_count(count), m_first(first), m_errors(errors), m_done(done) {}
+
+  void intern() {
+    m_interned.resize(m_count);
+    for (size_t n = 0; n < m_count; ++n) {
+      size_t i = (m_first + n) % m_count;
+      std::string name = staticName(i);
+      StringData* sd = StringData::GetStaticString(name);
+      if (!sd->isStatic() || sd->toCPPString() != name ||
+          StringData::LookupStaticString(sd) != sd) {
+        ++m_errors;
+      }
+      m_interned[i] = sd;
+    }
+  }
+
+  void lookup() {
+    while (!m_done.load()) {
+      for (size_t i = m_first; i < m_count; i += kStaticStringWorkers) {
+        std::string name = staticName(i);
+        StackStringData key(name.c_str(), name.size(), AttachLiteral);
+        StringData* sd = StringData::LookupStaticString(&key);
+        if (sd && (!sd->isStatic() || !sd->same(&key))) ++m_errors;
+      }
+    }
+  }
+
+  const std::vector<StringData*>& interned() const { return m_interned; }
+
+private:
+  size_t m_count;
+  size_t m_first;
+  std::atomic<int>& m_errors;
+  std::atomic<bool>& m_done;
+  std::vector<StringData*> m_interned;
+};
+
+typedef boost::shared_ptr<StaticStringWorker> StaticStringWorkerPtr;
+typedef AsyncFunc<StaticStringWorker> StaticStringWorkerFunc;
+typedef boost::shared_ptr<StaticStringWorkerFunc> StaticStringWorkerFuncPtr;
+
+}
+
+bool TestCppBase::TestStaticStrings() {
+  auto before = StringData::GetStaticStringStats();
+  // Enough new strings to grow the table at least once.
+  size_t count = before.capacity / 2 - before.count + 1024;
+
+  std::atomic<int> errors(0);
+  std::atomic<bool> done(false);
+  std::vector<StaticStringWorkerPtr> workers;
+  for (int w = 0; w < kStaticStringWorkers; ++w) {
+    workers.push_back(StaticStringWorkerPtr(new StaticStringWorker(
+      count, w * count / kStaticStringWorkers, errors, done)));
+  }
+  {
+    std::vector<StaticStringWorkerFuncPtr> readers, interners;
+    for (auto& w : workers) {
+      readers.push_back(StaticStringWorkerFuncPtr(
+        new StaticStringWorkerFunc(w.get(), &StaticStringWorker::lookup)));
+      readers.back()->start();
+    }
+    for (auto& w : workers) {
+      interners.push_back(StaticStringWorkerFuncPtr(
+        new StaticStringWorkerFunc(w.get(), &StaticStringWorker::intern)));
+      interners.back()->start();
+    }
+    for (auto& f : interners) f->waitForEnd();
+    done = true;
+    for (auto& f : readers) f->waitForEnd();
+  }
+  VS(errors.load(), 0);
+
+  // Everyone got the same StringData for each name, and it survived the
+  // growth.
+  for (size_t i = 0; i < count; ++i) {
+    StringData* sd = workers[0]->interned()[i];
+    for (int w = 1; w < kStaticStringWorkers; ++w) {
+      VERIFY(workers[w]->interned()[i] == sd);
+    }
+    std::string name = staticName(i);
+    StackStringData key(name.c_str(), name.size(), AttachLiteral);
+    VERIFY(StringData::LookupStaticString(&key) == sd);
+  }
+
+  auto after = StringData::GetStaticStringStats();
+  VS((int64_t)after.count, (int64_t)(before.count + count));
+  VERIFY(after.resizes > before.resizes);
+  VERIFY(after.count * 2 <= after.capacity);
+  VERIFY(after.retiredBytes > before.retiredBytes);
+  // The retired tables hold fewer (16-byte) slots than the live one.
+  VERIFY(after.retiredBytes < after.capacity * 16);
+
+  return Count(true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// unit preloading
+
+namespace {
+
+class UnitPathCollector : public UnitVisitor {
+public:
+  virtual void operator()(Unit* u) {
+    m_paths.insert(u->filepath()->data());
+  }
+  std::set<std::string> m_paths;
+};
+
+}
+
+bool TestCppBase::TestUnitPreloader() {
+  char dir[] = "/tmp/hphp_preload_XXXXXX";
+  VERIFY(mkdtemp(dir));
+  const int kFiles = 8;
+  std::vector<std::string> files;
+  for (int i = 0; i < kFiles; ++i) {
+    files.push_back(std::string(dir) + "/p" + std::to_string(i) + ".php");
+    std::ofstream f(files.back().c_str());
+    f << "<?php\nfunction preload_test_" << i << "() { return " << i
+      << "; }\n";
+  }
+  // Comments, blank lines and missing files are skipped.
+  std::string hotList = std::string(dir) + "/hot.txt";
+  {
+    std::ofstream f(hotList.c_str());
+    f << "# hottest first\n" << files[3] << "\n\n"
+      << std::string(dir) << "/missing.php\n";
+    for (auto& file : files) f << file << "\n";
+  }
+
+  auto const savedThreads = RuntimeOption::ServerPreloadThreads;
+  auto const savedHotList = RuntimeOption::ServerPreloadHotList;
+  size_t before = Eval::FileRepository::getLoadedFiles();
+
+  // Nothing happens without threads.
+  RuntimeOption::ServerPreloadThreads = 0;
+  RuntimeOption::ServerPreloadHotList = hotList;
+  UnitPreloader::Run();
+  VS((int64_t)Eval::FileRepository::getLoadedFiles(), (int64_t)before);
+
+  RuntimeOption::ServerPreloadThreads = 3;
+  UnitPreloader::Run();
+  RuntimeOption::ServerPreloadThreads = savedThreads;
+  RuntimeOption::ServerPreloadHotList = savedHotList;
+
+  VS((int64_t)Eval::FileRepository::getLoadedFiles(),
+     (int64_t)(before + kFiles));
+  UnitPathCollector collector;
+  Eval::FileRepository::forEachUnit(collector);
+  for (auto& file : files) {
+    VERIFY(collector.m_paths.count(file));
+    unlink(file.c_str());
+  }
+  unlink(hotList.c_str());
+  rmdir(dir);
+
+  return Count(true);
+}
+
+namespace {
+
+/*
+ * Children come before their parents, interfaces and traits, across
+ * two units, so prebuildClasses needs several passes.  PrebuildOrphan's
+ * parent never shows up, and PrebuildBad can't be built at all.
+ */
+const char* kPrebuildChildren =
+  "<?php\n"
+  "class PrebuildC extends PrebuildB {}\n"
+  "class PrebuildE implements PrebuildI {}\n"
+  "class PrebuildOrphan extends PrebuildMissing {}\n"
+  "class PrebuildUser { use PrebuildTrait; }\n"
+  "class PrebuildBad extends PrebuildI {}\n";
+const char* kPrebuildParents =
+  "<?php\n"
+  "class PrebuildB extends PrebuildA {}\n"
+  "interface PrebuildI {}\n"
+  "trait PrebuildTrait {}\n"
+  "class PrebuildA {}\n";
+
+class ClassPrebuilder {
+public:
+  ClassPrebuilder() : m_errors(0) {}
+
+  void check(bool ok, const char* what) {
+    if (!ok) {
+      printf("%s\n", what);
+      ++m_errors;
+    }
+  }
+
+  void run() {
+    hphp_session_init();
+    auto context = hphp_context_init();
+    std::vector<Unit*> units;
+    units.push_back(compile_string(kPrebuildChildren,
+                                   strlen(kPrebuildChildren),
+                                   "prebuild_children.php"));
+    units.push_back(compile_string(kPrebuildParents,
+                                   strlen(kPrebuildParents),
+                                   "prebuild_parents.php"));
+    check(units[0] && units[1], "units compile");
+    if (units[0] && units[1]) {
+      check(Unit::prebuildClasses(units) == 7, "seven classes built");
+      const char* built[] = {
+        "PrebuildA", "PrebuildB", "PrebuildC", "PrebuildI", "PrebuildE",
+        "PrebuildTrait", "PrebuildUser"
+      };
+      for (auto name : built) {
+        check(Unit::lookupClass(StringData::GetStaticString(name)), name);
+      }
+      check(!Unit::lookupClass(StringData::GetStaticString("PrebuildOrphan")),
+            "PrebuildOrphan isn't built");
+      check(!Unit::lookupClass(StringData::GetStaticString("PrebuildBad")),
+            "PrebuildBad isn't built");
+      Class* b = Unit::lookupClass(StringData::GetStaticString("PrebuildB"));
+      check(b && b->parent() ==
+            Unit::lookupClass(StringData::GetStaticString("PrebuildA")),
+            "PrebuildB extends PrebuildA");
+      // Everything buildable is already defined.
+      check(Unit::prebuildClasses(units) == 0, "second run builds nothing");
+    }
+    hphp_context_exit(context, false, false);
+    hphp_session_exit();
+  }
+
+  int errors() const { return m_errors; }
+
+private:
+  int m_errors;
+};
+
+}
+
+bool TestCppBase::TestPrebuildClasses() {
+  ClassPrebuilder prebuilder;
+  AsyncFunc<ClassPrebuilder> f(&prebuilder, &ClassPrebuilder::run);
+  f.start();
+  f.waitForEnd();
+  VS(prebuilder.errors(), 0);
+  return Count(true);
+}
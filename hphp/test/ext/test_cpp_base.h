@@ -39,8 +39,22 @@ class TestCppBase : public TestBase {
 
   // building blocks
   bool TestSmartAllocator();
+  // smart_malloc medium size classes and the huge-page slab cache
+  bool TestSmartMallocSizeClasses();
+  bool TestSlabCache();
   bool TestIpBlockMap();
 
+  // lock-free APC table: priming, concurrent updates, growth and clear
+  bool TestLockFreeSharedStore();
+
+  // static string table: concurrent interning and lookup across growth
+  bool TestStaticStrings();
+
+  // loading the units on Server.Preload.HotList at startup
+  bool TestUnitPreloader();
+  // building classes from preloaded units, in dependency order
+  bool TestPrebuildClasses();
+
   /**
    * Date types. This in turn tests StringData, ArrayData, String,
    * ArrayIter, and other classes.
@@ -55,6 +69,7 @@ class TestCppBase : public TestBase {
    */
   bool TestString();
   bool TestArray();
+  bool TestArrayKeyAtPageEnd();
   bool TestObject();
   bool TestVariant();
   bool TestListAssignment();
@@ -228,6 +228,7 @@ bool TestServer::RunTests(const std::string &which) {
   RUN_TEST(TestRPCServer);
   RUN_TEST(TestXboxServer);
   RUN_TEST(TestPageletServer);
+  RUN_TEST(TestHeapProfiler);
 
   return ret;
 }
@@ -792,3 +793,42 @@ bool TestServer::TestPageletServer() {
 
   return true;
 }
+
+bool TestServer::TestHeapProfiler() {
+  // The first request samples its own heap growth; the profile is folded
+  // in when it ends, so the second request reads it back.
+  string admin = "http://' . php_uname('n') . ':" +
+    lexical_cast<string>(s_admin_port) + "/";
+  string input =
+    "<?php\n"
+    "function admin($cmd) {\n"
+    "  return file_get_contents('" + admin + "' . $cmd);\n"
+    "}\n"
+    "function grow() {\n"
+    "  $a = array();\n"
+    "  for ($i = 0; $i < 100000; $i++) $a[] = str_repeat('x', 100) . $i;\n"
+    "  return count($a);\n"
+    "}\n"
+    "if ($_GET['step'] == 'grow') {\n"
+    "  admin('prof-alloc-clear');\n"
+    "  admin('prof-alloc-on?bytes=65536');\n"
+    "  echo grow(), \"\\n\";\n"
+    "  admin('prof-alloc-off');\n"
+    "} else {\n"
+    "  $dump = admin('prof-alloc-dump');\n"
+    "  $peak = admin('prof-alloc-peak');\n"
+    "  $ok = preg_match('/^run_init::\\S+;grow (\\d+)$/m', $dump, $m) &&\n"
+    "    $m[1] > 0 && strpos($peak, '# peak usage ') === 0 &&\n"
+    "    strpos($peak, ';grow ') !== false;\n"
+    "  echo $ok ? \"ok\\n\" : $dump . $peak;\n"
+    "}\n";
+  const char* urls[2] = { "string?step=grow", "string?step=dump" };
+  const char* outputs[2] = { "100000\n", "ok\n" };
+  if (!Count(VerifyServerResponse(input.c_str(), outputs, urls, 2, "GET",
+                                  nullptr, nullptr, false,
+                                  __FILE__, __LINE__))) {
+    return false;
+  }
+
+  return true;
+}
@@ -65,6 +65,9 @@ public:
   // test PageletServer
   bool TestPageletServer();
 
+  // test the /prof-alloc-* heap profile admin commands
+  bool TestHeapProfiler();
+
 protected:
   void RunServer();
   void StopServer();
@@ -0,0 +1,95 @@
+<?php
+
+// Arrays of scalars and interned strings come back from apc_fetch as
+// uncounted arrays shared by every request; everything else takes the
+// SharedMap path.  Both must behave like ordinary values.
+
+function check($label, $got, $want) {
+  echo $label, ': ', $got === $want ? 'ok' : 'MISMATCH', "\n";
+  if ($got !== $want) {
+    var_dump($got, $want);
+  }
+}
+
+function modifyAfterFetch() {
+  $orig = array(1, 'two', 3.5, true, null, 'k' => 'v');
+  apc_store('flat', $orig);
+  $a = apc_fetch('flat');
+  check('fetch', $a, $orig);
+  $a[] = 'new';
+  $a[0] = 100;
+  $a['k'] = 'changed';
+  unset($a[1]);
+  check('local copy', $a, array(0 => 100, 2 => 3.5, 3 => true, 4 => null,
+                                'k' => 'changed', 5 => 'new'));
+  check('stored value', apc_fetch('flat'), $orig);
+  $b = apc_fetch('flat');
+  foreach ($b as $k => &$v) {
+    $v = 'x';
+  }
+  unset($v);
+  check('stored after foreach by ref', apc_fetch('flat'), $orig);
+}
+
+function nested() {
+  $orig = array('a' => array(1, 2, array('deep' => 'd')),
+                'b' => array(),
+                'c' => 'top');
+  apc_store('nested', $orig);
+  $a = apc_fetch('nested');
+  check('nested fetch', $a, $orig);
+  check('nested read', $a['a'][2]['deep'], 'd');
+  $a['a'][2]['deep'] = 'changed';
+  $a['b'][] = 'appended';
+  $inner = $a['a'];
+  $inner[] = 3;
+  check('nested local copy', $a['a'][2]['deep'] . count($a['b']) .
+        count($inner), 'changed14');
+  check('nested stored value', apc_fetch('nested'), $orig);
+}
+
+function outliveEntry() {
+  apc_store('gone', array('x', 'y', array('z')));
+  $a = apc_fetch('gone');
+  apc_delete('gone');
+  check('after delete', apc_fetch('gone'), false);
+  check('held after delete', $a, array('x', 'y', array('z')));
+
+  apc_store('replaced', array('old', array('old')));
+  $b = apc_fetch('replaced');
+  apc_store('replaced', array('new'));
+  check('held after overwrite', $b, array('old', array('old')));
+  check('overwritten value', apc_fetch('replaced'), array('new'));
+  $b[] = 'more';
+  check('modify after overwrite', count($b), 3);
+}
+
+function dynamicStrings() {
+  // Strings built at runtime aren't interned, so these arrays are
+  // stored the old way.
+  $s = str_repeat('ab', 3);
+  $k = 'key' . strlen($s);
+  $orig = array($s, $k => $s, 'n' => array($s . '!'));
+  apc_store('dynamic', $orig);
+  $a = apc_fetch('dynamic');
+  check('dynamic fetch', $a, $orig);
+  check('dynamic read', $a['key6'] . $a['n'][0], 'ababab' . 'ababab!');
+  $a['n'][] = 'more';
+  $a[0] = 'changed';
+  check('dynamic stored value', apc_fetch('dynamic'), $orig);
+  $c = apc_fetch('dynamic');
+  apc_delete('dynamic');
+  check('dynamic held after delete', $c,
+        array('ababab', 'key6' => 'ababab', 'n' => array('ababab!')));
+
+  // Mixing in one dynamic string anywhere, even deep down, has the same
+  // effect.
+  $mixed = array('lit', array('lit', array($s)));
+  apc_store('mixed', $mixed);
+  check('mixed fetch', apc_fetch('mixed'), $mixed);
+}
+
+modifyAfterFetch();
+nested();
+outliveEntry();
+dynamicStrings();
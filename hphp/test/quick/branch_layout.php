@@ -0,0 +1,65 @@
+<?php
+
+// Every tracelet below ends in a JmpZ or JmpNZ, so each one goes
+// through the first-bind service request: its first execution decides
+// which side is laid out as the fallthrough, and the other side gets
+// translated the first time it's taken.  The first call to each
+// function takes the rare side.
+
+function rareFirst($i) {
+  if ($i % 16 == 0) {
+    return 'rare';
+  }
+  return 'common';
+}
+
+function notZero($x) {
+  if (!$x) {
+    return 0;
+  }
+  return 1;
+}
+
+function nested($a, $b) {
+  if ($a) {
+    if ($b) return 3;
+    return 2;
+  }
+  if ($b) return 1;
+  return 0;
+}
+
+function loopSum($n) {
+  $t = 0;
+  for ($i = 0; $i < $n; ++$i) {
+    if ($i & 3) {
+      $t += $i;
+    } else {
+      $t -= $i;
+    }
+  }
+  return $t;
+}
+
+function check($label, $got, $want) {
+  echo $label, ': ', $got === $want ? 'ok' : 'FAIL got '.var_export($got, true)
+    .' want '.var_export($want, true), "\n";
+}
+
+$counts = array('rare' => 0, 'common' => 0);
+for ($i = 0; $i < 64; ++$i) $counts[rareFirst($i)]++;
+check('rareFirst', $counts, array('rare' => 4, 'common' => 60));
+
+$t = 0;
+foreach (array(0, 0, 1, 2, 0, 3, '', 'x', null, 4.5) as $x) $t += notZero($x);
+check('notZero', $t, 5);
+
+$got = array();
+foreach (array(array(0, 0), array(1, 1), array(1, 0), array(0, 1),
+               array(1, 1), array(0, 0)) as $p) {
+  $got[] = nested($p[0], $p[1]);
+}
+check('nested', $got, array(0, 3, 2, 1, 3, 0));
+
+check('loopSum', loopSum(100), 2550);
+check('loopSum again', loopSum(7), 13);
@@ -0,0 +1,79 @@
+<?php
+
+// Appends that may grow a string in place: loops of .= with each operand
+// type, and appends to strings that must not change underneath us
+// because they're shared or static.
+
+function check($label, $got, $want) {
+  echo $label, ': ', $got === $want ? 'ok' : 'FAIL got '.var_export($got, true)
+    .' want '.var_export($want, true), "\n";
+}
+
+function lit() {
+  return 'static';
+}
+
+function loops() {
+  $s = '';
+  for ($i = 0; $i < 10000; $i++) $s .= 'ab';
+  check('strings', strlen($s), 20000);
+  check('strings content', substr($s, 19996), 'abab');
+
+  $s = '';
+  for ($i = 0; $i < 1000; $i++) $s .= $i;
+  check('ints', strlen($s), 2890);
+  check('ints tail', substr($s, -6), '998999');
+
+  $s = 'd';
+  for ($i = 0; $i < 100; $i++) $s .= 0.5;
+  check('doubles', strlen($s), 301);
+
+  $s = 'b';
+  for ($i = 0; $i < 100; $i++) $s .= ($i & 1) == 1;
+  check('bools', $s, 'b' . str_repeat('1', 50));
+
+  $s = 'x';
+  for ($i = 0; $i < 10; $i++) $s .= $s;
+  check('self', strlen($s), 1024);
+
+  $s = 'c';
+  for ($i = 0; $i < 1000; $i++) $s = $s . 'z';
+  check('concat', strlen($s), 1001);
+}
+
+function shared() {
+  $a = str_repeat('s', 40);
+  $b = $a;
+  $a .= 'tail';
+  check('shared copy', $b, str_repeat('s', 40));
+  check('shared append', $a, str_repeat('s', 40) . 'tail');
+
+  $arr = array(str_repeat('t', 40));
+  $c = $arr[0];
+  $c .= 7;
+  check('array element', $arr[0], str_repeat('t', 40));
+  check('array copy', $c, str_repeat('t', 40) . '7');
+
+  $d = str_repeat('u', 40);
+  $e = &$d;
+  $e .= 1.5;
+  check('reference', $d, str_repeat('u', 40) . '1.5');
+}
+
+function statics() {
+  $s = lit();
+  $s .= ' one';
+  $t = lit();
+  $t .= 2;
+  check('static one', $s, 'static one');
+  check('static two', $t, 'static2');
+  check('static literal', lit(), 'static');
+  $u = 'literal';
+  for ($i = 0; $i < 3; $i++) $u .= true;
+  check('literal', $u, 'literal111');
+  check('literal again', 'literal', 'lit' . 'eral');
+}
+
+loops();
+shared();
+statics();
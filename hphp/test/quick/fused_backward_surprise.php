@@ -0,0 +1,19 @@
+<?php
+
+// The back edge of this loop is a comparison followed by JmpNZ, which
+// the interpreter runs as one instruction.  It must still check for
+// surprises: going over the memory limit only sets a flag, and nothing
+// else in the loop body would notice it.
+
+function fill() {
+  $a = array();
+  $i = 0;
+  do {
+    $a[] = 'item ' . $i;
+    $i++;
+  } while ($i < 10000000);
+  echo "not reached\n";
+}
+
+ini_set('memory_limit', '16M');
+fill();
@@ -0,0 +1,89 @@
+<?php
+
+// A comparison followed by JmpZ/JmpNZ runs as one instruction in the
+// interpreter.  Check it against the unfused comparison, whose result
+// is stored in a local instead of branched on.
+
+class C { public $x; function __construct($x) { $this->x = $x; } }
+
+function unfused($a, $b) {
+  $r = array();
+  $r[] = $x = $a === $b;
+  $r[] = $x = $a !== $b;
+  $r[] = $x = $a == $b;
+  $r[] = $x = $a != $b;
+  $r[] = $x = $a < $b;
+  $r[] = $x = $a <= $b;
+  $r[] = $x = $a > $b;
+  $r[] = $x = $a >= $b;
+  return $r;
+}
+
+// Each condition is a comparison followed by JmpZ.
+function jmpz($a, $b) {
+  $r = array();
+  if ($a === $b) $r[] = true; else $r[] = false;
+  if ($a !== $b) $r[] = true; else $r[] = false;
+  if ($a == $b)  $r[] = true; else $r[] = false;
+  if ($a != $b)  $r[] = true; else $r[] = false;
+  if ($a < $b)   $r[] = true; else $r[] = false;
+  if ($a <= $b)  $r[] = true; else $r[] = false;
+  if ($a > $b)   $r[] = true; else $r[] = false;
+  if ($a >= $b)  $r[] = true; else $r[] = false;
+  return $r;
+}
+
+// Negated conditions are a comparison followed by JmpNZ.
+function jmpnz($a, $b) {
+  $r = array();
+  if (!($a === $b)) $r[] = false; else $r[] = true;
+  if (!($a !== $b)) $r[] = false; else $r[] = true;
+  if (!($a == $b))  $r[] = false; else $r[] = true;
+  if (!($a != $b))  $r[] = false; else $r[] = true;
+  if (!($a < $b))   $r[] = false; else $r[] = true;
+  if (!($a <= $b))  $r[] = false; else $r[] = true;
+  if (!($a > $b))   $r[] = false; else $r[] = true;
+  if (!($a >= $b))  $r[] = false; else $r[] = true;
+  return $r;
+}
+
+// Comparing an object with a number or string raises notices, so
+// objects are only paired with objects, null and bools.
+function comparable($a, $b) {
+  if (!is_object($a) && !is_object($b)) return true;
+  foreach (array($a, $b) as $v) {
+    if (!is_object($v) && !is_null($v) && !is_bool($v)) return false;
+  }
+  return true;
+}
+
+function main() {
+  $o1 = new C(1);
+  $values = array(
+    null, true, false,
+    0, 1, -1, 42, PHP_INT_MAX,
+    0.0, 1.0, -1.5, 42.0,
+    "", "0", "1", "42", "42.0", " 42", "1e1", "abc", "ABC", "abd",
+    array(), array(1), array(1, 2), array("a" => 1), array(2),
+    $o1, $o1, new C(1), new C(2),
+  );
+
+  $pairs = 0;
+  $bad = 0;
+  foreach ($values as $i => $a) {
+    foreach ($values as $j => $b) {
+      if (!comparable($a, $b)) continue;
+      ++$pairs;
+      $expected = unfused($a, $b);
+      foreach (array('jmpz', 'jmpnz') as $f) {
+        if ($f($a, $b) !== $expected) {
+          ++$bad;
+          echo "$f mismatch for values $i and $j\n";
+        }
+      }
+    }
+  }
+  echo "compared $pairs pairs, $bad mismatches\n";
+}
+
+main();
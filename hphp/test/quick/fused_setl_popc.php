@@ -0,0 +1,56 @@
+<?php
+
+// "$x = ...;" is SetL followed by PopC, which the interpreter runs as
+// one instruction.  The old value of the local must still be released
+// right away.
+
+class D {
+  private $n;
+  function __construct($n) { $this->n = $n; echo "ctor {$this->n}\n"; }
+  function __destruct() { echo "dtor {$this->n}\n"; }
+}
+
+function overwrite() {
+  $x = new D(1);
+  echo "assigning int\n";
+  $x = 5;
+  echo "assigned int\n";
+  $x = new D(2);
+  echo "assigning object\n";
+  $x = new D(3);
+  echo "assigned object\n";
+  $x = null;
+  echo "cleared\n";
+}
+
+function overwriteRef() {
+  $x = new D(4);
+  $y = &$x;
+  echo "assigning through ref\n";
+  $y = "str";
+  echo "assigned through ref: $x\n";
+}
+
+function keepAlive() {
+  $x = new D(5);
+  $keep = $x;
+  $x = 1;
+  echo "still referenced\n";
+  $keep = 2;
+  echo "released\n";
+}
+
+function loop() {
+  $i = 0;
+  do {
+    $x = new D(10 + $i);
+    $i = $i + 1;
+  } while ($i < 3);
+  echo "loop done\n";
+}
+
+overwrite();
+overwriteRef();
+keepAlive();
+loop();
+echo "done\n";
@@ -0,0 +1,44 @@
+<?php
+
+// Runs with Eval.GCTriggerPct=50.  Each phase makes far more cyclic
+// garbage than the memory limit allows, so it only finishes if the
+// collector is triggered automatically as the heap nears the limit.
+
+class Node {
+  public $next;
+  public $a, $b, $c, $d, $e, $f, $g;
+}
+
+function makeCycles($n) {
+  for ($i = 0; $i < $n; $i++) {
+    $first = $prev = new Node;
+    for ($j = 0; $j < 9; $j++) {
+      $node = new Node;
+      $node->a = $i;
+      $prev->next = $node;
+      $prev = $node;
+    }
+    $prev->next = $first;
+  }
+}
+
+function phase($label, $limit, $n) {
+  makeCycles($n);
+  echo $label, ': done';
+  if ($limit > 0) {
+    echo ', usage ', memory_get_usage() < $limit ? 'below' : 'ABOVE',
+      ' limit';
+  }
+  echo "\n";
+}
+
+ini_set('memory_limit', '32M');
+phase('32M', 32 << 20, 40000);
+
+// Raising the limit moves the trigger up with it.
+ini_set('memory_limit', '64M');
+phase('64M', 64 << 20, 80000);
+
+// No limit, no automatic collection; keep this phase small.
+ini_set('memory_limit', '-1');
+phase('unlimited', 0, 5000);
@@ -0,0 +1,66 @@
+<?php
+
+// Runs with Eval.JitMaxTranslations=2 and Eval.JitLimitBailout=true.
+// The entries below see more types than the limit allows, so after two
+// translations each one interprets a single instruction and re-enters
+// the TC at the next.  Results must not depend on which path ran.
+
+class Foo {}
+
+function describe($x) {
+  $t = gettype($x);
+  if (is_array($x)) {
+    $s = count($x);
+  } else if (is_object($x)) {
+    $s = get_class($x);
+  } else {
+    $s = strval($x);
+  }
+  return $t . ':' . $s;
+}
+
+function add($a, $b) {
+  $r = $a + $b;
+  $r = $r * 2;
+  return gettype($r) . ' ' . $r;
+}
+
+function sumMixed($vals) {
+  $t = 0;
+  foreach ($vals as $v) {
+    $t += $v;
+  }
+  return $t;
+}
+
+function stable($label, $f) {
+  $res = array();
+  for ($pass = 0; $pass < 4; $pass++) {
+    $res[] = $f();
+  }
+  echo $label, ': ', $res[0], "\n";
+  $same = $res[0] === $res[1] && $res[1] === $res[2] && $res[2] === $res[3];
+  echo $label, ': ', $same ? 'stable' : 'UNSTABLE ' . implode(' | ', $res),
+    "\n";
+}
+
+stable('describe', function() {
+  $out = array();
+  foreach (array(1, 2.5, '3', true, null, array(1, 2), new Foo) as $v) {
+    $out[] = describe($v);
+  }
+  return implode(' ', $out);
+});
+
+stable('add', function() {
+  $out = array();
+  foreach (array(array(1, 2), array(1.5, 2), array('3', 4), array(true, 1),
+                 array(null, 5), array(2, '2.5')) as $p) {
+    $out[] = add($p[0], $p[1]);
+  }
+  return implode(', ', $out);
+});
+
+stable('sumMixed', function() {
+  return (string)sumMixed(array(1, 2.5, '3', true, null, 4));
+});
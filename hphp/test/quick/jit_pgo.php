@@ -0,0 +1,68 @@
+<?php
+
+// Runs with a low Eval.JitPGOThreshold, so each function below is
+// profiled for a few calls and then retranslated as an optimized
+// region.  Later calls send the optimized code types and paths it
+// didn't see while profiling.
+
+function sum($n) {
+  $t = 0;
+  for ($i = 0; $i < $n; ++$i) {
+    if ($i & 1) {
+      $t += $i;
+    } else {
+      $t -= 1;
+    }
+  }
+  return $t;
+}
+
+function pick($x) {
+  if (is_int($x)) return $x * 2;
+  if (is_string($x)) return strlen($x);
+  return -1;
+}
+
+class Acc {
+  private $v = 0;
+  public function add($x) { $this->v += $x; return $this; }
+  public function get() { return $this->v; }
+}
+
+function acc($n) {
+  $a = new Acc;
+  for ($i = 0; $i < $n; ++$i) $a->add($i);
+  return $a->get();
+}
+
+function check($label, $got, $want) {
+  echo $label, ': ', $got === $want ? 'ok' : 'FAIL got '.var_export($got, true)
+    .' want '.var_export($want, true), "\n";
+}
+
+// Profile, then run past the threshold with the same types.
+$s = 0;
+for ($i = 0; $i < 100; ++$i) $s += sum(10);
+check('sum hot', $s, 100 * 20);
+
+$p = 0;
+for ($i = 0; $i < 100; ++$i) $p += pick($i);
+check('pick hot', $p, 9900);
+
+$a = 0;
+for ($i = 0; $i < 100; ++$i) $a += acc(5);
+check('acc hot', $a, 1000);
+
+// Types and paths the profile never saw.
+check('sum double', sum(10.5), 19);
+check('sum zero', sum(0), 0);
+check('pick string', pick('hello'), 5);
+check('pick double', pick(1.5), -1);
+check('pick null', pick(null), -1);
+check('acc double', acc(3) + 0.5, 3.5);
+
+// Still right once everything has settled.
+$p = 0;
+for ($i = 0; $i < 50; ++$i) $p += pick($i & 1 ? 'ab' : $i);
+// 25 odd $i give strlen('ab'); the even ones sum to 2 * 600.
+check('pick mixed', $p, 25 * 2 + 2 * 600);
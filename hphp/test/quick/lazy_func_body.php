@@ -0,0 +1,107 @@
+<?php
+
+// Funcs loaded from a repo keep their exception handler and FPI tables
+// encoded until they first unwind or are translated.  In repo mode
+// (test/run -r), or whenever this unit comes out of the central repo,
+// every function below starts that way.  Each one needs its tables
+// for the first time in a different way: catching, rethrowing through
+// finally-free nesting, unwinding out of a call whose arguments are
+// still being pushed, and unwinding through a generator.
+
+class E1 extends Exception {}
+class E2 extends Exception {}
+
+function thrower($cls, $msg) {
+  throw new $cls($msg);
+}
+
+function catchDirect() {
+  try {
+    thrower('E1', 'direct');
+  } catch (E1 $e) {
+    return 'caught ' . $e->getMessage();
+  }
+  return 'not caught';
+}
+
+function catchNested() {
+  $log = array();
+  try {
+    try {
+      thrower('E2', 'inner');
+    } catch (E1 $e) {
+      $log[] = 'wrong handler';
+    }
+  } catch (E2 $e) {
+    $log[] = 'outer got ' . $e->getMessage();
+  }
+  try {
+    try {
+      thrower('E1', 'again');
+    } catch (E1 $e) {
+      $log[] = 'inner got ' . $e->getMessage();
+      throw new E2('rethrown');
+    }
+  } catch (E2 $e) {
+    $log[] = 'outer got ' . $e->getMessage();
+  }
+  return implode(', ', $log);
+}
+
+function three($a, $b, $c) {
+  return "$a$b$c";
+}
+
+// The exception leaves while three()'s ActRec and two of its arguments
+// are on the stack, so unwinding has to consult the FPI table.
+function throwInArgs() {
+  try {
+    return three('a', strtoupper('b'), thrower('E1', 'in args'));
+  } catch (E1 $e) {
+    return 'caught ' . $e->getMessage() . ', then ' . three(1, 2, 3);
+  }
+}
+
+function nestedArgs($n) {
+  $out = array();
+  for ($i = 0; $i < $n; $i++) {
+    try {
+      $out[] = three($i, three('(', $i % 2 ? thrower('E2', 'odd') : $i, ')'),
+                     '.');
+    } catch (E2 $e) {
+      $out[] = $e->getMessage();
+    }
+  }
+  return implode(' ', $out);
+}
+
+function gen() {
+  for ($i = 0; $i < 4; $i++) {
+    try {
+      if ($i == 2) thrower('E1', 'in generator');
+      yield $i;
+    } catch (E1 $e) {
+      yield $e->getMessage();
+    }
+  }
+}
+
+function neverCalled() {
+  try {
+    thrower('E1', 'unused');
+  } catch (E1 $e) {
+  }
+}
+
+echo catchDirect(), "\n";
+echo catchNested(), "\n";
+echo throwInArgs(), "\n";
+echo nestedArgs(4), "\n";
+$parts = array();
+foreach (gen() as $v) $parts[] = $v;
+echo implode(', ', $parts), "\n";
+
+// Second time round the tables are already decoded.
+echo catchDirect(), "\n";
+echo nestedArgs(2), "\n";
+echo function_exists('neverCalled') ? "neverCalled exists\n" : "missing\n";
@@ -0,0 +1,221 @@
+<?php
+
+// Arrays whose keys are 0..n-1 in order are stored without a hash
+// table until something needs one.  Check that each way of leaving or
+// re-entering that state keeps keys, order, the next free key and
+// iteration right.
+
+function show($label, $a) {
+  $parts = array();
+  foreach ($a as $k => $v) {
+    $parts[] = var_export($k, true) . '=>' . var_export($v, true);
+  }
+  // The key the next append will get.
+  $b = $a;
+  $b[] = 'next';
+  end($b);
+  echo $label, ': [', implode(', ', $parts), '] count=', count($a),
+    ' next=', var_export(key($b), true), "\n";
+}
+
+function lookups($label, $a) {
+  echo $label, ':';
+  foreach (array(0, 1, 2, 3, -1, '1', 'x') as $k) {
+    echo ' ', var_export($k, true), '=',
+      isset($a[$k]) ? var_export($a[$k], true) : 'unset';
+  }
+  echo "\n";
+}
+
+function append() {
+  $a = array();
+  for ($i = 0; $i < 20; $i++) {
+    $a[] = $i * 10;
+  }
+  echo 'append: count=', count($a), ' a[0]=', $a[0], ' a[19]=', $a[19], "\n";
+  $b = array('a', 'b');
+  $b[] = 'c';
+  $b[3] = 'd';
+  $b[1] = 'B';
+  show('append', $b);
+  lookups('append', $b);
+  $c = $b;
+  $c[] = 'e';
+  show('append copy', $c);
+  show('append original', $b);
+}
+
+function unsetMiddle() {
+  $a = array('a', 'b', 'c', 'd');
+  unset($a[1]);
+  show('unset middle', $a);
+  lookups('unset middle', $a);
+  $a[] = 'e';
+  show('unset middle, append', $a);
+  $a[1] = 'B';
+  show('unset middle, refill', $a);
+}
+
+function unsetEnd() {
+  $a = array('a', 'b', 'c');
+  unset($a[2]);
+  show('unset end', $a);
+  $a[] = 'd';
+  show('unset end, append', $a);
+  unset($a[5]);
+  show('unset missing', $a);
+}
+
+function popShift() {
+  $a = array('a', 'b', 'c', 'd');
+  var_dump(array_pop($a));
+  show('pop', $a);
+  $a[] = 'x';
+  show('pop, append', $a);
+  var_dump(array_shift($a));
+  show('shift', $a);
+  $a[] = 'y';
+  show('shift, append', $a);
+  array_unshift($a, 'first');
+  show('unshift', $a);
+  $e = array();
+  var_dump(array_pop($e), array_shift($e));
+  show('pop empty', $e);
+}
+
+function stringKeys() {
+  $a = array('a', 'b');
+  $a['k'] = 'v';
+  show('string key', $a);
+  lookups('string key', $a);
+  $a[] = 'c';
+  show('string key, append', $a);
+  $b = array('a', 'b');
+  $b['1'] = 'B';
+  show('numeric string key', $b);
+  $c = array('a', 'b');
+  $c[5] = 'f';
+  show('sparse int key', $c);
+  $c[] = 'g';
+  show('sparse int key, append', $c);
+  $d = array('a', 'b');
+  $d[-1] = 'm';
+  show('negative int key', $d);
+}
+
+function cmp($x, $y) {
+  return $x < $y ? 1 : ($x > $y ? -1 : 0);
+}
+
+function sorts() {
+  $a = array(3 => 'c', 1 => 'a', 'k' => 'b', 0 => 'd');
+  sort($a);
+  show('sort', $a);
+  $a[] = 'e';
+  show('sort, append', $a);
+  $b = array('x' => 2, 'y' => 3, 'z' => 1);
+  usort($b, 'cmp');
+  show('usort', $b);
+  lookups('usort', $b);
+  $c = array(5 => 'a', 2 => 'b');
+  rsort($c);
+  show('rsort', $c);
+  $d = array('b', 'a', 'c');
+  asort($d);
+  show('asort', $d);
+  $d[] = 'z';
+  show('asort, append', $d);
+  $e = array(2 => 'x', 0 => 'y');
+  $f = array_values($e);
+  show('array_values', $f);
+}
+
+function refs() {
+  $a = array(1, 2, 3);
+  $r = &$a[1];
+  $r = 20;
+  $a[1] = 200;
+  show('ref element', $a);
+  echo 'ref sees ', $r, "\n";
+  foreach ($a as &$v) {
+    $v = $v + 1;
+  }
+  unset($v);
+  show('foreach by ref', $a);
+}
+
+function eachThenForeach() {
+  $a = array('a', 'b', 'c');
+  $kv = each($a);
+  echo 'each: ', $kv[0], '=>', $kv[1], "\n";
+  $kv = each($a);
+  echo 'each: ', $kv[0], '=>', $kv[1], "\n";
+  show('foreach after each', $a);
+  unset($a[0]);
+  $a[] = 'd';
+  show('foreach after each, unset, append', $a);
+}
+
+function summary($label, $a) {
+  $keys = 0;
+  $sum = 0;
+  foreach ($a as $k => $v) {
+    if (is_int($k)) $keys += $k;
+    if (is_int($v)) $sum += $v;
+  }
+  reset($a);
+  $first = key($a);
+  end($a);
+  $last = key($a);
+  echo $label, ': count=', count($a), ' first=', var_export($first, true),
+    ' last=', var_export($last, true), ' keysum=', $keys, ' sum=', $sum, "\n";
+}
+
+function big($n) {
+  $a = array();
+  for ($i = 0; $i < $n; $i++) {
+    $a[] = $i;
+  }
+  return $a;
+}
+
+// Big packed arrays don't allocate their hash table until they leave
+// the packed state.
+function bigArrays() {
+  $a = big(1000);
+  summary('big', $a);
+  $a['k'] = 5;
+  summary('big, string key', $a);
+  echo 'big lookups: ', $a[0], ' ', $a[500], ' ', $a[999], ' ', $a['k'], ' ',
+    isset($a[1000]) ? 'set' : 'unset', "\n";
+
+  $b = big(1000);
+  $c = $b;
+  $c[5000] = 1;
+  summary('big copy, sparse key', $c);
+  summary('big original', $b);
+  $c[] = 2;
+  echo 'big copy next: ', $c[5001], "\n";
+
+  $d = big(1000);
+  arsort($d);
+  summary('big arsort', $d);
+  echo 'big arsort lookups: ', $d[0], ' ', $d[999], "\n";
+
+  $e = big(1000);
+  array_shift($e);
+  summary('big shift', $e);
+  unset($e[10]);
+  $e[] = 7;
+  summary('big shift, unset, append', $e);
+}
+
+append();
+unsetMiddle();
+unsetEnd();
+popShift();
+stringKeys();
+sorts();
+refs();
+eachThenForeach();
+bigArrays();
@@ -0,0 +1,103 @@
+<?php
+
+// In RepoAuthoritative mode (test/run -r) the .opts file makes hhvm
+// build a repo image from this test's repo at startup, map it, and
+// load this unit out of it.  Repo.Image.Verify loads the unit from
+// SQLite as well and logs an error, which lands in the output, if the
+// two differ.  Outside repo mode the options do nothing and this is an
+// ordinary test.  The code below just gives the unit a bit of
+// everything a unit record holds: literal strings and arrays, classes,
+// functions, closures, generators, constants and exception handlers.
+
+const GREETING = 'hello';
+define('TIMES', 3);
+
+interface Shape {
+  function area();
+}
+
+abstract class Base implements Shape {
+  const SIDES = 0;
+  protected static $made = 0;
+  public $name;
+
+  function __construct($name) {
+    $this->name = $name;
+    ++self::$made;
+  }
+
+  static function made() {
+    return self::$made;
+  }
+}
+
+class Square extends Base {
+  const SIDES = 4;
+  private $side;
+
+  function __construct($side) {
+    parent::__construct('square');
+    $this->side = $side;
+  }
+
+  function area() {
+    return $this->side * $this->side;
+  }
+}
+
+class Triangle extends Base {
+  const SIDES = 3;
+  private $base, $height;
+
+  function __construct($base, $height) {
+    parent::__construct('triangle');
+    $this->base = $base;
+    $this->height = $height;
+  }
+
+  function area() {
+    return $this->base * $this->height / 2;
+  }
+}
+
+function describe(Shape $s, $prefix = 'shape') {
+  static $calls = 0;
+  ++$calls;
+  return sprintf('%s %d: %s area=%s sides=%d', $prefix, $calls, $s->name,
+                 $s->area(), constant(get_class($s) . '::SIDES'));
+}
+
+function gen() {
+  yield 1;
+  yield 2;
+}
+
+function name($n) {
+  switch ($n) {
+    case 1: return 'one';
+    case 2: return 'two';
+    default: return 'many';
+  }
+}
+
+echo GREETING, ' ', TIMES, "\n";
+echo describe(new Square(3)), "\n";
+echo describe(new Triangle(3, 5), 'triangle'), "\n";
+echo Base::made(), "\n";
+foreach (gen() as $v) {
+  echo $v;
+}
+echo "\n";
+$table = array('a' => array(1, 2, 3),
+               'b' => array('x' => true, 'y' => null),
+               'c' => 2.5);
+echo json_encode($table), "\n";
+$k = 3;
+$add = function($x) use ($k) { return $x + $k; };
+echo $add(4), "\n";
+try {
+  throw new Exception('boom');
+} catch (Exception $e) {
+  echo 'caught ', $e->getMessage(), "\n";
+}
+echo name(2), ' ', name(7), "\n";
@@ -0,0 +1,43 @@
+<?php
+
+/**
+ * Lookups of short, dynamically built string keys, so nearly every hit
+ * compares key bytes rather than StringData pointers.  The keys run from
+ * 2 to 21 bytes, on both sides of the 16-byte SSE2 compare.
+ */
+
+function make_keys($n) {
+  $keys = array();
+  for ($i = 0; $i < $n; $i++) {
+    $keys[] = 'k' . str_repeat('x', $i % 20) . $i;
+  }
+  return $keys;
+}
+
+function build($keys) {
+  $a = array();
+  foreach ($keys as $i => $k) {
+    $a[$k] = $i;
+  }
+  return $a;
+}
+
+function probe($a, $n, $rounds) {
+  $sum = 0;
+  $misses = 0;
+  for ($r = 0; $r < $rounds; $r++) {
+    for ($i = 0; $i < $n; $i++) {
+      // A fresh copy of the key, not the one stored in $a.
+      $k = 'k' . str_repeat('x', $i % 20) . $i;
+      $sum += $a[$k];
+      if (!isset($a[$k . 'y'])) $misses++;
+    }
+  }
+  return array($sum, $misses);
+}
+
+$n = 1000;
+$a = build(make_keys($n));
+list($sum, $misses) = probe($a, $n, 2000);
+echo "sum: $sum\n";
+echo "misses: $misses\n";
@@ -58,6 +58,7 @@ void freeSlab(Address addr, size_t size) {
 
 void DataBlock::init() {
   base = frontier = allocSlab(size);
+  bounded = false;
 }
 
 void DataBlock::free() {
@@ -69,6 +70,7 @@ void DataBlock::free() {
 void DataBlock::init(Address start, size_t sz) {
   base = frontier = start;
   size = sz;
+  bounded = false;
 }
 
 void DataBlock::makeExecable() {
@@ -89,6 +91,7 @@ void CodeBlock::initCodeBlock(size_t sz) {
 void CodeBlock::initCodeBlock(CodeAddress start, size_t sz) {
   base = frontier = start;
   size = sz;
+  bounded = false;
   makeExecable();
 }
 
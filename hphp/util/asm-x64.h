@@ -17,6 +17,7 @@
 #define incl_HPHP_UTIL_ASM_X64_H_
 
 #include <type_traits>
+#include <stdexcept>
 
 #include "hphp/util/util.h"
 #include "hphp/util/base.h"
@@ -491,6 +492,14 @@ namespace sz {
 Address allocSlab(size_t size);
 void freeSlab(Address addr, size_t size);
 
+/*
+ * Thrown when emitting into a bounded DataBlock that doesn't have room
+ * for the bytes being written.
+ */
+struct DataBlockFull : std::runtime_error {
+  DataBlockFull() : std::runtime_error("DataBlock full") {}
+};
+
 /*
  * This needs to be a POD type (no user-declared constructors is the most
  * important characteristic) so that it can be made thread-local.
@@ -499,6 +508,13 @@ struct DataBlock {
   logical_const Address base;
   Address               frontier;
   size_t                size;
+  /*
+   * Blocks that can't be allowed to overflow, even in release builds,
+   * set this; every write into them is then checked and throws
+   * DataBlockFull instead of running past base + size.  The init
+   * functions clear it.
+   */
+  bool                  bounded;
 
   /*
    * mmap()s in the desired amount of memory. The size member must be set.
@@ -537,6 +553,9 @@ struct DataBlock {
     }
     assert((uintptr_t(frontier) & (align - 1)) == 0);
     frontierOff += sz;
+    if (UNLIKELY(bounded) && frontierOff > size) {
+      throw DataBlockFull();
+    }
     assert(frontierOff <= size);
     return frontier;
   }
@@ -554,37 +573,48 @@ struct DataBlock {
     return frontier + nBytes <= base + size;
   }
 
+  /*
+   * Called before every write.  Only bounded blocks pay for a real
+   * check; for the rest this is the usual debug-only assert.
+   */
+  void ensureRoom(size_t nBytes) {
+    if (UNLIKELY(bounded) && !canEmit(nBytes)) {
+      throw DataBlockFull();
+    }
+    assert(canEmit(nBytes));
+  }
+
   bool isValidAddress(const CodeAddress tca) const {
     return tca >= base && tca < (base + size);
   }
 
   void byte(const uint8_t byte) {
-    assert(canEmit(sz::byte));
+    ensureRoom(sz::byte);
     TRACE(10, "%p b : %02x\n", frontier, byte);
     *frontier = byte;
     frontier += sz::byte;
   }
   void word(const uint16_t word) {
-    assert(canEmit(sz::word));
+    ensureRoom(sz::word);
     *(uint16_t*)frontier = word;
     TRACE(10, "%p w : %04x\n", frontier, word);
     frontier += sz::word;
   }
   void dword(const uint32_t dword) {
-    assert(canEmit(sz::dword));
+    ensureRoom(sz::dword);
     TRACE(10, "%p d : %08x\n", frontier, dword);
     *(uint32_t*)frontier = dword;
     frontier += sz::dword;
   }
   void qword(const uint64_t qword) {
-    assert(canEmit(sz::qword));
+    ensureRoom(sz::qword);
     TRACE(10, "%p q : %016lx\n", frontier, qword);
     *(uint64_t*)frontier = qword;
     frontier += sz::qword;
   }
 
   void bytes(size_t n, const uint8_t *bs) {
-    assert(canEmit(n));
+    ensureRoom(n);
     TRACE(10, "%p [%ld b] : [%p]\n", frontier, n, bs);
     if (n <= 8) {
       // If it is a modest number of bytes, try executing in one machine
@@ -614,6 +644,7 @@ protected:
   void makeExecable();
 
   void *rawBytes(size_t n) {
+    ensureRoom(n);
     void* retval = (void*) frontier;
     frontier += n;
     return retval;
@@ -1305,6 +1336,7 @@ struct X64Assembler {
   }
 
   void emitInt3s(int n) {
+    code.ensureRoom(n);
     memset(code.frontier, 0xcc, n);
     code.frontier += n;
   }
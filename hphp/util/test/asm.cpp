@@ -704,4 +704,54 @@ asm_label(a, loop);
   test_case(127);
 }
 
+TEST(Asm, BoundedBlockFull) {
+  // Carve a small bounded block out of a bigger one, the way reclaimed
+  // translation cache space is handed to the JIT, and fill it up.
+  Asm big;
+  big.init(4096);
+  memset(big.code.base, 0xcc, 4096);
+
+  const size_t kBlockLen = 61;
+  Address const start = big.code.base + 128;
+  Address const end = start + kBlockLen;
+
+  Asm a;
+  a.code.init(start, kBlockLen);
+  a.code.bounded = true;
+
+  int emitted = 0;
+  bool full = false;
+  try {
+    for (;;) {
+      a.    movq   (rax, rbx);
+      ++emitted;
+      ASSERT_LE(a.code.frontier, end);
+    }
+  } catch (const DataBlockFull&) {
+    full = true;
+  }
+  EXPECT_TRUE(full);
+  EXPECT_EQ(kBlockLen / 3, emitted);
+  EXPECT_LE(a.code.frontier, end);
+  for (Address p = end; p < big.code.base + 4096; ++p) {
+    ASSERT_EQ(0xcc, *p) << "wrote past the block at +" << (p - end);
+  }
+
+  // Multi-byte writes must not start if they can't finish.
+  a.code.frontier = end - 2;
+  EXPECT_THROW(a.emitNop(3), DataBlockFull);
+  EXPECT_THROW(a.emitInt3s(3), DataBlockFull);
+  EXPECT_THROW(a.code.alloc<uint64_t>(1), DataBlockFull);
+  EXPECT_EQ(0xcc, end[0]);
+
+  // Exactly filling the block is fine.
+  a.    emitNop(2);
+  EXPECT_EQ(end, a.code.frontier);
+  EXPECT_FALSE(a.code.canEmit(1));
+
+  // Re-initializing drops the bound.
+  a.code.init(start, kBlockLen);
+  EXPECT_FALSE(a.code.bounded);
+}
+
 }}
@@ -95,6 +95,7 @@ namespace Trace {
       TM(statgroups)  \
       TM(minstr)      \
       TM(region)      \
+      TM(pgo)         \
       /* Stress categories, to exercise rare paths */ \
       TM(stress_txInterpPct)    \
       TM(stress_txInterpSeed)   \